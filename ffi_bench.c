@@ -0,0 +1,134 @@
+/*
+ * Calls libsimdxorshift.so through its C interface, as an FFI consumer would, to check that
+ * the per-call cost is amortized for large batches. Also checks seeding and shuffles.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <x86intrin.h>
+
+#include "include/simdxorshift.h"
+
+#define MAX_BATCH (1 << 22)
+#define TOTAL (1 << 24)
+
+static uint32_t u32[MAX_BATCH];
+static float f32[MAX_BATCH];
+
+static int compare_u32(const void* a, const void* b)
+{
+	uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+
+	return (x > y) - (x < y);
+}
+
+int main(void)
+{
+	printf("libsimdxorshift ABI version %d\n\n", simdxorshift_abi_version());
+
+	simdxorshift_generator* gen = simdxorshift_create(0x853c49e6748fea9bull, 0xda3e39cb94b95bdbull);
+
+	/* The same seeds give the same numbers */
+	simdxorshift_generator* a = simdxorshift_create(1, 2);
+	simdxorshift_generator* b = simdxorshift_create(1, 2);
+	uint32_t first[1000], second[1000];
+
+	simdxorshift_fill_u32(a, first, 1000);
+	simdxorshift_fill_u32(b, second, 1000);
+
+	printf("Same seeds, same numbers %d\n", memcmp(first, second, sizeof(first)) == 0);
+
+	/* Seeds (0, 0) give a working generator too */
+	simdxorshift_generator* zero = simdxorshift_create(0, 0);
+	float normals[1000];
+	int zero_words = 0, zero_normals = 0;
+
+	simdxorshift_fill_u32(zero, second, 1000);
+	simdxorshift_normal_f32(zero, normals, 1000, 0.0f, 1.0f);
+
+	for (int i = 0; i < 1000; i++)
+	{
+		zero_words += second[i] == 0;
+		zero_normals += normals[i] == 0.0f;
+	}
+
+	printf("Seeds (0, 0), zero words %d and zero normals %d, expected 0\n", zero_words, zero_normals);
+
+	simdxorshift_destroy(zero);
+
+	simdxorshift_generator* child = simdxorshift_split(a);
+
+	simdxorshift_fill_u32(a, first, 1000);
+	simdxorshift_fill_u32(child, second, 1000);
+
+	printf("Split child differs from parent %d\n", memcmp(first, second, sizeof(first)) != 0);
+
+	simdxorshift_destroy(child);
+	simdxorshift_destroy(b);
+	simdxorshift_destroy(a);
+
+	/* A shuffle is a permutation */
+	for (uint32_t i = 0; i < 100000; i++)
+		u32[i] = i;
+
+	simdxorshift_shuffle_u32(gen, u32, 100000);
+	qsort(u32, 100000, sizeof(uint32_t), compare_u32);
+
+	int permutation = 1;
+
+	for (uint32_t i = 0; i < 100000; i++)
+		permutation &= u32[i] == i;
+
+	printf("Shuffle is a permutation %d\n", permutation);
+
+	simdxorshift_uniform_f32(gen, f32, 1 << 20);
+
+	double sum = 0;
+	int in_range = 1;
+
+	for (int i = 0; i < 1 << 20; i++)
+	{
+		sum += f32[i];
+		in_range &= f32[i] >= 0.0f && f32[i] < 1.0f;
+	}
+
+	printf("Uniform floats in [0, 1) %d, mean %.4f expected 0.5\n\n", in_range, sum / (1 << 20));
+
+	/* The same TOTAL numbers in batches of each size, the best of 5 runs */
+	printf("Time reported in number of cycles per 32-bit number, %d numbers per run\n\n", TOTAL);
+	printf("%10s %12s %12s %12s\n", "batch", "fill_u32", "uniform_f32", "normal_f32");
+
+	for (size_t batch = 1; batch <= MAX_BATCH; batch *= 16)
+	{
+		double best[3] = {1e30, 1e30, 1e30};
+
+		for (int run = 0; run < 5; run++)
+		{
+			for (int f = 0; f < 3; f++)
+			{
+				unsigned long long start = __rdtsc();
+
+				for (size_t done = 0; done < TOTAL; done += batch)
+				{
+					if (f == 0)
+						simdxorshift_fill_u32(gen, u32, batch);
+					else if (f == 1)
+						simdxorshift_uniform_f32(gen, f32, batch);
+					else
+						simdxorshift_normal_f32(gen, f32, batch, 0.0f, 1.0f);
+				}
+
+				double cycles = (double)(__rdtsc() - start) / TOTAL;
+
+				if (cycles < best[f])
+					best[f] = cycles;
+			}
+		}
+
+		printf("%10zu %12.2f %12.2f %12.2f\n", batch, best[0], best[1], best[2]);
+	}
+
+	simdxorshift_destroy(gen);
+
+	return 0;
+}
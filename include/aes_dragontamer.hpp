@@ -4,9 +4,11 @@
 #include <cstring>
 #include <iostream>
 #include <array>
-#include <immintrin.h>
 
+#include "simd_intrinsics.hpp"
 #include "randutils.hpp"
+#include "xorshift128plus.hpp"
+#include "keystream.hpp"
 
 // This may be needed for older versions of GCC
 #if __GNUC__ < 8
@@ -17,6 +19,15 @@
 class aes_dragontamer_key
 {
 protected:
+	void init_state(uint64_t seed1, uint64_t seed2)
+	{
+		// Create a __m128i with 16 8-bit numbers
+		increment = _mm_set_epi8(0x2f, 0x2b, 0x29, 0x25, 0x1f, 0x1d, 0x17, 0x13, 
+								0x11, 0x0D, 0x0B, 0x07, 0x05, 0x03, 0x02, 0x01);
+
+		// Create __m128i with 2 64-bit numbers
+		state = _mm_set_epi64x(seed1, seed2);
+	}
 
 public:
 	aes_dragontamer_key()
@@ -36,12 +47,87 @@ public:
 		uint64_t seed1 = seed_part1 << 32 | seed_part2;
 		uint64_t seed2 = seed_part3 << 32 | seed_part4;
 
-		// Create a __m128i with 16 8-bit numbers
-		increment = _mm_set_epi8(0x2f, 0x2b, 0x29, 0x25, 0x1f, 0x1d, 0x17, 0x13, 
-								0x11, 0x0D, 0x0B, 0x07, 0x05, 0x03, 0x02, 0x01);
+		init_state(seed1, seed2);
+	}
 
-		// Create __m128i with 2 64-bit numbers
-		state = _mm_set_epi64x(seed1, seed2);
+	// Explicitly seeded key, gives a reproducible stream
+	aes_dragontamer_key(uint64_t seed1, uint64_t seed2)
+	{
+		init_state(seed1, seed2);
+	}
+
+	// Move the counter on by a number of calls to the generator
+	// The generator is counter based so this is as cheap as a single step
+	void advance(uint64_t steps)
+	{
+		alignas(16) uint64_t inc[2];
+
+		_mm_store_si128((__m128i *)inc, increment);
+
+		state = _mm_add_epi64(state, _mm_set_epi64x(inc[1] * steps, inc[0] * steps));
+	}
+
+	// A child key for a forked task, see xorshift128plus_key::split
+	// The counter moves one step and both of its halves are mixed into the child's starting counter
+	aes_dragontamer_key split()
+	{
+		state = _mm_add_epi64(state, increment);
+
+		alignas(16) uint64_t counter[2];
+
+		_mm_store_si128((__m128i *)counter, state);
+
+		uint64_t x = counter[0] ^ xorshift128plus_key::splitmix64(counter[1]);
+
+		const uint64_t child_low = xorshift128plus_key::splitmix64(x);
+		const uint64_t child_high = xorshift128plus_key::splitmix64(x);
+
+		aes_dragontamer_key child(*this);
+
+		child.state = _mm_set_epi64x(child_high, child_low);
+
+		return child;
+	}
+
+	__m128i state;
+	__m128i increment;
+};
+
+
+// A value type copy of a key for use inside hand-written SIMD loops
+// See simd_xorshift128plus_state
+class aes_dragontamer_state
+{
+public:
+	aes_dragontamer_state() {}
+
+	explicit aes_dragontamer_state(const aes_dragontamer_key& key)
+	{
+		load_state(key);
+	}
+
+	inline __attribute__((always_inline)) void load_state(const aes_dragontamer_key& key)
+	{
+		state = key.state;
+		increment = key.increment;
+	}
+
+	inline __attribute__((always_inline)) void store_state(aes_dragontamer_key& key) const
+	{
+		key.state = state;
+		key.increment = increment;
+	}
+
+	// Same sequence as aes_dragontamer::get_rand
+	inline __attribute__((always_inline)) __m256i next()
+	{
+		state = _mm_add_epi64(state, increment);
+
+		__m128i penultimate = _mm_aesenc_si128(state, increment); 
+		__m128i penultimate1 = _mm_aesenc_si128(penultimate, increment); 
+		__m128i penultimate2 = _mm_aesdec_si128(penultimate, increment);
+
+		return _mm256_set_m128i(penultimate1, penultimate2);
 	}
 
 	__m128i state;
@@ -52,6 +138,9 @@ public:
 class aes_dragontamer
 {
 protected:
+	// Aligned fills of at least this many numbers (16 MiB) bypass the caches
+	static constexpr uint32_t stream_threshold = uint32_t(1) << 22;
+
 	inline __m256i aesdragontamer_rand(aes_dragontamer_key& key) 
 	{
 		key.state = _mm_add_epi64(key.state, key.increment);
@@ -67,15 +156,38 @@ protected:
 
 	void populateRandom_avx_aesdragontamer(uint32_t* rand_arr, const uint32_t size) 
 	{
-	    uint32_t i = 0;
-
 		// Create a seed object for the rng
 		aes_dragontamer_key my_key;
 
+		populateRandom_avx_aesdragontamer(rand_arr, size, my_key);
+	}
+
+	// As above but continues the stream of a caller-owned key
+	void populateRandom_avx_aesdragontamer(uint32_t* rand_arr, const uint32_t size, aes_dragontamer_key& my_key) 
+	{
+	    uint32_t i = 0;
+
         // The number of variables we're operating on
         // Should be 8 here
 	    const uint32_t block = sizeof(__m256i) / sizeof(uint32_t); // 8
 	    
+	    if (uintptr_t(rand_arr) % sizeof(__m256i) == 0)
+	    {
+	        // See simd_xorshift128plus::populate_array_simd_xorshift128plus
+	        if (size >= stream_threshold)
+	        {
+	            for (; i + block <= size; i += block)
+	                _mm256_stream_si256((__m256i *)(rand_arr + i), aesdragontamer_rand(my_key));
+
+	            _mm_sfence();
+	        }
+	        else
+	        {
+	            for (; i + block <= size; i += block)
+	                _mm256_store_si256((__m256i *)(rand_arr + i), aesdragontamer_rand(my_key));
+	        }
+	    }
+
 	    while (i + block <= size) 
 	    {
 	        _mm256_storeu_si256((__m256i *)(rand_arr + i), aesdragontamer_rand(my_key));
@@ -102,6 +214,11 @@ public:
     	return populateRandom_avx_aesdragontamer(rand_arr, N_rands);
     }
 
+	void fill_array(uint32_t* rand_arr, uint32_t N_rands, aes_dragontamer_key& key)
+    {
+    	return populateRandom_avx_aesdragontamer(rand_arr, N_rands, key);
+    }
+
 	inline __m256i get_rand(aes_dragontamer_key& key)
 	{
 		return aesdragontamer_rand(key);
@@ -111,6 +228,75 @@ public:
 	{
 		return aesdragontamer_rand(key);
 	}	
+
+	// Calls fn(rand, x) on each 256-bit vector x of data and stores the result back in place
+	// See simd_xorshift128plus::transform_with_random
+	template <typename T, typename FN>
+	void transform_with_random(T* data, std::size_t n, FN&& fn, aes_dragontamer_key& key)
+	{
+		aes_dragontamer_state state(key);
+
+		unsigned char* bytes = (unsigned char *)data;
+
+		const std::size_t size = n * sizeof(T);
+		const std::size_t block = sizeof(__m256i);
+
+		std::size_t i = 0;
+
+		while (i + block <= size)
+		{
+			_mm256_storeu_si256((__m256i *)(bytes + i), fn(state.next(), _mm256_loadu_si256((const __m256i *)(bytes + i))));
+
+			i += block;
+		}
+
+		if (i != size)
+		{
+			unsigned char buffer[sizeof(__m256i)] = {0};
+
+			std::memcpy(buffer, bytes + i, size - i);
+
+			_mm256_storeu_si256((__m256i *)buffer, fn(state.next(), _mm256_loadu_si256((const __m256i *)buffer)));
+
+			std::memcpy(bytes + i, buffer, size - i);
+		}
+
+		state.store_state(key);
+	}
+
+	template <typename T, typename FN>
+	void transform_with_random(T* data, std::size_t n, FN&& fn)
+	{
+		aes_dragontamer_key key;
+
+		return transform_with_random(data, n, fn, key);
+	}
+
+	// XORs len bytes at buf with the keystream of key, starting at byte offset of the stream
+	// The generator is counter based so seeking to any offset costs a single advance,
+	// applying it twice restores the data and any sub-range can be done on its own
+	void xor_keystream(void* buf, std::size_t len, const aes_dragontamer_key& key, uint64_t offset = 0)
+	{
+		aes_dragontamer_key start(key);
+
+		start.advance(offset / sizeof(__m256i));
+
+		aes_dragontamer_state state(start);
+
+		keystream_xor_bytes((unsigned char *)buf, len, offset % sizeof(__m256i), state);
+	}
+
+	void xor_keystream(void* buf, std::size_t len)
+	{
+		aes_dragontamer_key key;
+
+		return xor_keystream(buf, len, key);
+	}
+
+	void xor_keystream_parallel(void* buf, std::size_t len, const aes_dragontamer_key& key, uint64_t offset, unsigned n_threads)
+	{
+		return keystream_xor_parallel<aes_dragontamer>(buf, len, key, offset, n_threads);
+	}
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,174 @@
+#ifndef ALIGNEDBUFFER_H
+#define ALIGNEDBUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <sys/mman.h>
+
+// How the pages of a large buffer are backed
+// transparent_huge asks for 2 MiB pages with madvise(MADV_HUGEPAGE), which needs THP set to
+// "madvise" or "always". explicit_huge maps from the reserved hugetlbfs pool with MAP_HUGETLB
+// and falls back to transparent_huge when the pool is empty
+enum class page_backing { normal, transparent_huge, explicit_huge };
+
+
+// 64-byte aligned memory, so every 256 and 512-bit store of the fill kernels is aligned
+// Blocks of huge_page_size or more are mapped directly and 2 MiB aligned, smaller ones use aligned new.
+// Large blocks are never touched here, so the first write decides their NUMA node
+class aligned_memory
+{
+public:
+	static constexpr std::size_t alignment = 64;
+	static constexpr std::size_t huge_page_size = std::size_t(2) << 20;
+
+	static bool is_mapped(std::size_t bytes)
+	{
+		return bytes >= huge_page_size;
+	}
+
+	static std::size_t mapped_size(std::size_t bytes)
+	{
+		return (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+	}
+
+	static void* allocate(std::size_t bytes, page_backing backing = page_backing::transparent_huge)
+	{
+		if (!is_mapped(bytes))
+			return ::operator new(bytes, std::align_val_t(alignment));
+
+		const std::size_t size = mapped_size(bytes);
+
+		if (backing == page_backing::explicit_huge)
+		{
+			void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+			if (p != MAP_FAILED)
+				return p;
+		}
+
+		// Map an extra huge page and trim both ends so the block starts on a 2 MiB boundary
+		char* raw = (char *)mmap(nullptr, size + huge_page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if (raw == (char *)MAP_FAILED)
+			throw std::bad_alloc();
+
+		char* p = (char *)((uintptr_t(raw) + huge_page_size - 1) & ~uintptr_t(huge_page_size - 1));
+
+		if (p != raw)
+			munmap(raw, p - raw);
+
+		munmap(p + size, raw + huge_page_size - p);
+
+		if (backing != page_backing::normal)
+			madvise(p, size, MADV_HUGEPAGE);
+
+		return p;
+	}
+
+	static void deallocate(void* p, std::size_t bytes)
+	{
+		if (p == nullptr)
+			return;
+
+		if (!is_mapped(bytes))
+			return ::operator delete(p, std::align_val_t(alignment));
+
+		munmap(p, mapped_size(bytes));
+	}
+};
+
+
+// Standard allocator over aligned_memory, for std::vector<T, aligned_allocator<T>>
+template <typename T, page_backing backing = page_backing::transparent_huge>
+class aligned_allocator
+{
+public:
+	typedef T value_type;
+
+	template <typename U>
+	struct rebind
+	{
+		typedef aligned_allocator<U, backing> other;
+	};
+
+	aligned_allocator() noexcept {}
+
+	template <typename U>
+	aligned_allocator(const aligned_allocator<U, backing>&) noexcept {}
+
+	T* allocate(std::size_t n)
+	{
+		return (T *)aligned_memory::allocate(n * sizeof(T), backing);
+	}
+
+	void deallocate(T* p, std::size_t n)
+	{
+		aligned_memory::deallocate(p, n * sizeof(T));
+	}
+
+	template <typename U>
+	bool operator==(const aligned_allocator<U, backing>&) const noexcept
+	{
+		return true;
+	}
+
+	template <typename U>
+	bool operator!=(const aligned_allocator<U, backing>&) const noexcept
+	{
+		return false;
+	}
+};
+
+
+// A fixed size aligned array of trivially copyable T that is left uninitialized
+// Unlike std::vector nothing is written on construction
+template <typename T>
+class aligned_buffer
+{
+protected:
+	T* ptr = nullptr;
+	std::size_t n = 0;
+
+public:
+	aligned_buffer() {}
+
+	explicit aligned_buffer(std::size_t size, page_backing backing = page_backing::transparent_huge)
+		: ptr((T *)aligned_memory::allocate(size * sizeof(T), backing)), n(size) {}
+
+	aligned_buffer(const aligned_buffer&) = delete;
+	aligned_buffer& operator=(const aligned_buffer&) = delete;
+
+	aligned_buffer(aligned_buffer&& other) noexcept : ptr(other.ptr), n(other.n)
+	{
+		other.ptr = nullptr;
+		other.n = 0;
+	}
+
+	aligned_buffer& operator=(aligned_buffer&& other) noexcept
+	{
+		std::swap(ptr, other.ptr);
+		std::swap(n, other.n);
+
+		return *this;
+	}
+
+	~aligned_buffer()
+	{
+		aligned_memory::deallocate(ptr, n * sizeof(T));
+	}
+
+	T* data() { return ptr; }
+	const T* data() const { return ptr; }
+
+	std::size_t size() const { return n; }
+
+	T& operator[](std::size_t i) { return ptr[i]; }
+	const T& operator[](std::size_t i) const { return ptr[i]; }
+
+	T* begin() { return ptr; }
+	T* end() { return ptr + n; }
+};
+
+#endif
@@ -0,0 +1,510 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <array>
+#include <vector>
+#include <utility>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <cpuid.h>
+
+#include "simd_intrinsics.hpp"
+#include "simd_xorshift128plus.hpp"
+#include "aes_dragontamer.hpp"
+#include "keystream.hpp"
+#include "aligned_buffer.hpp"
+#include "rng_pool.hpp"
+
+#if defined(__AVX512F__)
+	#include "simd_avx512_xorshift128plus.hpp"
+#endif
+
+// Routes fill_array to whichever variant is fastest on this host
+// Variants differ in engine (AVX2 or AVX-512 xorshift, dragontamer), in how many independent
+// states are interleaved (1, 2, 4 or 8) and, for large arrays, in streaming or regular stores.
+// Small and large arrays get their own winner, each timed on the first fill of its size and
+// cached per CPU model in $SIMDXORSHIFT_TUNE_FILE, or ~/.simd_xorshift_autotune. Setting $SIMDXORSHIFT_FILL to a
+// variant name, or calling pin(), skips the timing. Small arrays never use streaming stores,
+// a streaming variant chosen for them is replaced by the same variant with regular stores
+class fill_autotuner
+{
+public:
+	// Arrays of at least this many numbers (16 MiB, as the fill kernels' stream_threshold)
+	// use the large array winner
+	static constexpr std::size_t large_threshold = std::size_t(1) << 22;
+
+protected:
+	static constexpr unsigned max_interleave = 8;
+
+	// Sizes the variants are timed on, large arrays well past the last level cache
+	static constexpr std::size_t small_tune_size = std::size_t(1) << 14;
+	static constexpr std::size_t large_tune_size = std::size_t(1) << 24;
+
+	// Every key is a substream of the global pool, no key seeds itself
+	std::array<simd_xorshift128plus_key, max_interleave> xorshift_keys;
+#if defined(__AVX512F__)
+	std::array<simd_avx512_xorshift128plus_key, max_interleave> avx512_keys;
+#endif
+	std::array<aes_dragontamer_key, max_interleave> dragontamer_keys;
+
+	template <typename KEY, std::size_t... I>
+	static std::array<KEY, sizeof...(I)> pool_keys(KEY (rng_pool::*make)(), std::index_sequence<I...>)
+	{
+		rng_pool& pool = rng_pool::global();
+
+		return {{((void)I, (pool.*make)())...}};
+	}
+
+	typedef void (*fill_fn)(fill_autotuner&, uint32_t*, std::size_t);
+
+	struct variant
+	{
+		std::string name;
+		fill_fn fn;
+		bool streaming;
+	};
+
+	static void stream_store(uint32_t* p, __m256i v)
+	{
+		_mm256_stream_si256((__m256i *)p, v);
+	}
+
+#if defined(__AVX512F__)
+	static void stream_store(uint32_t* p, __m512i v)
+	{
+		_mm512_stream_si512((__m512i *)p, v);
+	}
+#endif
+
+	// N states take turns filling consecutive vectors so their dependency chains overlap
+	// Streaming stores need aligned vectors, other arrays fall back to regular stores
+	template <typename STATE, unsigned N, bool streaming, typename KEY>
+	static void interleaved_fill(uint32_t* out, std::size_t n, KEY* keys)
+	{
+		typedef decltype(std::declval<STATE&>().next()) VEC;
+
+		if (streaming && uintptr_t(out) % sizeof(VEC) != 0)
+			return interleaved_fill<STATE, N, false>(out, n, keys);
+
+		const std::size_t block = sizeof(VEC) / sizeof(uint32_t);
+
+		STATE states[N];
+
+		for (unsigned j = 0; j < N; j++)
+			states[j].load_state(keys[j]);
+
+		std::size_t i = 0;
+
+		for (; i + N * block <= n; i += N * block)
+		{
+			for (unsigned j = 0; j < N; j++)
+			{
+				if (streaming)
+					stream_store(out + i + j * block, states[j].next());
+				else
+					keystream_store((unsigned char *)(out + i + j * block), states[j].next());
+			}
+		}
+
+		if (streaming)
+			_mm_sfence();
+
+		for (; i + block <= n; i += block)
+			keystream_store((unsigned char *)(out + i), states[0].next());
+
+		if (i != n)
+		{
+			alignas(64) unsigned char buffer[sizeof(VEC)];
+
+			keystream_store(buffer, states[0].next());
+
+			std::memcpy(out + i, buffer, sizeof(uint32_t) * (n - i));
+		}
+
+		for (unsigned j = 0; j < N; j++)
+			states[j].store_state(keys[j]);
+	}
+
+	struct xorshift_avx2
+	{
+		template <unsigned N, bool streaming>
+		static void fill(fill_autotuner& tuner, uint32_t* out, std::size_t n)
+		{
+			interleaved_fill<simd_xorshift128plus_state, N, streaming>(out, n, tuner.xorshift_keys.data());
+		}
+	};
+
+#if defined(__AVX512F__)
+	struct xorshift_avx512
+	{
+		template <unsigned N, bool streaming>
+		static void fill(fill_autotuner& tuner, uint32_t* out, std::size_t n)
+		{
+			interleaved_fill<simd_avx512_xorshift128plus_state, N, streaming>(out, n, tuner.avx512_keys.data());
+		}
+	};
+#endif
+
+	struct dragontamer
+	{
+		template <unsigned N, bool streaming>
+		static void fill(fill_autotuner& tuner, uint32_t* out, std::size_t n)
+		{
+			interleaved_fill<aes_dragontamer_state, N, streaming>(out, n, tuner.dragontamer_keys.data());
+		}
+	};
+
+	template <typename ENGINE>
+	static void add_engine(std::vector<variant>& list, const std::string& engine)
+	{
+		list.push_back(variant{engine + "_x1", &ENGINE::template fill<1, false>, false});
+		list.push_back(variant{engine + "_x2", &ENGINE::template fill<2, false>, false});
+		list.push_back(variant{engine + "_x4", &ENGINE::template fill<4, false>, false});
+		list.push_back(variant{engine + "_x8", &ENGINE::template fill<8, false>, false});
+		list.push_back(variant{engine + "_x1_stream", &ENGINE::template fill<1, true>, true});
+		list.push_back(variant{engine + "_x2_stream", &ENGINE::template fill<2, true>, true});
+		list.push_back(variant{engine + "_x4_stream", &ENGINE::template fill<4, true>, true});
+		list.push_back(variant{engine + "_x8_stream", &ENGINE::template fill<8, true>, true});
+	}
+
+	static const std::vector<variant>& variants()
+	{
+		static const std::vector<variant> list = []()
+		{
+			std::vector<variant> v;
+
+			add_engine<xorshift_avx2>(v, "xorshift_avx2");
+		#if defined(__AVX512F__)
+			add_engine<xorshift_avx512>(v, "xorshift_avx512");
+		#endif
+			add_engine<dragontamer>(v, "dragontamer");
+
+			return v;
+		}();
+
+		return list;
+	}
+
+	static int find_variant(const std::string& name)
+	{
+		const auto& list = variants();
+
+		for (std::size_t v = 0; v < list.size(); v++)
+			if (list[v].name == name)
+				return int(v);
+
+		return -1;
+	}
+
+	// The variant to use for small arrays when v is chosen
+	// Streaming stores bypass the cache, which small arrays are about to be read from
+	static int for_small(int v)
+	{
+		if (v < 0 || !variants()[v].streaming)
+			return v;
+
+		const std::string& name = variants()[v].name;
+
+		return find_variant(name.substr(0, name.size() - std::strlen("_stream")));
+	}
+
+	// The winners, as indices into variants(), -1 until a size class is tuned
+	struct tuning
+	{
+		std::mutex lock;
+		std::atomic<int> small{-1};
+		std::atomic<int> large{-1};
+	};
+
+	static tuning& state()
+	{
+		static tuning t;
+
+		return t;
+	}
+
+	// CPU brand string plus the instruction sets this build uses
+	static std::string cpu_model()
+	{
+		unsigned int regs[12] = {0};
+
+		for (unsigned int leaf = 0; leaf < 3; leaf++)
+			__get_cpuid(0x80000002 + leaf, &regs[4 * leaf], &regs[4 * leaf + 1], &regs[4 * leaf + 2], &regs[4 * leaf + 3]);
+
+		char brand[sizeof(regs) + 1] = {0};
+
+		std::memcpy(brand, regs, sizeof(regs));
+
+		std::string model(brand);
+
+		model.erase(0, model.find_first_not_of(' '));
+
+	#if defined(__AVX512F__)
+		return model + " [avx512]";
+	#else
+		return model + " [avx2]";
+	#endif
+	}
+
+	static std::string cache_path()
+	{
+		if (const char* path = std::getenv("SIMDXORSHIFT_TUNE_FILE"))
+			return path;
+
+		if (const char* home = std::getenv("HOME"))
+			return std::string(home) + "/.simd_xorshift_autotune";
+
+		return std::string();
+	}
+
+	// Lines of "model \t small winner \t large winner", "-" for a size class not tuned yet
+	static void read_cache(const std::string& model, int* small, int* large)
+	{
+		std::ifstream in(cache_path());
+		std::string line;
+
+		*small = -1;
+		*large = -1;
+
+		while (std::getline(in, line))
+		{
+			std::stringstream ss(line);
+			std::string m, s, l;
+
+			if (std::getline(ss, m, '\t') && std::getline(ss, s, '\t') && std::getline(ss, l) && m == model)
+			{
+				*small = for_small(find_variant(s));
+				*large = find_variant(l);
+
+				return;
+			}
+		}
+	}
+
+	static void write_cache(const std::string& model, int small, int large)
+	{
+		const std::string path = cache_path();
+
+		if (path.empty())
+			return;
+
+		std::vector<std::string> lines;
+
+		{
+			std::ifstream in(path);
+			std::string line;
+
+			while (std::getline(in, line))
+				if (line.compare(0, model.size() + 1, model + "\t") != 0)
+					lines.push_back(line);
+		}
+
+		auto name = [](int v) { return v < 0 ? std::string("-") : variants()[v].name; };
+
+		lines.push_back(model + "\t" + name(small) + "\t" + name(large));
+
+		std::ofstream out(path, std::ios::trunc);
+
+		for (auto& line : lines)
+			out << line << "\n";
+	}
+
+	static int fastest(const std::vector<std::pair<std::string, double>>& times)
+	{
+		auto best = std::min_element(times.begin(), times.end(),
+									 [](const std::pair<std::string, double>& a, const std::pair<std::string, double>& b) { return a.second < b.second; });
+
+		return find_variant(best->first);
+	}
+
+	// The winner for small or large arrays, tuning that size class alone if it has none yet
+	// so a program filling only small arrays never times, or allocates, the large ones
+	static int ensure_tuned(bool large)
+	{
+		tuning& t = state();
+		std::atomic<int>& slot = large ? t.large : t.small;
+
+		const int tuned = slot.load(std::memory_order_acquire);
+
+		if (tuned >= 0)
+			return tuned;
+
+		std::lock_guard<std::mutex> guard(t.lock);
+
+		if (slot.load(std::memory_order_relaxed) >= 0)
+			return slot.load(std::memory_order_relaxed);
+
+		int small_winner = t.small.load(std::memory_order_relaxed);
+		int large_winner = t.large.load(std::memory_order_relaxed);
+		int& winner = large ? large_winner : small_winner;
+
+		if (const char* name = std::getenv("SIMDXORSHIFT_FILL"))
+		{
+			const int named = find_variant(name);
+
+			if (named >= 0)
+			{
+				large_winner = named;
+				small_winner = for_small(named);
+			}
+		}
+
+		if (winner < 0)
+		{
+			const std::string model = cpu_model();
+
+			int cached_small, cached_large;
+
+			read_cache(model, &cached_small, &cached_large);
+
+			if (small_winner < 0)
+				small_winner = cached_small;
+
+			if (large_winner < 0)
+				large_winner = cached_large;
+
+			// The other size class is cached as it is, "-" if it hasn't been tuned either
+			if (winner < 0)
+			{
+				winner = fastest(measure(large));
+
+				write_cache(model, small_winner, large_winner);
+			}
+		}
+
+		t.small.store(small_winner, std::memory_order_release);
+		t.large.store(large_winner, std::memory_order_release);
+
+		return winner;
+	}
+
+public:
+	fill_autotuner()
+		: xorshift_keys(pool_keys(&rng_pool::make_xorshift_key, std::make_index_sequence<max_interleave>()))
+	#if defined(__AVX512F__)
+		, avx512_keys(pool_keys(&rng_pool::make_avx512_xorshift_key, std::make_index_sequence<max_interleave>()))
+	#endif
+		, dragontamer_keys(pool_keys(&rng_pool::make_dragontamer_key, std::make_index_sequence<max_interleave>()))
+	{}
+
+	// Fills with the tuned variant, tuning this size class first if no choice has been made yet
+	void fill_array(uint32_t* rand_arr, std::size_t N_rands)
+	{
+		const int v = ensure_tuned(N_rands >= large_threshold);
+
+		variants()[v].fn(*this, rand_arr, N_rands);
+	}
+
+	// Seconds per fill of each variant, on large or small arrays
+	// Streaming stores are only timed on large arrays. The variants take turns in every round
+	// so a change in load on the host affects them all alike
+	static std::vector<std::pair<std::string, double>> measure(bool large)
+	{
+		const std::size_t n = large ? large_tune_size : small_tune_size;
+		const int rounds = large ? 5 : 50;
+
+		aligned_buffer<uint32_t> buffer(n);
+
+		fill_autotuner tuner;
+
+		std::vector<std::pair<std::string, double>> times;
+		std::vector<const variant*> timed;
+
+		for (auto& v : variants())
+		{
+			if (v.streaming && !large)
+				continue;
+
+			timed.push_back(&v);
+			times.emplace_back(v.name, 1e30);
+		}
+
+		// Untimed first run pages the buffer in and warms up
+		timed[0]->fn(tuner, buffer.data(), n);
+
+		for (int r = 0; r < rounds; r++)
+		{
+			for (std::size_t v = 0; v < timed.size(); v++)
+			{
+				auto start = std::chrono::steady_clock::now();
+
+				timed[v]->fn(tuner, buffer.data(), n);
+
+				std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+				times[v].second = std::min(times[v].second, elapsed.count());
+			}
+		}
+
+		return times;
+	}
+
+	// Times every variant now and replaces the cached choice for this CPU
+	static void retune()
+	{
+		tuning& t = state();
+
+		const int small = fastest(measure(false));
+		const int large = fastest(measure(true));
+
+		std::lock_guard<std::mutex> guard(t.lock);
+
+		write_cache(cpu_model(), small, large);
+
+		t.small.store(small, std::memory_order_release);
+		t.large.store(large, std::memory_order_release);
+	}
+
+	// Uses the named variants for small and large arrays from now on, returns false for unknown names
+	// A streaming variant for small arrays is replaced by its regular store counterpart.
+	// Nothing is cached, pin(choice(0), choice(large_threshold)) saved earlier restores a choice
+	static bool pin(const std::string& small_name, const std::string& large_name)
+	{
+		const int small = for_small(find_variant(small_name));
+		const int large = find_variant(large_name);
+
+		if (small < 0 || large < 0)
+			return false;
+
+		tuning& t = state();
+
+		std::lock_guard<std::mutex> guard(t.lock);
+
+		t.small.store(small, std::memory_order_release);
+		t.large.store(large, std::memory_order_release);
+
+		return true;
+	}
+
+	// The named variant for every size, with regular stores for small arrays
+	static bool pin(const std::string& name)
+	{
+		return pin(name, name);
+	}
+
+	// The variant used for arrays of N_rands numbers
+	static std::string choice(std::size_t N_rands)
+	{
+		return variants()[ensure_tuned(N_rands >= large_threshold)].name;
+	}
+
+	static std::vector<std::string> variant_names()
+	{
+		std::vector<std::string> names;
+
+		for (auto& v : variants())
+			names.push_back(v.name);
+
+		return names;
+	}
+};
+
+#endif
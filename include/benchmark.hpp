@@ -2,20 +2,47 @@
 #define BENCHMARK_H
 
 #include <cstring>
+#include <cctype>
 #include <iostream>
 #include <array>
 #include <random>
 #include <iomanip>
-#include <immintrin.h>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
+#include "simd_intrinsics.hpp"
 #include "randutils.hpp"
 
 #include "simd_xorshift128plus.hpp"
 #include "xorshift128plus.hpp"
 #include "aes_dragontamer.hpp"
+#include "rng_pool.hpp"
+#include "prefill_ring.hpp"
+#include "xorshift128plus_streams.hpp"
+#include "simd_distributions.hpp"
+#include "skip_sampling.hpp"
+#include "sorted_sampling.hpp"
+#include "reservoir_sampling.hpp"
+#include "bootstrap.hpp"
+#include "random_projection.hpp"
+#include "low_precision.hpp"
+#include "random_tokens.hpp"
+#include "numa_parallel.hpp"
+#include "aligned_buffer.hpp"
+#include "autotune.hpp"
+#include "canonical_stream.hpp"
 
 #if defined(__AVX512F__)
 	#include "simd_avx512_xorshift128plus.hpp"
+	#include "simd_avx512_distributions.hpp"
 #endif
 
 class benchmark
@@ -43,7 +70,8 @@ protected:
 	const std::size_t repeats = 500;
 	
 	// Use a vector here in case a lot of rands are requested
-	std::vector<uint32_t> rand_arr;
+	// 64-byte aligned so the fill kernels take their aligned store paths
+	std::vector<uint32_t, aligned_allocator<uint32_t>> rand_arr;
 
 	// Benchmarking functions
     void RDTSC_start(uint64_t* cycles)
@@ -127,11 +155,44 @@ protected:
     }
 
 
-	// Sorting functions    
-	static int qsort_compare_uint32_t(const int a, const int b) 
-	{
-		return a-b;
-	}
+    // As benchmark_fn but for any callable taking no arguments, for kernels
+    // that don't have the (uint32_t*, uint32_t) signature
+    // n_repeats overrides the default number of repeats for slow tests
+    template <typename FN>
+    void benchmark_callable(FN&& fn, const std::string& str, const std::size_t size, std::size_t n_repeats = 0)
+    {
+    	if(n_repeats == 0)
+    		n_repeats = repeats;
+
+    	std::fflush(nullptr);
+
+        uint64_t cycles_start{0}, cycles_final{0}, cycles_diff{0};
+
+        uint64_t min_diff = (uint64_t)-1;
+
+        std::cout << "Testing function : " << str << "\n"; 
+
+        for(uint32_t i = 0; i < n_repeats; i++)
+        {
+            __asm volatile("" ::: "memory");
+            
+            RDTSC_start(&cycles_start);
+         
+            fn();
+            
+            RDTSC_final(&cycles_final);
+
+            cycles_diff = (cycles_final - cycles_start);   
+            
+            if (cycles_diff < min_diff)
+                min_diff = cycles_diff;
+        }  
+
+        float cycles_per_op = min_diff / float(size);
+
+        std::cout << std::setprecision(2) << cycles_per_op << " cycles per operation\n";
+        std::fflush(nullptr);
+    }
 
 	// Tries to put the array in cache
 	void array_cache_prefetch(uint32_t* B, const int32_t length) 
@@ -147,10 +208,12 @@ protected:
 	}
 
 	// Compare the arrays
-	bool sort_compare(std::vector<uint32_t>& shuf, std::vector<uint32_t>& orig) 
+	template <typename T>
+	bool sort_compare(std::vector<T>& shuf, std::vector<T>& orig) 
 	{
-		std::sort(shuf.begin(), shuf.end(), qsort_compare_uint32_t);
-		std::sort(orig.begin(), orig.end(), qsort_compare_uint32_t);
+		// std::sort needs a less-than comparison, a qsort style a - b comparator isn't one
+		std::sort(shuf.begin(), shuf.end());
+		std::sort(orig.begin(), orig.end());
 
 		if(shuf == orig)
 			return true;
@@ -218,6 +281,2053 @@ public:
 
 	}
 
+	// Each thread fills its own array from its thread_rng handle
+	// Reports the total throughput for 1 up to all hardware threads
+	void run_thread_pool()
+	{
+		std::cout << "\n==========================\n" <<
+					   		"\tThread pool" 			<<
+					"\n==========================\n\n";
+
+		unsigned int max_threads = std::max(1u, std::thread::hardware_concurrency());
+
+		std::cout << "Each thread fills " << repeats << " arrays of size " << N_rands << "\n";
+		std::cout << "Throughput reported in millions of 32-bit numbers per second\n\n";
+
+		auto run = [&](unsigned int n_threads, auto fill_fn, const std::string& str)
+		{
+			std::atomic<unsigned int> ready{0};
+			std::atomic<bool> go{false};
+
+			std::vector<std::thread> threads;
+
+			for(unsigned int t = 0; t < n_threads; t++)
+			{
+				threads.emplace_back([&]()
+				{
+					std::vector<uint32_t> thread_arr(N_rands);
+
+					// Creates this thread's key outside of the timed section
+					fill_fn(thread_arr.data(), thread_arr.size());
+
+					ready++;
+
+					while(!go.load(std::memory_order_acquire))
+						std::this_thread::yield();
+
+					for(std::size_t r = 0; r < repeats; r++)
+						fill_fn(thread_arr.data(), thread_arr.size());
+
+					// Make sure the work isn't optimised away
+					__asm volatile("" : : "r"(thread_arr.data()) : "memory");
+				});
+			}
+
+			while(ready.load() != n_threads)
+				std::this_thread::yield();
+
+			auto start = std::chrono::steady_clock::now();
+
+			go.store(true, std::memory_order_release);
+
+			for(auto& th : threads)
+				th.join();
+
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+			double rate = double(n_threads) * repeats * N_rands / elapsed.count() / 1e6;
+
+			std::cout << "Testing function : " << str << " threads " << n_threads << "\n";
+			std::cout << std::setprecision(4) << rate << " M/s (" << rate / n_threads << " M/s per thread)\n";
+		};
+
+		for(unsigned int n_threads = 1; n_threads <= max_threads; n_threads++)
+			run(n_threads, thread_rng::fill_array, "thread_rng xor128_simd");
+
+		for(unsigned int n_threads = 1; n_threads <= max_threads; n_threads++)
+			run(n_threads, thread_rng::fill_array_dragontamer, "thread_rng aes_dragontamer");
+
+		// Explicit seeds are mixed first, so keys and substreams of seeds (0, 0) aren't stuck at zero
+		rng_pool zero_pool(0, 0);
+
+		simd_xorshift128plus_key zero_keys[] = {simd_xorshift128plus_key(0, 0), zero_pool.xorshift_key(0), zero_pool.xorshift_key(5)};
+
+		uint64_t set = 0;
+
+		for(auto& key : zero_keys)
+		{
+			my_simd_xor.fill_array(rand_arr.data(), N_rands, key);
+
+			for(uint32_t i = 0; i < N_rands; i++)
+				set += __builtin_popcount(rand_arr[i]);
+		}
+
+		std::cout << "\nSeeds (0, 0), bits set " << std::setprecision(5) << double(set) / (3 * 32.0 * N_rands) << " expected 0.5\n";
+
+		std::cout << "\n";
+	}
+
+	// Consumers that want a few numbers per event, generating inline vs
+	// taking them from a ring filled by a background thread
+	void run_prefill()
+	{
+		std::cout << "\n==========================\n" <<
+					   		"\tPrefill ring" 			<<
+					"\n==========================\n\n";
+
+		const std::size_t N_events = 200000;
+		const std::size_t words_per_event = 4;
+
+		std::cout << N_events << " events each taking " << words_per_event << " random numbers\n";
+		std::cout << "Latency reported in cycles per event\n\n";
+
+		std::vector<uint64_t> latency(N_events);
+
+		uint32_t event_words[words_per_event];
+
+		auto report = [&](const std::string& str)
+		{
+			uint64_t total = 0;
+
+			for(auto l : latency)
+				total += l;
+
+			std::sort(latency.begin(), latency.end());
+
+			std::cout << "Testing function : " << str << "\n";
+			std::cout << std::setprecision(2) << total / float(N_events * words_per_event) << " cycles per operation\n";
+			std::cout << "p50 " << latency[N_events / 2] << " p99 " << latency[N_events * 99 / 100] 
+					  << " p999 " << latency[N_events * 999 / 1000] << " cycles\n";
+		};
+
+		// Generate a block inline whenever the local one runs out
+		simd_xorshift128plus_key inline_key;
+		std::vector<uint32_t> inline_block(prefill_ring::block_words);
+		std::size_t inline_pos = inline_block.size();
+
+		for(std::size_t e = 0; e < N_events; e++)
+		{
+			_mm_lfence();
+			uint64_t start = __rdtsc();
+			_mm_lfence();
+
+			if(inline_pos + words_per_event > inline_block.size())
+			{
+				my_simd_xor.fill_array(inline_block.data(), inline_block.size(), inline_key);
+				inline_pos = 0;
+			}
+
+			std::memcpy(event_words, inline_block.data() + inline_pos, sizeof(event_words));
+			inline_pos += words_per_event;
+
+			_mm_lfence();
+			latency[e] = __rdtsc() - start;
+
+			__asm volatile("" : : "r"(event_words) : "memory");
+		}
+
+		report("inline xor128_simd");
+
+		prefill_ring ring;
+
+		// Let the producer get ahead before measuring
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+		for(std::size_t e = 0; e < N_events; e++)
+		{
+			_mm_lfence();
+			uint64_t start = __rdtsc();
+			_mm_lfence();
+
+			ring.take(event_words, words_per_event);
+
+			_mm_lfence();
+			latency[e] = __rdtsc() - start;
+
+			__asm volatile("" : : "r"(event_words) : "memory");
+		}
+
+		report("prefill_ring");
+
+		std::cout << "\n";
+	}
+
+	// Random numbers below a different bound for every element
+	void run_bounded()
+	{
+		std::cout << "\n==========================\n" <<
+					   		"\tBounded batch" 			<<
+					"\n==========================\n\n";
+		std::cout << "Time reported in number of cycles per bounded number\n\n";
+
+		std::vector<uint32_t> bounds(N_rands);
+
+		// Capacities from 1 up to ~1 million
+		my_xor.fill_array(bounds.data(), bounds.size());
+
+		for(auto& b : bounds)
+			b = (b & 0xFFFFF) + 1;
+
+		auto check = [&]()
+		{
+			for(std::size_t i = 0; i < N_rands; i++)
+			{
+				if(rand_arr[i] >= bounds[i])
+				{
+					std::cout << "Bounded number out of range at " << i << "\n";
+					return;
+				}
+			}
+		};
+
+		benchmark_callable([&]() { my_xor.bounded_array(bounds.data(), rand_arr.data(), N_rands); }, "xorshift128plus_bounded", N_rands);
+		check();
+
+		simd_xorshift128plus_key simd_key;
+		benchmark_callable([&]() { my_simd_xor.bounded_array(bounds.data(), rand_arr.data(), N_rands, simd_key); }, "xor128_simd bounded_array", N_rands);
+		check();
+
+	#if defined(__AVX512F__)
+		simd_avx512_xorshift128plus_key avx512_key;
+		benchmark_callable([&]() { my_512simd_xor.bounded_array(bounds.data(), rand_arr.data(), N_rands, avx512_key); }, "AVX512 xor128_simd bounded_array", N_rands);
+		check();
+	#endif
+
+		std::cout << "\n";
+	}
+
+	// Bit-packed masks with each bit set with probability p
+	void run_bernoulli()
+	{
+		std::cout << "\n==========================\n" <<
+					   		"\tBernoulli masks" 			<<
+					"\n==========================\n\n";
+		std::cout << "Time reported in number of cycles per output bit\n\n";
+
+		const double p = 0.3;
+		const uint64_t n_bits = 32 * N_rands;
+
+		std::vector<uint64_t> mask((n_bits + 63) / 64);
+
+		auto check = [&](double expected)
+		{
+			uint64_t set = 0;
+
+			for(auto w : mask)
+				set += __builtin_popcountll(w);
+
+			std::cout << "Fraction of bits set " << std::setprecision(4) << set / double(n_bits) << " expected " << expected << "\n";
+		};
+
+		// What we do without the kernel, one 32-bit number per bit
+		const uint32_t threshold = uint32_t(p * 4294967296.0);
+
+		benchmark_callable([&]()
+		{
+			my_simd_xor.fill_array(rand_arr.data(), N_rands);
+
+			std::fill(mask.begin(), mask.begin() + N_rands / 64, 0);
+
+			for(std::size_t i = 0; i < N_rands / 64 * 64; i++)
+				mask[i / 64] |= uint64_t(rand_arr[i] < threshold) << (i % 64);
+		}, "fill_array and compare", N_rands);
+
+		simd_xorshift128plus_key simd_key;
+
+		benchmark_callable([&]() { my_simd_xor.bernoulli_mask(mask.data(), n_bits, p, 16, simd_key); }, "xor128_simd bernoulli_mask p=0.3, 16 bits", n_bits);
+		check(p);
+
+		benchmark_callable([&]() { my_simd_xor.bernoulli_mask_pow2(mask.data(), n_bits, 3, simd_key); }, "xor128_simd bernoulli_mask_pow2 p=1/8", n_bits);
+		check(0.125);
+
+	#if defined(__AVX512F__)
+		simd_avx512_xorshift128plus_key avx512_key;
+
+		benchmark_callable([&]() { my_512simd_xor.bernoulli_mask(mask.data(), n_bits, p, 16, avx512_key); }, "AVX512 xor128_simd bernoulli_mask p=0.3, 16 bits", n_bits);
+		check(p);
+
+		benchmark_callable([&]() { my_512simd_xor.bernoulli_mask_pow2(mask.data(), n_bits, 3, avx512_key); }, "AVX512 xor128_simd bernoulli_mask_pow2 p=1/8", n_bits);
+		check(0.125);
+	#endif
+
+		std::cout << "\n";
+	}
+
+	// Filling with 0..n-1 and shuffling vs writing a random permutation directly
+	void run_permutation()
+	{
+		std::cout << "\n==========================\n" <<
+					   		"\tRandom permutation" 			<<
+					"\n==========================\n\n";
+		std::cout << "Time reported in number of cycles per array element\n\n";
+
+		// In cache and well out of cache
+		const std::size_t sizes[] = {N_shuffle, std::size_t(1) << 24};
+
+		for(std::size_t size : sizes)
+		{
+			std::cout << "Array of size " << size << "\n";
+
+			// Only a few repeats for the large array
+			std::size_t n_repeats = size > N_shuffle ? 5 : repeats;
+
+			std::vector<uint32_t> perm(size);
+			std::vector<uint32_t> identity(size);
+
+			std::iota(identity.begin(), identity.end(), 0);
+
+			auto check = [&]()
+			{
+				std::vector<uint32_t> sorted = perm;
+
+				if(!sort_compare(sorted, identity))
+					std::cout << "Not a permutation\n";
+			};
+
+			benchmark_callable([&]()
+			{
+				std::iota(perm.begin(), perm.end(), 0);
+
+				my_simd_xor.simd_xorshift128plus_shuffle32(perm.data(), size);
+			}, "iota and simd_xorshift128plus_shuffle32", size, n_repeats);
+			check();
+
+			simd_xorshift128plus_key simd_key;
+
+			benchmark_callable([&]() { my_simd_xor.random_permutation(perm.data(), size, simd_key); }, "xor128_simd random_permutation", size, n_repeats);
+			check();
+
+			std::vector<uint64_t> perm64(size);
+
+			benchmark_callable([&]() { my_simd_xor.random_permutation64(perm64.data(), size, simd_key); }, "xor128_simd random_permutation64", size, n_repeats);
+
+			std::vector<uint64_t> identity64(size);
+
+			std::iota(identity64.begin(), identity64.end(), 0);
+
+			if(!sort_compare(perm64, identity64))
+				std::cout << "Not a permutation\n";
+
+			std::cout << "\n";
+		}
+	}
+
+	// Many small arrays such as card decks shuffled one call at a time vs in a batch
+	void run_shuffle_batch()
+	{
+		std::cout << "\n==========================\n" <<
+					   		"\tBatched small shuffles" 			<<
+					"\n==========================\n\n";
+		std::cout << "Time reported in number of cycles per array\n\n";
+
+		const uint32_t n_arrays = 1000;
+
+		const uint32_t array_sizes[] = {8, 13, 16, 32, 52};
+
+		for(uint32_t K : array_sizes)
+		{
+			std::cout << n_arrays << " arrays of size " << K << "\n";
+
+			std::vector<uint32_t> arrays(std::size_t(n_arrays) * K);
+
+			for(uint32_t a = 0; a < n_arrays; a++)
+				std::iota(arrays.begin() + std::size_t(a) * K, arrays.begin() + std::size_t(a + 1) * K, 0);
+
+			auto check = [&]()
+			{
+				std::vector<uint32_t> identity(K);
+				std::iota(identity.begin(), identity.end(), 0);
+
+				for(uint32_t a = 0; a < n_arrays; a++)
+				{
+					std::vector<uint32_t> sorted(arrays.begin() + std::size_t(a) * K, arrays.begin() + std::size_t(a + 1) * K);
+					std::vector<uint32_t> orig = identity;
+
+					if(!sort_compare(sorted, orig))
+					{
+						std::cout << "Array " << a << " is no longer a permutation\n";
+						return;
+					}
+				}
+			};
+
+			benchmark_callable([&]()
+			{
+				for(uint32_t a = 0; a < n_arrays; a++)
+					my_simd_xor.simd_xorshift128plus_shuffle32(arrays.data() + std::size_t(a) * K, K);
+			}, "simd_xorshift128plus_shuffle32 per array", n_arrays, 20);
+			check();
+
+			simd_xorshift128plus_key simd_key;
+
+			benchmark_callable([&]() { my_simd_xor.shuffle_batch(arrays.data(), n_arrays, K, simd_key); }, "xor128_simd shuffle_batch", n_arrays);
+			check();
+
+		#if defined(__AVX512F__)
+			simd_avx512_xorshift128plus_key avx512_key;
+
+			benchmark_callable([&]() { my_512simd_xor.shuffle_batch(arrays.data(), n_arrays, K, avx512_key); }, "AVX512 xor128_simd shuffle_batch", n_arrays);
+			check();
+		#endif
+
+			std::cout << "\n";
+		}
+	}
+
+	// Stepping many independent streams, an array of keys vs the SoA stream container
+	void run_streams()
+	{
+		std::cout << "\n==========================\n" <<
+					   		"\tMultiple streams" 			<<
+					"\n==========================\n\n";
+
+		const std::size_t N_streams = 10000;
+
+		std::cout << "Stepping " << N_streams << " independent streams\n";
+		std::cout << "Time reported in number of cycles per stream\n\n";
+
+		xorshift128plus_streams streams(N_streams, 0x0123456789abcdef, 0xfedcba9876543210);
+
+		// The same streams held as separate keys
+		std::vector<xorshift128plus_key> keys;
+
+		for(std::size_t i = 0; i < N_streams; i++)
+			keys.push_back(streams.key(i));
+
+		std::vector<uint64_t> out_keys(N_streams);
+		std::vector<uint64_t> out_streams(N_streams);
+
+		// One step of each to check they agree
+		for(std::size_t i = 0; i < N_streams; i++)
+			out_keys[i] = my_xor.get_rand(keys[i]);
+
+		streams.step(out_streams.data());
+
+		if(out_keys != out_streams)
+			std::cout << "Stream outputs don't match the scalar generator\n";
+
+		benchmark_callable([&]()
+		{
+			for(std::size_t i = 0; i < N_streams; i++)
+				out_keys[i] = my_xor.get_rand(keys[i]);
+		}, "xorshift128plus_key array", N_streams);
+
+		benchmark_callable([&]() { streams.step(out_streams.data()); }, "xorshift128plus_streams step", N_streams);
+
+		// Every other stream
+		std::vector<uint64_t> mask((N_streams + 63) / 64, 0x5555555555555555);
+
+		benchmark_callable([&]() { streams.step_masked(out_streams.data(), mask.data()); }, "xorshift128plus_streams step_masked, half", N_streams);
+
+		std::cout << "\n";
+	}
+
+	// A user loop that adds random noise to an array, calling get_rand on a key
+	// vs using a register resident state
+	void run_inline_state()
+	{
+		std::cout << "\n==========================\n" <<
+					   		"\tInline state" 			<<
+					"\n==========================\n\n";
+		std::cout << "Adding 8-bit noise to an array of size " << N_rands << "\n";
+		std::cout << "Time reported in number of cycles per array element\n\n";
+
+		std::vector<uint32_t> data(N_rands, 0);
+
+		const std::size_t n = N_rands / 8 * 8;
+
+		const __m256i noise_mask = _mm256_set1_epi32(0xFF);
+
+		simd_xorshift128plus_key key;
+
+		auto add_noise_key = [&](uint32_t* arr, simd_xorshift128plus_key& k)
+		{
+			for(std::size_t i = 0; i < n; i += 8)
+			{
+				__m256i v = _mm256_loadu_si256((const __m256i *)(arr + i));
+				__m256i r = _mm256_and_si256(my_simd_xor.get_rand(k), noise_mask);
+				_mm256_storeu_si256((__m256i *)(arr + i), _mm256_add_epi32(v, r));
+			}
+		};
+
+		auto add_noise_state = [&](uint32_t* arr, simd_xorshift128plus_key& k)
+		{
+			simd_xorshift128plus_state state(k);
+
+			for(std::size_t i = 0; i < n; i += 8)
+			{
+				__m256i v = _mm256_loadu_si256((const __m256i *)(arr + i));
+				__m256i r = _mm256_and_si256(state.next(), noise_mask);
+				_mm256_storeu_si256((__m256i *)(arr + i), _mm256_add_epi32(v, r));
+			}
+
+			state.store_state(k);
+		};
+
+		// Both should follow the same sequence
+		simd_xorshift128plus_key key_copy = key;
+		std::vector<uint32_t> data_copy = data;
+
+		add_noise_key(data.data(), key);
+		add_noise_state(data_copy.data(), key_copy);
+
+		if(data != data_copy)
+			std::cout << "simd_xorshift128plus_state doesn't match get_rand\n";
+
+		benchmark_callable([&]() { add_noise_key(data.data(), key); }, "xor128_simd get_rand(key)", n);
+		benchmark_callable([&]() { add_noise_state(data.data(), key); }, "simd_xorshift128plus_state", n);
+
+		aes_dragontamer_key dragon_key;
+
+		benchmark_callable([&]()
+		{
+			for(std::size_t i = 0; i < n; i += 8)
+			{
+				__m256i v = _mm256_loadu_si256((const __m256i *)(data.data() + i));
+				__m256i r = _mm256_and_si256(my_dragon.get_rand(dragon_key), noise_mask);
+				_mm256_storeu_si256((__m256i *)(data.data() + i), _mm256_add_epi32(v, r));
+			}
+		}, "aes_dragontamer get_rand(key)", n);
+
+		benchmark_callable([&]()
+		{
+			aes_dragontamer_state state(dragon_key);
+
+			for(std::size_t i = 0; i < n; i += 8)
+			{
+				__m256i v = _mm256_loadu_si256((const __m256i *)(data.data() + i));
+				__m256i r = _mm256_and_si256(state.next(), noise_mask);
+				_mm256_storeu_si256((__m256i *)(data.data() + i), _mm256_add_epi32(v, r));
+			}
+
+			state.store_state(dragon_key);
+		}, "aes_dragontamer_state", n);
+
+	#if defined(__AVX512F__)
+		const std::size_t n512 = N_rands / 16 * 16;
+
+		const __m512i noise_mask512 = _mm512_set1_epi32(0xFF);
+
+		simd_avx512_xorshift128plus_key avx512_key;
+
+		benchmark_callable([&]()
+		{
+			for(std::size_t i = 0; i < n512; i += 16)
+			{
+				__m512i v = _mm512_loadu_si512((const __m512i *)(data.data() + i));
+				__m512i r = _mm512_and_si512(my_512simd_xor.get_rand(avx512_key), noise_mask512);
+				_mm512_storeu_si512((__m512i *)(data.data() + i), _mm512_add_epi32(v, r));
+			}
+		}, "AVX512 xor128_simd get_rand(key)", n512);
+
+		benchmark_callable([&]()
+		{
+			simd_avx512_xorshift128plus_state state(avx512_key);
+
+			for(std::size_t i = 0; i < n512; i += 16)
+			{
+				__m512i v = _mm512_loadu_si512((const __m512i *)(data.data() + i));
+				__m512i r = _mm512_and_si512(state.next(), noise_mask512);
+				_mm512_storeu_si512((__m512i *)(data.data() + i), _mm512_add_epi32(v, r));
+			}
+
+			state.store_state(avx512_key);
+		}, "simd_avx512_xorshift128plus_state", n512);
+	#endif
+
+		std::cout << "\n";
+	}
+
+	// Non-uniform distributions against the standard library
+	void run_distributions()
+	{
+		std::cout << "\n==========================\n" <<
+					   		"\tDistributions" 			<<
+					"\n==========================\n\n";
+		std::cout << "Time reported in number of cycles per sample\n\n";
+
+		const std::size_t n_repeats = 50;
+
+		std::vector<float> real_arr(N_rands);
+
+		std::mt19937 mt(randutils::auto_seed_128{}.base());
+
+		// Sample mean and variance against the exact values
+		auto check = [&](auto& arr, double mean, double variance)
+		{
+			double sum = 0, sum2 = 0;
+
+			for(std::size_t i = 0; i < N_rands; i++)
+			{
+				sum += arr[i];
+				sum2 += double(arr[i]) * arr[i];
+			}
+
+			const double m = sum / N_rands;
+
+			std::cout << "Mean " << std::setprecision(4) << m << " expected " << mean
+					  << ", variance " << sum2 / N_rands - m * m << " expected " << variance << "\n";
+		};
+
+		simd_distributions simd_dist;
+		simd_xorshift128plus_key simd_key;
+
+	#if defined(__AVX512F__)
+		simd_avx512_distributions avx512_dist;
+		simd_avx512_xorshift128plus_key avx512_key;
+	#endif
+
+		// Exponential, rate 1
+		std::exponential_distribution<float> exponential(1.0f);
+		benchmark_callable([&]() { for(auto& x : real_arr) x = exponential(mt); }, "std::exponential_distribution", N_rands, n_repeats);
+		check(real_arr, 1, 1);
+
+		benchmark_callable([&]() { simd_dist.exponential_array(real_arr.data(), N_rands, 1.0f, simd_key); }, "simd exponential_array", N_rands, n_repeats);
+		check(real_arr, 1, 1);
+
+	#if defined(__AVX512F__)
+		benchmark_callable([&]() { avx512_dist.exponential_array(real_arr.data(), N_rands, 1.0f, avx512_key); }, "AVX512 simd exponential_array", N_rands, n_repeats);
+		check(real_arr, 1, 1);
+	#endif
+
+		// Standard normal
+		std::normal_distribution<float> normal(0.0f, 1.0f);
+		benchmark_callable([&]() { for(auto& x : real_arr) x = normal(mt); }, "std::normal_distribution", N_rands, n_repeats);
+		check(real_arr, 0, 1);
+
+		benchmark_callable([&]() { simd_dist.normal_array(real_arr.data(), N_rands, 0.0f, 1.0f, simd_key); }, "simd normal_array", N_rands, n_repeats);
+		check(real_arr, 0, 1);
+
+	#if defined(__AVX512F__)
+		benchmark_callable([&]() { avx512_dist.normal_array(real_arr.data(), N_rands, 0.0f, 1.0f, avx512_key); }, "AVX512 simd normal_array", N_rands, n_repeats);
+		check(real_arr, 0, 1);
+	#endif
+
+		// Poisson by inversion and by transformed rejection
+		for(double lambda : {4.0, 100.0})
+		{
+			const std::string name = "(" + std::to_string(int(lambda)) + ")";
+
+			std::poisson_distribution<uint32_t> poisson(lambda);
+			benchmark_callable([&]() { for(auto& x : rand_arr) x = poisson(mt); }, "std::poisson_distribution" + name, N_rands, n_repeats);
+			check(rand_arr, lambda, lambda);
+
+			benchmark_callable([&]() { simd_dist.poisson_array(rand_arr.data(), N_rands, lambda, simd_key); }, "simd poisson_array" + name, N_rands, n_repeats);
+			check(rand_arr, lambda, lambda);
+
+		#if defined(__AVX512F__)
+			benchmark_callable([&]() { avx512_dist.poisson_array(rand_arr.data(), N_rands, lambda, avx512_key); }, "AVX512 simd poisson_array" + name, N_rands, n_repeats);
+			check(rand_arr, lambda, lambda);
+		#endif
+		}
+
+		// Binomial by inversion and by transformed rejection
+		for(auto np : {std::make_pair(20u, 0.3), std::make_pair(1000u, 0.4)})
+		{
+			const uint32_t n = np.first;
+			const double p = np.second;
+
+			const std::string name = "(" + std::to_string(n) + ", " + std::to_string(p).substr(0, 3) + ")";
+
+			std::binomial_distribution<uint32_t> binomial(n, p);
+			benchmark_callable([&]() { for(auto& x : rand_arr) x = binomial(mt); }, "std::binomial_distribution" + name, N_rands, n_repeats);
+			check(rand_arr, n * p, n * p * (1 - p));
+
+			benchmark_callable([&]() { simd_dist.binomial_array(rand_arr.data(), N_rands, n, p, simd_key); }, "simd binomial_array" + name, N_rands, n_repeats);
+			check(rand_arr, n * p, n * p * (1 - p));
+
+		#if defined(__AVX512F__)
+			benchmark_callable([&]() { avx512_dist.binomial_array(rand_arr.data(), N_rands, n, p, avx512_key); }, "AVX512 simd binomial_array" + name, N_rands, n_repeats);
+			check(rand_arr, n * p, n * p * (1 - p));
+		#endif
+		}
+
+		std::cout << "\n";
+	}
+
+	// Positions of the successes of a sparse Bernoulli sequence
+	void run_skip_sampling()
+	{
+		std::cout << "\n==========================\n" <<
+					   		"\tSkip sampling" 			<<
+					"\n==========================\n\n";
+		std::cout << "Time reported in number of cycles per geometric number, then per position of the sequence or vertex pair\n\n";
+
+		const double p = 1.0 / 1024;
+		const uint64_t n = uint64_t(1) << 24;
+		const std::size_t n_repeats = 10;
+
+		simd_distributions simd_dist;
+		simd_xorshift128plus_key simd_key;
+
+		std::vector<uint64_t> gaps(N_rands);
+
+		auto check_gaps = [&]()
+		{
+			double sum = 0;
+
+			for(auto g : gaps)
+				sum += g;
+
+			std::cout << "Mean " << std::setprecision(5) << sum / N_rands << " expected " << (1 - p) / p << "\n";
+		};
+
+		benchmark_callable([&]() { simd_dist.geometric_array(gaps.data(), N_rands, p, simd_key); }, "simd geometric_array", N_rands);
+		check_gaps();
+
+	#if defined(__AVX512F__)
+		simd_avx512_distributions avx512_dist;
+		simd_avx512_xorshift128plus_key avx512_key;
+
+		benchmark_callable([&]() { avx512_dist.geometric_array(gaps.data(), N_rands, p, avx512_key); }, "AVX512 simd geometric_array", N_rands);
+		check_gaps();
+	#endif
+
+		std::cout << "\n";
+
+		skip_sampling sampler;
+
+		std::vector<uint32_t> block(N_rands);
+		std::vector<uint64_t> found;
+
+		auto check_count = [&](std::size_t count)
+		{
+			std::cout << count << " successes, expected " << std::setprecision(6) << n * p << "\n";
+		};
+
+		// One 32-bit number per position compared against a threshold
+		const uint32_t threshold = uint32_t(p * 4294967296.0);
+
+		benchmark_callable([&]()
+		{
+			found.clear();
+
+			for(uint64_t start = 0; start < n; start += block.size())
+			{
+				const uint32_t len = uint32_t(std::min<uint64_t>(block.size(), n - start));
+
+				my_simd_xor.fill_array(block.data(), len, simd_key);
+
+				for(uint32_t i = 0; i < len; i++)
+					if(block[i] < threshold)
+						found.push_back(start + i);
+			}
+		}, "fill_array and compare", n, n_repeats);
+		check_count(found.size());
+
+		benchmark_callable([&]() { found = sampler.positions(n, p, simd_key); }, "skip_sampling positions", n, n_repeats);
+		check_count(found.size());
+
+		const unsigned n_threads = std::max(2u, std::thread::hardware_concurrency());
+
+		benchmark_callable([&]() { found = sampler.positions_parallel(n, p, n_threads); },
+						   "skip_sampling positions_parallel, " + std::to_string(n_threads) + " threads", n, n_repeats);
+		check_count(found.size());
+
+		if(!std::is_sorted(found.begin(), found.end()) || std::adjacent_find(found.begin(), found.end()) != found.end())
+			std::cout << "Positions aren't strictly increasing\n";
+
+		std::vector<uint64_t> mask(n / 64);
+
+		benchmark_callable([&]() { my_simd_xor.bernoulli_mask_pow2(mask.data(), n, 10, simd_key); }, "xor128_simd bernoulli_mask_pow2 p=1/1024", n, n_repeats);
+
+		benchmark_callable([&]() { sampler.sparse_mask(mask.data(), n, p, simd_key); }, "skip_sampling sparse_mask p=1/1024", n, n_repeats);
+
+		std::size_t set = 0;
+
+		for(auto w : mask)
+			set += __builtin_popcountll(w);
+
+		check_count(set);
+
+		// G(n, p) with 5000 vertices and an average degree of about 5
+		const uint32_t n_vertices = 5000;
+		const double edge_p = 5.0 / n_vertices;
+
+		std::vector<std::pair<uint32_t, uint32_t>> edges;
+
+		benchmark_callable([&]() { edges = sampler.erdos_renyi(n_vertices, edge_p, simd_key); }, "skip_sampling erdos_renyi", n_vertices * (n_vertices - 1) / 2, n_repeats);
+
+		bool valid = true;
+
+		for(auto& e : edges)
+			valid &= e.first < e.second && e.second < n_vertices;
+
+		std::cout << edges.size() << " edges, expected " << std::setprecision(6) << n_vertices * (n_vertices - 1) / 2.0 * edge_p
+				  << (valid ? "" : ", invalid edge found") << "\n";
+
+		std::cout << "\n";
+	}
+
+	// Sorted samples generated in order against generating and sorting
+	void run_sorted_sampling()
+	{
+		std::cout << "\n==========================\n" <<
+					   		"\tSorted samples" 			<<
+					"\n==========================\n\n";
+		std::cout << "Time reported in number of cycles per sample\n\n";
+
+		const std::size_t n_repeats = 50;
+		const unsigned n_threads = std::max(2u, std::thread::hardware_concurrency());
+
+		sorted_sampling sampler;
+		simd_xorshift128plus_key simd_key;
+
+		std::vector<double> uniforms(N_rands);
+
+		auto check_uniforms = [&]()
+		{
+			const double mean = std::accumulate(uniforms.begin(), uniforms.end(), 0.0) / N_rands;
+
+			std::cout << (std::is_sorted(uniforms.begin(), uniforms.end()) ? "Sorted" : "Not sorted")
+					  << ", mean " << std::setprecision(4) << mean << " expected 0.5\n";
+		};
+
+		benchmark_callable([&]()
+		{
+			my_simd_xor.fill_array(rand_arr.data(), N_rands, simd_key);
+
+			for(std::size_t i = 0; i < N_rands; i++)
+				uniforms[i] = rand_arr[i] * (1.0 / 4294967296.0);
+
+			std::sort(uniforms.begin(), uniforms.end());
+		}, "fill_array and std::sort", N_rands, n_repeats);
+		check_uniforms();
+
+		benchmark_callable([&]() { sampler.uniforms(uniforms.data(), N_rands, simd_key); }, "sorted_sampling uniforms", N_rands, n_repeats);
+		check_uniforms();
+
+		benchmark_callable([&]() { sampler.uniforms_parallel(uniforms.data(), N_rands, n_threads); },
+						   "sorted_sampling uniforms_parallel, " + std::to_string(n_threads) + " threads", N_rands, n_repeats);
+		check_uniforms();
+
+		std::cout << "\n";
+
+		// Distinct indices from [0, 2^32)
+		const uint64_t N = uint64_t(1) << 32;
+
+		std::vector<uint64_t> indices(N_rands);
+
+		auto check_indices = [&]()
+		{
+			bool valid = indices.back() < N;
+
+			for(std::size_t i = 1; i < N_rands; i++)
+				valid &= indices[i - 1] < indices[i];
+
+			std::cout << (valid ? "Sorted and distinct" : "Not sorted and distinct") << "\n";
+		};
+
+		benchmark_callable([&]()
+		{
+			my_simd_xor.fill_array(rand_arr.data(), N_rands, simd_key);
+
+			std::copy(rand_arr.begin(), rand_arr.begin() + N_rands, indices.begin());
+
+			std::sort(indices.begin(), indices.end());
+		}, "fill_array and std::sort (duplicates possible)", N_rands, n_repeats);
+
+		benchmark_callable([&]() { sampler.indices(indices.data(), N_rands, N, simd_key); }, "sorted_sampling indices", N_rands, n_repeats);
+		check_indices();
+
+		benchmark_callable([&]() { sampler.indices_parallel(indices.data(), N_rands, N, n_threads); },
+						   "sorted_sampling indices_parallel, " + std::to_string(n_threads) + " threads", N_rands, n_repeats);
+		check_indices();
+
+		std::cout << "\n";
+	}
+
+	// Reservoir sampling over a stream of variable length batches
+	void run_reservoir()
+	{
+		std::cout << "\n==========================\n" <<
+					   		"\tReservoir sampling" 			<<
+					"\n==========================\n\n";
+		std::cout << "Time reported in number of cycles per record\n\n";
+
+		const uint32_t k = 1000;
+		const std::size_t n_records = std::size_t(1) << 22;
+		const std::size_t n_repeats = 10;
+
+		std::vector<uint64_t> records(n_records);
+		std::iota(records.begin(), records.end(), 0);
+
+		std::vector<double> weights(n_records, 1.0);
+
+		// Batch lengths between 1 and 4096
+		std::vector<std::size_t> batches;
+
+		my_xor.fill_array(rand_arr.data(), N_rands);
+
+		for(std::size_t total = 0, i = 0; total < n_records; i++)
+		{
+			batches.push_back(std::min<std::size_t>(rand_arr[i % N_rands] % 4096 + 1, n_records - total));
+			total += batches.back();
+		}
+
+		// Every record is equally likely to be kept, the sample mean should be about half the stream
+		auto check = [&](const std::vector<uint64_t>& sample)
+		{
+			double mean = std::accumulate(sample.begin(), sample.end(), 0.0) / sample.size();
+
+			std::cout << sample.size() << " records, mean " << std::setprecision(4) << mean / n_records << " of the stream, expected 0.5\n";
+		};
+
+		// Algorithm R, one bounded random number per record
+		std::vector<uint64_t> sample_r(k);
+
+		benchmark_callable([&]()
+		{
+			xorshift128plus_key key(rand_arr[0] | 1, rand_arr[1]);
+
+			uint64_t seen = 0;
+
+			for(std::size_t b = 0, offset = 0; b < batches.size(); offset += batches[b++])
+			{
+				for(std::size_t i = 0; i < batches[b]; i++, seen++)
+				{
+					if(seen < k)
+					{
+						sample_r[seen] = records[offset + i];
+						continue;
+					}
+
+					uint64_t s1 = key.seed1;
+					const uint64_t s0 = key.seed2;
+					key.seed1 = s0;
+					s1 ^= s1 << 23;
+					key.seed2 = s1 ^ s0 ^ (s1 >> 18) ^ (s0 >> 5);
+
+					const uint64_t j = uint64_t((uint128_type(key.seed2 + s0) * (seen + 1)) >> 64);
+
+					if(j < k)
+						sample_r[j] = records[offset + i];
+				}
+			}
+		}, "Algorithm R, scalar xorshift128plus", n_records, n_repeats);
+		check(sample_r);
+
+		std::vector<uint64_t> sample_l;
+
+		benchmark_callable([&]()
+		{
+			reservoir_sampler<uint64_t> sampler(k);
+
+			for(std::size_t b = 0, offset = 0; b < batches.size(); offset += batches[b++])
+				sampler.add(records.data() + offset, batches[b]);
+
+			sample_l = sampler.sample();
+		}, "reservoir_sampler, Algorithm L", n_records, n_repeats);
+		check(sample_l);
+
+		benchmark_callable([&]()
+		{
+			weighted_reservoir_sampler<uint64_t> sampler(k);
+
+			for(std::size_t b = 0, offset = 0; b < batches.size(); offset += batches[b++])
+				sampler.add(records.data() + offset, weights.data() + offset, batches[b]);
+
+			sample_l = sampler.sample();
+		}, "weighted_reservoir_sampler, A-ExpJ", n_records, n_repeats);
+		check(sample_l);
+
+		std::cout << "\n";
+	}
+
+	// Bootstrap resampling, the mean of each resample
+	void run_bootstrap()
+	{
+		std::cout << "\n==========================\n" <<
+					   		"\tBootstrap" 			<<
+					"\n==========================\n\n";
+		std::cout << "Time reported in number of cycles per resampled value\n\n";
+
+		const uint32_t n = 1000000;
+		const uint32_t n_resamples = 16;
+		const std::size_t n_repeats = 5;
+		const unsigned n_threads = std::max(2u, std::thread::hardware_concurrency());
+
+		// Uniform source values in [0, 1)
+		std::vector<double> src(n);
+		std::vector<uint32_t> idx(n);
+
+		my_simd_xor.fill_array(idx.data(), n);
+
+		for(uint32_t i = 0; i < n; i++)
+			src[i] = idx[i] * (1.0 / 4294967296.0);
+
+		const double src_mean = std::accumulate(src.begin(), src.end(), 0.0) / n;
+
+		std::vector<double> means(n_resamples);
+
+		// The spread of the resample means should be close to sqrt(1 / 12n)
+		auto check = [&]()
+		{
+			double m = std::accumulate(means.begin(), means.end(), 0.0) / n_resamples;
+			double v = 0;
+
+			for(auto x : means)
+				v += (x - m) * (x - m);
+
+			std::cout << "Mean " << std::setprecision(5) << m << " expected " << src_mean
+					  << ", standard error " << std::setprecision(3) << std::sqrt(v / (n_resamples - 1)) << " expected " << std::sqrt(1.0 / (12.0 * n)) << "\n";
+		};
+
+		simd_xorshift128plus_key simd_key;
+		std::vector<uint32_t> bounds(n, n);
+
+		benchmark_callable([&]()
+		{
+			for(uint32_t r = 0; r < n_resamples; r++)
+			{
+				my_simd_xor.bounded_array(bounds.data(), idx.data(), n, simd_key);
+
+				double sum = 0;
+
+				for(uint32_t i = 0; i < n; i++)
+					sum += src[idx[i]];
+
+				means[r] = sum / n;
+			}
+		}, "bounded_array then sum", uint64_t(n) * n_resamples, n_repeats);
+		check();
+
+		bootstrap resampler;
+		bootstrap::key_type key;
+
+		benchmark_callable([&]()
+		{
+			for(uint32_t r = 0; r < n_resamples; r++)
+				means[r] = resampler.mean(src.data(), n, n, key);
+		}, "bootstrap mean, fused gather", uint64_t(n) * n_resamples, n_repeats);
+		check();
+
+		benchmark_callable([&]() { bootstrap::means(src.data(), n, means.data(), n_resamples, n_threads); },
+						   "bootstrap means, " + std::to_string(n_threads) + " threads", uint64_t(n) * n_resamples, n_repeats);
+		check();
+
+		benchmark_callable([&]() { bootstrap::quantiles(src.data(), n, 0.5, means.data(), n_resamples, n_threads); },
+						   "bootstrap quantiles (median), " + std::to_string(n_threads) + " threads", uint64_t(n) * n_resamples, n_repeats);
+		check();
+
+		// An empty source has nothing to draw, its means are NaN
+		bootstrap::means(src.data(), 0, means.data(), n_resamples, n_threads);
+
+		std::cout << "Empty source means NaN " << std::isnan(means[0]) << ", sum " << resampler.sum(src.data(), 0, n, key) << "\n";
+
+		std::cout << "\n";
+	}
+
+	// Generating into a scratch array then mixing it in, against doing both in one pass
+	void run_transform()
+	{
+		std::cout << "\n==========================\n" <<
+					   		"\tTransform with random" 			<<
+					"\n==========================\n\n";
+		std::cout << "Time reported in number of cycles per element\n\n";
+
+		// Uniform noise in [-scale / 2, scale / 2)
+		const float scale = 1e-3f;
+		const float noise_scale = scale / 4294967296.0f;
+
+		std::vector<float> data(N_rands, 1.0f);
+
+		simd_xorshift128plus_key simd_key;
+		aes_dragontamer_key dragon_key;
+
+		auto add_noise = [noise_scale](__m256i rand, __m256i x)
+		{
+			return _mm256_castps_si256(_mm256_fmadd_ps(_mm256_cvtepi32_ps(rand), _mm256_set1_ps(noise_scale), _mm256_castsi256_ps(x)));
+		};
+
+		benchmark_callable([&]()
+		{
+			my_simd_xor.fill_array(rand_arr.data(), N_rands, simd_key);
+
+			for(std::size_t i = 0; i < N_rands; i++)
+				data[i] += int32_t(rand_arr[i]) * noise_scale;
+		}, "xor128_simd fill_array then add noise", N_rands);
+
+		benchmark_callable([&]() { my_simd_xor.transform_with_random(data.data(), N_rands, add_noise, simd_key); }, "xor128_simd transform_with_random add noise", N_rands);
+
+		benchmark_callable([&]()
+		{
+			my_dragon.fill_array(rand_arr.data(), N_rands, dragon_key);
+
+			for(std::size_t i = 0; i < N_rands; i++)
+				data[i] += int32_t(rand_arr[i]) * noise_scale;
+		}, "aes_dragontamer fill_array then add noise", N_rands);
+
+		benchmark_callable([&]() { my_dragon.transform_with_random(data.data(), N_rands, add_noise, dragon_key); }, "aes_dragontamer transform_with_random add noise", N_rands);
+
+	#if defined(__AVX512F__)
+		simd_avx512_xorshift128plus_key avx512_key;
+
+		benchmark_callable([&]()
+		{
+			my_512simd_xor.fill_array(rand_arr.data(), N_rands, avx512_key);
+
+			for(std::size_t i = 0; i < N_rands; i++)
+				data[i] += int32_t(rand_arr[i]) * noise_scale;
+		}, "AVX512 xor128_simd fill_array then add noise", N_rands);
+
+		benchmark_callable([&]()
+		{
+			my_512simd_xor.transform_with_random(data.data(), N_rands, [noise_scale](__m512i rand, __m512i x)
+			{
+				return _mm512_castps_si512(_mm512_fmadd_ps(_mm512_cvtepi32_ps(rand), _mm512_set1_ps(noise_scale), _mm512_castsi512_ps(x)));
+			}, avx512_key);
+		}, "AVX512 xor128_simd transform_with_random add noise", N_rands);
+	#endif
+
+		// XOR masking through both routes from copies of the same key must give the same result
+		// An odd length checks the partial last vector
+		const std::size_t n = N_rands - 3;
+
+		std::vector<uint32_t> expected(n), masked(n);
+
+		auto check = [&](const std::string& name, auto& gen, auto key, auto xor_fn)
+		{
+			auto key_copy = key;
+
+			for(std::size_t i = 0; i < n; i++)
+				expected[i] = masked[i] = uint32_t(i * 2654435761u);
+
+			gen.fill_array(rand_arr.data(), n, key);
+
+			for(std::size_t i = 0; i < n; i++)
+				expected[i] ^= rand_arr[i];
+
+			gen.transform_with_random(masked.data(), n, xor_fn, key_copy);
+
+			std::cout << name << (expected == masked ? " transform_with_random matches fill_array" : " transform_with_random doesn't match fill_array") << "\n";
+		};
+
+		auto xor256 = [](__m256i rand, __m256i x) { return _mm256_xor_si256(rand, x); };
+
+		check("xor128_simd", my_simd_xor, simd_key, xor256);
+		check("aes_dragontamer", my_dragon, dragon_key, xor256);
+
+	#if defined(__AVX512F__)
+		check("AVX512 xor128_simd", my_512simd_xor, avx512_key, [](__m512i rand, __m512i x) { return _mm512_xor_si512(rand, x); });
+	#endif
+
+		std::cout << "\n";
+	}
+
+	// Masking a buffer in place with a keystream
+	void run_keystream()
+	{
+		std::cout << "\n==========================\n" <<
+					   		"\tKeystream XOR" 			<<
+					"\n==========================\n\n";
+		std::cout << "Time reported in number of cycles per byte\n\n";
+
+		// 16 MiB plus an odd tail, starting one byte into the allocation so nothing is aligned
+		const std::size_t len = (std::size_t(1) << 24) + 13;
+		const std::size_t n_repeats = 10;
+		const unsigned n_threads = std::max(2u, std::thread::hardware_concurrency());
+
+		std::vector<unsigned char> storage(len + 1);
+		unsigned char* buf = storage.data() + 1;
+
+		for(std::size_t i = 0; i < len; i++)
+			buf[i] = (unsigned char)(i * 131);
+
+		const std::vector<unsigned char> original(buf, buf + len);
+
+		std::vector<uint32_t> scratch(len / sizeof(uint32_t) + 1);
+
+		aes_dragontamer_key dragon_key;
+		simd_xorshift128plus_key simd_key;
+
+		benchmark_callable([&]()
+		{
+			my_dragon.fill_array(scratch.data(), uint32_t(scratch.size()), dragon_key);
+
+			const unsigned char* stream = (const unsigned char *)scratch.data();
+
+			for(std::size_t i = 0; i < len; i++)
+				buf[i] ^= stream[i];
+		}, "aes_dragontamer fill_array then XOR", len, n_repeats);
+
+		benchmark_callable([&]() { my_dragon.xor_keystream(buf, len, dragon_key); }, "aes_dragontamer xor_keystream", len, n_repeats);
+
+		benchmark_callable([&]() { my_dragon.xor_keystream_parallel(buf, len, dragon_key, 0, n_threads); },
+						   "aes_dragontamer xor_keystream_parallel, " + std::to_string(n_threads) + " threads", len, n_repeats);
+
+		benchmark_callable([&]() { my_simd_xor.xor_keystream(buf, len, simd_key); }, "xor128_simd xor_keystream", len, n_repeats);
+
+	#if defined(__AVX512F__)
+		simd_avx512_xorshift128plus_key avx512_key;
+
+		benchmark_callable([&]() { my_512simd_xor.xor_keystream(buf, len, avx512_key); }, "AVX512 xor128_simd xor_keystream", len, n_repeats);
+	#endif
+
+		// Mask everything, then unmask two uneven pieces separately using their offsets
+		auto check = [&](const std::string& name, auto& gen, const auto& key)
+		{
+			std::copy(original.begin(), original.end(), buf);
+
+			gen.xor_keystream(buf, len, key, 0);
+
+			const bool masked = !std::equal(original.begin(), original.end(), buf);
+
+			const std::size_t cut = len / 3 + 7;
+
+			gen.xor_keystream(buf, cut, key, 0);
+			gen.xor_keystream_parallel(buf + cut, len - cut, key, cut, n_threads);
+
+			std::cout << name << ((masked && std::equal(original.begin(), original.end(), buf)) ? " masks and unmasks by range" : " range unmasking failed") << "\n";
+		};
+
+		check("aes_dragontamer", my_dragon, dragon_key);
+		check("xor128_simd", my_simd_xor, simd_key);
+
+	#if defined(__AVX512F__)
+		check("AVX512 xor128_simd", my_512simd_xor, avx512_key);
+	#endif
+
+		std::cout << "\n";
+	}
+
+	// Random sign and sparse ternary projection matrices, one bit per sign
+	void run_projection()
+	{
+		std::cout << "\n==========================\n" <<
+					   		"\tRandom projections" 	<<
+					"\n==========================\n\n";
+		std::cout << "Time reported in number of cycles per matrix entry\n\n";
+
+		const std::size_t rows = 1000;
+		const std::size_t cols = 4099;
+		const std::size_t n = rows * cols;
+		const std::size_t n_repeats = 5;
+		const unsigned n_threads = std::max(2u, std::thread::hardware_concurrency());
+
+		std::vector<float> dense(n);
+		std::vector<int8_t> dense8(n);
+
+		// Fractions of negative and zero entries, and the second moment
+		auto check = [&](const char* name, auto& m, double expected_zero, double expected_m2)
+		{
+			std::size_t negative = 0, zero = 0;
+			double m2 = 0;
+
+			for(auto x : m)
+			{
+				negative += x < 0;
+				zero += x == 0;
+				m2 += double(x) * x;
+			}
+
+			std::cout << name << ": negative " << std::setprecision(4) << double(negative) / n
+					  << " expected " << (1.0 - expected_zero) / 2
+					  << ", zero " << double(zero) / n << " expected " << expected_zero
+					  << ", E[x^2] " << m2 / n << " expected " << expected_m2 << "\n";
+		};
+
+		simd_xorshift128plus_key simd_key;
+		std::vector<uint32_t> words(n / 32 + 1);
+
+		benchmark_callable([&]()
+		{
+			my_simd_xor.fill_array(words.data(), uint32_t(words.size()));
+
+			for(std::size_t i = 0; i < n; i++)
+				dense[i] = (words[i / 32] >> (i % 32) & 1) ? -1.0f : 1.0f;
+		}, "fill_array then expand bits, float", n, n_repeats);
+		check("float", dense, 0.0, 1.0);
+
+		random_projection projection;
+		random_projection::key_type key;
+
+		benchmark_callable([&]() { projection.rademacher(dense.data(), n, 1.0f, key); },
+						   "rademacher, float", n, n_repeats);
+		check("float", dense, 0.0, 1.0);
+
+		benchmark_callable([&]() { projection.rademacher(dense8.data(), n, key); },
+						   "rademacher, int8", n, n_repeats);
+		check("int8", dense8, 0.0, 1.0);
+
+		benchmark_callable([&]() { projection.sparse_ternary(dense.data(), n, 1, std::sqrt(2.0f), key); },
+						   "sparse_ternary s = 2, float", n, n_repeats);
+		check("float", dense, 0.5, 1.0);
+
+		benchmark_callable([&]() { projection.sparse_ternary(dense8.data(), n, 3, key); },
+						   "sparse_ternary s = 8, int8", n, n_repeats);
+		check("int8", dense8, 0.875, 0.125);
+
+		benchmark_callable([&]() { projection.gaussian(dense.data(), n, 1.0f, key); },
+						   "gaussian, float", n, n_repeats);
+		check("float", dense, 0.0, 1.0);
+
+		benchmark_callable([&]() { random_projection::rademacher_parallel(dense.data(), rows, cols, 1.0f, n_threads); },
+						   "rademacher_parallel, float, " + std::to_string(n_threads) + " threads", n, n_repeats);
+		check("float", dense, 0.0, 1.0);
+
+		benchmark_callable([&]() { random_projection::sparse_ternary_parallel(dense8.data(), rows, cols, 2, n_threads); },
+						   "sparse_ternary_parallel s = 4, int8, " + std::to_string(n_threads) + " threads", n, n_repeats);
+		check("int8", dense8, 0.75, 0.25);
+
+		std::cout << "\n";
+	}
+
+	// bf16, fp16 and int8 outputs straight from the random bits, against fp32 then converting
+	void run_low_precision()
+	{
+		std::cout << "\n==========================\n" <<
+					   		"\tLow precision" 		<<
+					"\n==========================\n\n";
+		std::cout << "Time reported in number of cycles per output value\n\n";
+
+		const uint32_t n = 1000003;
+		const std::size_t n_repeats = 5;
+
+		std::vector<float> fp32(n);
+		std::vector<uint16_t> half(n);
+		std::vector<int8_t> quantized(n);
+
+		auto bf16_to_float = [](uint16_t h)
+		{
+			uint32_t bits = uint32_t(h) << 16;
+			float x;
+
+			std::memcpy(&x, &bits, sizeof(x));
+
+			return x;
+		};
+
+		// Mean, variance and range of the decoded values
+		auto check = [&](const char* name, auto decode, double expected_mean, double expected_var)
+		{
+			double sum = 0, sum2 = 0, lo = 1e30, hi = -1e30;
+
+			for(uint32_t i = 0; i < n; i++)
+			{
+				double x = decode(i);
+
+				sum += x;
+				sum2 += x * x;
+				lo = std::min(lo, x);
+				hi = std::max(hi, x);
+			}
+
+			const double m = sum / n;
+
+			std::cout << name << ": mean " << std::setprecision(4) << m << " expected " << expected_mean
+					  << ", variance " << sum2 / n - m * m << " expected " << expected_var
+					  << ", range [" << lo << ", " << hi << "]\n";
+		};
+
+		auto decode_bf16 = [&](uint32_t i) { return double(bf16_to_float(half[i])); };
+
+		simd_distributions dist;
+		simd_xorshift128plus_key simd_key;
+
+		benchmark_callable([&]()
+		{
+			dist.normal_array(fp32.data(), n, 0.0f, 1.0f, simd_key);
+
+			for(uint32_t i = 0; i < n; i++)
+			{
+				uint32_t bits;
+
+				std::memcpy(&bits, &fp32[i], sizeof(bits));
+
+				half[i] = uint16_t((bits + 0x7FFF + ((bits >> 16) & 1)) >> 16);
+			}
+		}, "normal_array then convert to bf16", n, n_repeats);
+		check("bf16", decode_bf16, 0.0, 1.0);
+
+		low_precision lp;
+		low_precision::key_type key;
+
+		benchmark_callable([&]() { lp.normal_bf16(half.data(), n, 0.0f, 1.0f, key); }, "normal_bf16", n, n_repeats);
+		check("bf16", decode_bf16, 0.0, 1.0);
+
+		benchmark_callable([&]() { lp.uniform_bf16(half.data(), n, -1.0f, 1.0f, key); }, "uniform_bf16 in [-1, 1)", n, n_repeats);
+		check("bf16", decode_bf16, -1.0 / 128, 1.0 / 3);
+
+		// Away from 0 the format is coarser than the uniform grid, rounding must still stay below hi
+		auto largest = [&](auto decode)
+		{
+			double top = -1e30;
+
+			for(uint32_t i = 0; i < n; i++)
+				top = std::max(top, decode(i));
+
+			return top;
+		};
+
+		lp.uniform_bf16(half.data(), n, 10.0f, 11.0f, key);
+		std::cout << "uniform_bf16 in [10, 11), largest " << largest(decode_bf16) << " expected 10.94\n";
+
+#if defined(__AVX512F__) || defined(__F16C__)
+		auto decode_fp16 = [&](uint32_t i) { return double(_cvtsh_ss(half[i])); };
+
+		benchmark_callable([&]() { lp.normal_fp16(half.data(), n, 0.0f, 1.0f, key); }, "normal_fp16", n, n_repeats);
+		check("fp16", decode_fp16, 0.0, 1.0);
+
+		benchmark_callable([&]() { lp.uniform_fp16(half.data(), n, 0.0f, 1.0f, key); }, "uniform_fp16 in [0, 1)", n, n_repeats);
+		check("fp16", decode_fp16, 0.5 - 0.5 / 1024, 1.0 / 12);
+
+		lp.uniform_fp16(half.data(), n, 10.0f, 11.0f, key);
+		std::cout << "uniform_fp16 in [10, 11), largest " << largest(decode_fp16) << " expected 10.99\n";
+#endif
+
+		benchmark_callable([&]() { lp.normal_int8(quantized.data(), n, 16.0f, key); }, "normal_int8, stddev 16", n, n_repeats);
+		check("int8", [&](uint32_t i) { return double(quantized[i]); }, 0.0, 256.0 + 1.0 / 12);
+
+		std::cout << "\n";
+	}
+
+	// Random strings and UUIDs written as fixed width records
+	void run_tokens()
+	{
+		std::cout << "\n==========================\n" <<
+					   		"\tRandom tokens" 		<<
+					"\n==========================\n\n";
+		std::cout << "Time reported in number of cycles per character\n\n";
+
+		const std::size_t n = 100000;
+		const std::size_t width = 22;
+		const std::size_t n_repeats = 5;
+
+		std::vector<char> out(n * 37);
+
+		// Largest and smallest character counts relative to the expected count
+		auto check = [&](const token_alphabet& alphabet, const std::string& chars, std::size_t stride)
+		{
+			std::vector<std::size_t> counts(256);
+
+			for(std::size_t r = 0; r < n; r++)
+				for(std::size_t i = 0; i < width; i++)
+					counts[(unsigned char)out[r * stride + i]]++;
+
+			std::size_t lo = n * width, hi = 0, total = 0;
+
+			for(char ch : chars)
+			{
+				lo = std::min(lo, counts[(unsigned char)ch]);
+				hi = std::max(hi, counts[(unsigned char)ch]);
+				total += counts[(unsigned char)ch];
+			}
+
+			const double expected = double(n * width) / alphabet.size;
+
+			std::cout << "Characters outside the alphabet " << n * width - total
+					  << ", counts from " << std::setprecision(4) << lo / expected << " to " << hi / expected << " of expected\n";
+		};
+
+		const std::string alnum = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+		const token_alphabet alphanumeric = token_alphabet::alphanumeric();
+
+		std::vector<uint32_t> rands(n * width);
+
+		benchmark_callable([&]()
+		{
+			my_dragon.fill_array(rands.data(), uint32_t(rands.size()));
+
+			for(std::size_t i = 0; i < n * width; i++)
+				out[i] = alnum[rands[i] % 62];
+		}, "fill_array then modulo, alphanumeric", n * width, n_repeats);
+		check(alphanumeric, alnum, width);
+
+		random_tokens tokens;
+		aes_dragontamer_key key;
+
+		benchmark_callable([&]() { tokens.strings(out.data(), n, width, width, alphanumeric, key); },
+						   "strings, alphanumeric", n * width, n_repeats);
+		check(alphanumeric, alnum, width);
+
+		benchmark_callable([&]() { tokens.strings(out.data(), n, width, width + 1, alphanumeric, key); },
+						   "strings, alphanumeric, stride " + std::to_string(width + 1), n * width, n_repeats);
+		check(alphanumeric, alnum, width + 1);
+
+		benchmark_callable([&]() { tokens.strings(out.data(), n, width, width, token_alphabet::base64url(), key); },
+						   "strings, base64url", n * width, n_repeats);
+		check(token_alphabet::base64url(), "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_", width);
+
+		benchmark_callable([&]() { tokens.strings(out.data(), n, width, width, token_alphabet::digits(), key); },
+						   "strings, digits", n * width, n_repeats);
+		check(token_alphabet::digits(), "0123456789", width);
+
+		benchmark_callable([&]() { tokens.uuids(out.data(), n, 37, key); }, "uuids, stride 37", n * 36, n_repeats);
+
+		// Dashes, the version and the variant in place, hex everywhere else
+		std::size_t bad = 0;
+
+		for(std::size_t r = 0; r < n; r++)
+		{
+			const char* u = out.data() + r * 37;
+
+			for(int i = 0; i < 36; i++)
+			{
+				const bool dash = i == 8 || i == 13 || i == 18 || i == 23;
+
+				bad += dash ? u[i] != '-' : !std::isxdigit((unsigned char)u[i]) || std::isupper((unsigned char)u[i]);
+			}
+
+			bad += u[14] != '4' || !std::strchr("89ab", u[19]);
+		}
+
+		std::cout << "Malformed UUIDs " << bad << ", for example " << std::string(out.data(), 36) << "\n";
+
+		// Alphabets the tables can't hold are refused
+		std::size_t refused = 0;
+
+		for(const std::string& chars : {std::string(), std::string(65, 'a')})
+		{
+			try
+			{
+				token_alphabet alphabet(chars);
+			}
+			catch (const std::invalid_argument&)
+			{
+				refused++;
+			}
+		}
+
+		std::cout << "Empty and 65 character alphabets refused " << refused << ", expected 2\n";
+
+		std::cout << "\n";
+	}
+
+	// Parallel fill and batch shuffle with node-local against interleaved pages
+	// Consumers are pinned the same way, so local placement means local reads
+	void run_numa()
+	{
+		std::cout << "\n==========================\n" <<
+					   		"\tNUMA placement" 		<<
+					"\n==========================\n\n";
+
+		const numa_topology& topology = numa_topology::system();
+
+		for(auto& node : topology.nodes)
+			std::cout << "Node " << node.id << ": " << node.cpus.size() << " CPUs\n";
+
+		std::cout << "Time reported in number of cycles per 32-bit number\n\n";
+
+		const std::size_t n = std::size_t(1) << 25;
+		const uint32_t K = 32;
+		const std::size_t n_repeats = 3;
+		const unsigned n_threads = std::max(2u, std::thread::hardware_concurrency());
+
+		uint32_t* buffer = (uint32_t *)numa_parallel::allocate(n * sizeof(uint32_t));
+
+		// Fraction of bits set
+		auto check_bits = [&]()
+		{
+			uint64_t set = 0;
+
+			for(std::size_t i = 0; i < n; i++)
+				set += __builtin_popcount(buffer[i]);
+
+			std::cout << "Bits set " << std::setprecision(5) << double(set) / (32.0 * n) << " expected 0.5\n";
+		};
+
+		// Each array should still hold 0..K-1
+		auto check_permutations = [&]()
+		{
+			std::size_t bad = 0;
+
+			for(std::size_t a = 0; a < n / K; a++)
+			{
+				uint64_t seen = 0;
+
+				for(uint32_t i = 0; i < K; i++)
+					seen |= uint64_t(1) << buffer[a * K + i];
+
+				bad += seen != (uint64_t(1) << K) - 1;
+			}
+
+			std::cout << "Arrays that aren't permutations " << bad << "\n";
+		};
+
+		auto reset_arrays = [&]()
+		{
+			for(std::size_t i = 0; i < n; i++)
+				buffer[i] = uint32_t(i % K);
+		};
+
+		// Pinned readers over the same regions
+		std::atomic<uint64_t> total{0};
+
+		auto consume = [&]()
+		{
+			numa_parallel::for_each_region(n, 0, [&](std::size_t first, std::size_t last)
+			{
+				uint64_t sum = 0;
+
+				for(std::size_t i = first; i < last; i++)
+					sum += buffer[i];
+
+				total += sum;
+			});
+		};
+
+		benchmark_callable([&]()
+		{
+			std::vector<std::thread> threads;
+
+			for(unsigned t = 0; t < n_threads; t++)
+				threads.emplace_back([&, t]()
+				{
+					simd_xorshift128plus generator;
+					simd_xorshift128plus_key key;
+
+					const std::size_t first = n * t / n_threads, last = n * (t + 1) / n_threads;
+
+					generator.fill_array(buffer + first, uint32_t(last - first), key);
+				});
+
+			for(auto& thread : threads)
+				thread.join();
+		}, "fill_array, " + std::to_string(n_threads) + " unpinned threads", n, n_repeats);
+		check_bits();
+
+		benchmark_callable([&]() { numa_parallel::fill_array(buffer, n, numa_placement::local); },
+						   "numa_parallel fill_array, local", n, n_repeats);
+		check_bits();
+		benchmark_callable(consume, "pinned readers after local placement", n, n_repeats);
+
+		benchmark_callable([&]() { numa_parallel::fill_array(buffer, n, numa_placement::interleaved); },
+						   "numa_parallel fill_array, interleaved", n, n_repeats);
+		check_bits();
+		benchmark_callable(consume, "pinned readers after interleaved placement", n, n_repeats);
+
+		reset_arrays();
+		benchmark_callable([&]() { numa_parallel::shuffle_batch(buffer, n / K, K, numa_placement::local); },
+						   "numa_parallel shuffle_batch K = 32, local", n, n_repeats);
+		check_permutations();
+
+		benchmark_callable([&]() { numa_parallel::shuffle_batch(buffer, n / K, K, numa_placement::interleaved); },
+						   "numa_parallel shuffle_batch K = 32, interleaved", n, n_repeats);
+		check_permutations();
+
+		numa_parallel::deallocate(buffer, n * sizeof(uint32_t));
+
+		std::cout << "\n";
+	}
+
+	// Fills and shuffles of DRAM-sized arrays in std::vector against 64-byte aligned buffers
+	// on normal and huge pages. Aligned fills of 16 MiB or more use streaming stores
+	void run_aligned()
+	{
+		std::cout << "\n==========================\n" <<
+					   		"\tAligned buffers" 		<<
+					"\n==========================\n\n";
+		std::cout << "Time reported in number of cycles per 32-bit number\n\n";
+
+		const uint32_t n_fill = uint32_t(1) << 26;
+		const uint32_t n_shuffle = uint32_t(1) << 24;
+		const std::size_t n_repeats = 3;
+
+		simd_xorshift128plus_key simd_key;
+
+		// One number past the start so the stores are never aligned
+		std::vector<uint32_t> vec(n_fill + 1);
+
+		benchmark_callable([&]() { my_simd_xor.fill_array(vec.data() + 1, n_fill, simd_key); },
+						   "fill_array, std::vector, misaligned", n_fill, n_repeats);
+
+		auto run_buffers = [&](page_backing backing, const std::string& name)
+		{
+			aligned_buffer<uint32_t> buffer(n_fill, backing);
+
+			benchmark_callable([&]() { my_simd_xor.fill_array(buffer.data(), n_fill, simd_key); },
+							   "fill_array, aligned_buffer, " + name, n_fill, n_repeats);
+
+#if defined(__AVX512F__)
+			simd_avx512_xorshift128plus_key avx512_key;
+
+			benchmark_callable([&]() { my_512simd_xor.fill_array(buffer.data(), n_fill, avx512_key); },
+							   "AVX512 fill_array, aligned_buffer, " + name, n_fill, n_repeats);
+#endif
+
+			benchmark_callable([&]() { my_dragon.fill_array(buffer.data(), n_fill); },
+							   "aes_dragontamer fill_array, aligned_buffer, " + name, n_fill, n_repeats);
+
+			// Every other number of a uniform fill has its top bit set
+			uint64_t top = 0;
+
+			for(uint32_t i = 0; i < n_fill; i++)
+				top += buffer[i] >> 31;
+
+			std::cout << "Top bits set " << std::setprecision(5) << double(top) / n_fill << " expected 0.5\n";
+
+			std::iota(buffer.begin(), buffer.begin() + n_shuffle, 0u);
+
+			benchmark_callable([&]() { my_simd_xor.simd_xorshift128plus_shuffle32(buffer.data(), n_shuffle); },
+							   "shuffle32, aligned_buffer, " + name, n_shuffle, n_repeats);
+
+			std::vector<uint32_t> sorted(buffer.begin(), buffer.begin() + n_shuffle);
+			std::sort(sorted.begin(), sorted.end());
+
+			uint32_t fixed = 0;
+
+			for(uint32_t i = 0; i < n_shuffle; i++)
+				fixed += buffer[i] == i;
+
+			std::cout << "Still a permutation " << (sorted[0] == 0 && sorted.back() == n_shuffle - 1 && std::adjacent_find(sorted.begin(), sorted.end()) == sorted.end())
+					  << ", fixed points " << fixed << " expected about 1\n";
+		};
+
+		std::iota(vec.begin(), vec.begin() + n_shuffle, 0u);
+
+		benchmark_callable([&]() { my_simd_xor.simd_xorshift128plus_shuffle32(vec.data(), n_shuffle); },
+						   "shuffle32, std::vector", n_shuffle, n_repeats);
+
+		run_buffers(page_backing::normal, "4 KiB pages");
+		run_buffers(page_backing::transparent_huge, "transparent huge pages");
+		run_buffers(page_backing::explicit_huge, "MAP_HUGETLB or transparent huge pages");
+
+		std::cout << "\n";
+	}
+
+	// The autotuner's timings of every fill variant and its routed fill_array against the fixed ones
+	void run_autotune()
+	{
+		std::cout << "\n==========================\n" <<
+					   		"\tAutotuning" 			<<
+					"\n==========================\n\n";
+
+		// The choice is cached in a file of this run only, the user's cache is left alone
+		const char* user_tune_file = std::getenv("SIMDXORSHIFT_TUNE_FILE");
+		const std::string saved_tune_file = user_tune_file ? user_tune_file : "";
+		const std::string tune_file = "/tmp/simd_xorshift_autotune_" + std::to_string(getpid());
+
+		setenv("SIMDXORSHIFT_TUNE_FILE", tune_file.c_str(), 1);
+
+		for(bool large : {false, true})
+		{
+			auto times = fill_autotuner::measure(large);
+
+			std::sort(times.begin(), times.end(), [](const std::pair<std::string, double>& a, const std::pair<std::string, double>& b) { return a.second < b.second; });
+
+			std::cout << (large ? "Large" : "Small") << " arrays, fastest first, relative to the fastest\n";
+
+			for(auto& t : times)
+				std::cout << "  " << std::left << std::setw(28) << t.first << std::right << std::setprecision(3) << t.second / times[0].second << "\n";
+
+			std::cout << "\n";
+		}
+
+		const uint32_t n_large = uint32_t(1) << 24;
+		const std::size_t n_repeats = 5;
+
+		aligned_buffer<uint32_t> buffer(n_large);
+
+		fill_autotuner tuner;
+		simd_xorshift128plus_key simd_key;
+
+		std::cout << "Time reported in number of cycles per 32-bit number\n\n";
+
+		for(uint32_t n : {uint32_t(N_rands), n_large})
+		{
+			const std::string size = " (" + std::to_string(n) + ")";
+
+			benchmark_callable([&]() { my_simd_xor.fill_array(buffer.data(), n, simd_key); }, "xor128_simd fill_array" + size, n, n_repeats);
+			benchmark_callable([&]() { my_simd_xor.fill_array_two(buffer.data(), n); }, "xor128_simd_two fill_array" + size, n, n_repeats);
+			benchmark_callable([&]() { my_dragon.fill_array(buffer.data(), n); }, "aes_dragontamer fill_array" + size, n, n_repeats);
+			benchmark_callable([&]() { tuner.fill_array(buffer.data(), n); }, "fill_autotuner, " + fill_autotuner::choice(n) + size, n, n_repeats);
+		}
+
+		uint64_t top = 0;
+
+		for(uint32_t i = 0; i < n_large; i++)
+			top += buffer[i] >> 31;
+
+		std::cout << "Top bits set " << std::setprecision(5) << double(top) / n_large << " expected 0.5\n";
+
+		// Pinning, then restoring the tuned choice for the benchmarks that follow
+		const std::string tuned_small = fill_autotuner::choice(0);
+		const std::string tuned_large = fill_autotuner::choice(n_large);
+
+		std::cout << "Pinned to dragontamer_x4: " << fill_autotuner::pin("dragontamer_x4") << ", now using " << fill_autotuner::choice(n_large) << "\n";
+		std::cout << "Pinned to dragontamer_x4_stream: " << fill_autotuner::pin("dragontamer_x4_stream") << ", small arrays use "
+				  << fill_autotuner::choice(0) << ", large arrays " << fill_autotuner::choice(n_large) << "\n";
+		std::cout << "Restored: " << fill_autotuner::pin(tuned_small, tuned_large) << ", small arrays use "
+				  << fill_autotuner::choice(0) << ", large arrays " << fill_autotuner::choice(n_large) << "\n";
+
+		std::remove(tune_file.c_str());
+
+		if (user_tune_file)
+			setenv("SIMDXORSHIFT_TUNE_FILE", saved_tune_file.c_str(), 1);
+		else
+			unsetenv("SIMDXORSHIFT_TUNE_FILE");
+
+		std::cout << "\n";
+	}
+
+	// The canonical stream from every kernel, checked word for word, and its speed against fill_array
+	void run_canonical()
+	{
+		std::cout << "\n==========================\n" <<
+					   		"\tCanonical streams" 		<<
+					"\n==========================\n\n";
+
+		canonical_xorshift128plus canonical;
+
+		const canonical_xorshift128plus_key seeded(0x853c49e6748fea9bull, 0xda3e39cb94b95bdbull);
+
+		typedef void (canonical_xorshift128plus::*kernel)(uint32_t*, uint32_t, canonical_xorshift128plus_key&);
+
+		std::vector<std::pair<std::string, kernel>> kernels = {
+			{"scalar", &canonical_xorshift128plus::fill_array_scalar},
+			{"AVX2", &canonical_xorshift128plus::fill_array_avx2},
+#if defined(__AVX512F__)
+			{"AVX512", &canonical_xorshift128plus::fill_array_avx512},
+#endif
+		};
+
+		// Every size, including partial steps, and the key left after it must match the scalar kernel
+		bool identical = true;
+
+		for (uint32_t size : {0u, 1u, 15u, 16u, 17u, 31u, 1000u, uint32_t(N_rands)})
+		{
+			std::vector<uint32_t> expected(size + 1, 0);
+			canonical_xorshift128plus_key expected_key = seeded;
+
+			canonical.fill_array_scalar(expected.data(), size, expected_key);
+
+			for (auto& k : kernels)
+			{
+				std::vector<uint32_t> out(size + 1, 0);
+				canonical_xorshift128plus_key key = seeded;
+
+				(canonical.*k.second)(out.data(), size, key);
+
+				identical &= std::equal(expected.begin(), expected.end(), out.begin()) &&
+							 std::memcmp(expected_key.part1, key.part1, sizeof(key.part1)) == 0 &&
+							 std::memcmp(expected_key.part2, key.part2, sizeof(key.part2)) == 0;
+
+				// One number in so the vector stores are misaligned
+				std::vector<uint32_t> shifted(size + 1, 0);
+				key = seeded;
+
+				(canonical.*k.second)(shifted.data() + 1, size, key);
+
+				identical &= std::equal(expected.begin(), expected.begin() + size, shifted.begin() + 1);
+			}
+		}
+
+		std::cout << "Kernels bit-identical, sizes 0 to " << N_rands << " : " << identical << "\n";
+
+		// Continuing a key in whole steps gives the same numbers as one fill
+		std::vector<uint32_t> whole(N_rands), parts(N_rands);
+		canonical_xorshift128plus_key whole_key = seeded, parts_key = seeded;
+
+		canonical.fill_array(whole.data(), N_rands, whole_key);
+		canonical.fill_array_avx2(parts.data(), 4096, parts_key);
+		canonical.fill_array_scalar(parts.data() + 4096, 4096, parts_key);
+		canonical.fill_array(parts.data() + 8192, N_rands - 8192, parts_key);
+
+		std::cout << "Split across kernels and calls matches one fill : " << (whole == parts) << "\n";
+
+		// Lane 0 is the reference xorshift128+ stream of the mixed seed
+		uint64_t seed1 = 0x853c49e6748fea9bull, seed2 = 0xda3e39cb94b95bdbull;
+
+		xorshift128plus_key::mix_seeds(seed1, seed2);
+
+		xorshift128plus_key reference(seed1, seed2);
+		bool lane0 = true;
+
+		for (uint32_t i = 0; i + 16 <= N_rands; i += 16)
+		{
+			uint64_t word;
+			std::memcpy(&word, whole.data() + i, sizeof(word));
+
+			lane0 &= word == my_xor.get_rand(reference);
+		}
+
+		std::cout << "Lane 0 matches xorshift128plus : " << lane0 << "\n\n";
+
+		std::cout << "Time reported in number of cycles per 32-bit number\n\n";
+
+		canonical_xorshift128plus_key key;
+
+		for (auto& k : kernels)
+			benchmark_callable([&]() { (canonical.*k.second)(rand_arr.data(), N_rands, key); }, "canonical " + k.first, N_rands);
+
+		simd_xorshift128plus_key simd_key;
+
+		benchmark_callable([&]() { my_simd_xor.fill_array(rand_arr.data(), N_rands, simd_key); }, "xor128_simd fill_array", N_rands);
+
+#if defined(__AVX512F__)
+		simd_avx512_xorshift128plus_key avx512_key;
+
+		benchmark_callable([&]() { my_512simd_xor.fill_array(rand_arr.data(), N_rands, avx512_key); }, "AVX512 fill_array", N_rands);
+#endif
+
+		std::cout << "\n";
+	}
+
+	// Divide and conquer fill of [first, last), each fork gives its left half a split key
+	// Forks above spawn_depth run on new threads, so the output doesn't depend on the schedule
+	void split_task(uint32_t* out, uint32_t first, uint32_t last, simd_xorshift128plus_key key, uint32_t leaf, int spawn_depth, std::atomic<uint64_t>& tasks)
+	{
+		tasks.fetch_add(1, std::memory_order_relaxed);
+
+		if (last - first <= leaf)
+			return my_simd_xor.fill_array(out + first, last - first, key);
+
+		simd_xorshift128plus_key child = key.split();
+
+		const uint32_t mid = first + (last - first) / 2;
+
+		if (spawn_depth > 0)
+		{
+			std::thread left([&, child, mid]() { split_task(out, first, mid, child, leaf, spawn_depth - 1, tasks); });
+
+			split_task(out, mid, last, key, leaf, spawn_depth - 1, tasks);
+
+			left.join();
+		}
+		else
+		{
+			split_task(out, first, mid, child, leaf, 0, tasks);
+			split_task(out, mid, last, key, leaf, 0, tasks);
+		}
+	}
+
+	// Cost of split on each key and of a fork-join task tree using it
+	void run_split()
+	{
+		std::cout << "\n==========================\n" <<
+					   		"\tSplittable keys" 		<<
+					"\n==========================\n\n";
+		std::cout << "Time reported in number of cycles per split\n\n";
+
+		const uint32_t n_splits = 1 << 16;
+
+		xorshift128plus_key scalar_key;
+		simd_xorshift128plus_key simd_key;
+		aes_dragontamer_key dragon_key;
+
+		// The children's first words go through sink so the splits can't be optimized away
+		uint64_t sink = 0;
+
+		benchmark_callable([&]() { for (uint32_t i = 0; i < n_splits; i++) sink += scalar_key.split().seed1; },
+						   "xorshift128plus_key split", n_splits);
+
+		benchmark_callable([&]() { for (uint32_t i = 0; i < n_splits; i++) sink += _mm256_extract_epi64(simd_key.split().part2, 0); },
+						   "simd_xorshift128plus_key split", n_splits);
+
+#if defined(__AVX512F__)
+		simd_avx512_xorshift128plus_key avx512_key;
+
+		benchmark_callable([&]() { for (uint32_t i = 0; i < n_splits; i++) sink += _mm_extract_epi64(_mm512_castsi512_si128(avx512_key.split().part2), 0); },
+						   "simd_avx512_xorshift128plus_key split", n_splits);
+#endif
+
+		benchmark_callable([&]() { for (uint32_t i = 0; i < n_splits; i++) sink += _mm_extract_epi64(dragon_key.split().state, 0); },
+						   "aes_dragontamer_key split", n_splits);
+
+		benchmark_callable([&]() { for (uint64_t i = 0; i < n_splits / 256; i++) sink += _mm256_extract_epi64(rng_pool(1, 2).xorshift_key(1000).part2, 0); },
+						   "rng_pool substream 1000, for comparison", n_splits / 256);
+
+		std::cout << "\n";
+
+		// Half of the bits of a parent's next output and its child's first output differ
+		simd_xorshift128plus_key parent(0x853c49e6748fea9bull, 0xda3e39cb94b95bdbull);
+		uint64_t differ = 0;
+
+		for (uint32_t i = 0; i < n_splits; i++)
+		{
+			simd_xorshift128plus_key child = parent.split();
+
+			__m256i d = _mm256_xor_si256(my_simd_xor.get_rand(parent), my_simd_xor.get_rand(child));
+
+			for (int lane = 0; lane < 4; lane++)
+			{
+				differ += _mm_popcnt_u64(_mm256_extract_epi64(d, 0));
+
+				d = _mm256_permute4x64_epi64(d, 0x39);
+			}
+		}
+
+		std::cout << "Parent and child outputs differ in " << std::setprecision(5) << double(differ) / (256.0 * n_splits)
+				  << " of bits, expected 0.5 (sink " << (sink & 1) << ")\n\n";
+
+		std::cout << "Time reported in number of cycles per 32-bit number\n\n";
+
+		const uint32_t n_fill = 1 << 24;
+		const uint32_t spawn_depth = 3;
+
+		std::vector<uint32_t> serial(n_fill), parallel(n_fill);
+
+		benchmark_callable([&]() { simd_xorshift128plus_key key(3, 4); my_simd_xor.fill_array(serial.data(), n_fill, key); },
+						   "fill_array, one key", n_fill, 5);
+
+		for (uint32_t leaf : {1u << 16, 1u << 12, 1u << 8})
+		{
+			std::atomic<uint64_t> tasks{0};
+
+			benchmark_callable([&]() { split_task(serial.data(), 0, n_fill, simd_xorshift128plus_key(3, 4), leaf, 0, tasks); },
+							   "task tree, " + std::to_string(leaf) + " numbers per leaf, serial", n_fill, 5);
+
+			benchmark_callable([&]() { split_task(parallel.data(), 0, n_fill, simd_xorshift128plus_key(3, 4), leaf, spawn_depth, tasks); },
+							   "task tree, " + std::to_string(leaf) + " numbers per leaf, " + std::to_string(1 << spawn_depth) + " threads", n_fill, 5);
+
+			std::cout << "Tasks " << tasks / 10 << ", same output serial and threaded " << (serial == parallel) << "\n";
+		}
+
+		std::cout << "\n";
+	}
+
+	// The least a client of a shared memory random pool would do on every process start, attach
+	// and read one page, against seeding a key and filling in-process
+	void run_shm_attach()
+	{
+		std::cout << "\n==========================\n" <<
+					   		"\tShared memory attach" 		<<
+					"\n==========================\n\n";
+
+		const std::string name = "/simd_xorshift_bench_" + std::to_string(getpid());
+		const std::size_t page = 4096;
+
+		const int created = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+
+		if (created < 0 || ftruncate(created, page) != 0)
+		{
+			std::cout << "No POSIX shared memory\n\n";
+
+			shm_unlink(name.c_str());
+			return;
+		}
+
+		close(created);
+
+		std::cout << "Time reported in number of cycles per process start\n\n";
+
+		std::vector<uint32_t> small(1000);
+
+		benchmark_callable([&]() { simd_xorshift128plus_key key; my_simd_xor.fill_array(small.data(), 1000, key); },
+						   "in-process key and fill_array of 1000 numbers", 1, 50);
+
+		benchmark_callable([&]()
+		{
+			const int fd = shm_open(name.c_str(), O_RDWR, 0);
+
+			void* p = mmap(nullptr, page, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+			close(fd);
+
+			if (p != MAP_FAILED)
+			{
+				small[0] = *(volatile uint32_t *)p;
+
+				munmap(p, page);
+			}
+		}, "shm_open, mmap and read one page", 1, 50);
+
+		shm_unlink(name.c_str());
+
+		std::cout << "\n";
+	}
+
     void run_generators()
     {
 		std::cout << "==========================\n" <<
@@ -241,7 +2351,7 @@ public:
 
     	#if defined(__AVX512F__)
     		fn_name = "AVX512 xor128_simd";
-    		benchmark_fn(&simd_avx512_xorshift128plus::fill_array, simd_avx512_xorshift128plus, rand_arr.data(), fn_name, N_rands);
+    		benchmark_fn(&simd_avx512_xorshift128plus::fill_array, my_512simd_xor, rand_arr.data(), fn_name, N_rands);
 			// benchmark_generators(my_512simd_xor, fn_name);
 		#endif
 
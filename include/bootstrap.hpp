@@ -0,0 +1,284 @@
+#ifndef BOOTSTRAP_H
+#define BOOTSTRAP_H
+
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <limits>
+
+#include "simd_intrinsics.hpp"
+#include "simd_xorshift128plus.hpp"
+#include "rng_pool.hpp"
+
+#if defined(__AVX512F__)
+	#include "simd_avx512_xorshift128plus.hpp"
+#endif
+
+// Bootstrap resampling with replacement from an array of doubles
+// Indices come from the SIMD bounded kernel and values are gathered straight from the
+// source, the sum kernel never writes the resample out. AVX-512 is used when available.
+// The source can hold up to 2^31 - 1 values as the gathers take signed 32-bit indices.
+// An empty source (n == 0) has nothing to draw: sums are 0, means and quantiles NaN and
+// resample writes nothing
+class bootstrap
+{
+public:
+#if defined(__AVX512F__)
+	typedef simd_avx512_xorshift128plus_key key_type;
+#else
+	typedef simd_xorshift128plus_key key_type;
+#endif
+
+protected:
+#if defined(__AVX512F__)
+	simd_avx512_xorshift128plus generator;
+
+	static key_type make_key(rng_pool& pool)
+	{
+		return pool.make_avx512_xorshift_key();
+	}
+
+	// Sum of m values drawn with replacement from src[0, n), n > 0
+	double resample_sum(const double* src, uint32_t n, uint32_t m, key_type& key)
+	{
+		const __m512i bound = _mm512_set1_epi32(n);
+
+		__m512d acc0 = _mm512_setzero_pd();
+		__m512d acc1 = _mm512_setzero_pd();
+
+		uint32_t i = 0;
+
+		const uint32_t block = sizeof(__m512i) / sizeof(uint32_t); // 16
+
+		while (i + block <= m)
+		{
+			__m512i idx = simd_avx512_xorshift128plus::avx512_randombound_epu32(generator.get_rand(key), bound);
+
+			acc0 = _mm512_add_pd(acc0, _mm512_i32gather_pd(_mm512_castsi512_si256(idx), src, 8));
+			acc1 = _mm512_add_pd(acc1, _mm512_i32gather_pd(_mm512_extracti64x4_epi64(idx, 1), src, 8));
+
+			i += block;
+		}
+
+		if (i != m)
+		{
+			__m512i idx = simd_avx512_xorshift128plus::avx512_randombound_epu32(generator.get_rand(key), bound);
+
+			const __mmask16 tail = (__mmask16)((1u << (m - i)) - 1);
+
+			acc0 = _mm512_add_pd(acc0, _mm512_mask_i32gather_pd(_mm512_setzero_pd(), (__mmask8)tail, _mm512_castsi512_si256(idx), src, 8));
+			acc1 = _mm512_add_pd(acc1, _mm512_mask_i32gather_pd(_mm512_setzero_pd(), (__mmask8)(tail >> 8), _mm512_extracti64x4_epi64(idx, 1), src, 8));
+		}
+
+		return _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1));
+	}
+
+	// Writes m values drawn with replacement from src[0, n) to out, n > 0
+	void resample_values(const double* src, uint32_t n, double* out, uint32_t m, key_type& key)
+	{
+		const __m512i bound = _mm512_set1_epi32(n);
+
+		uint32_t i = 0;
+
+		const uint32_t block = sizeof(__m512i) / sizeof(uint32_t); // 16
+
+		while (i + block <= m)
+		{
+			__m512i idx = simd_avx512_xorshift128plus::avx512_randombound_epu32(generator.get_rand(key), bound);
+
+			_mm512_storeu_pd(out + i, _mm512_i32gather_pd(_mm512_castsi512_si256(idx), src, 8));
+			_mm512_storeu_pd(out + i + 8, _mm512_i32gather_pd(_mm512_extracti64x4_epi64(idx, 1), src, 8));
+
+			i += block;
+		}
+
+		if (i != m)
+		{
+			__m512i idx = simd_avx512_xorshift128plus::avx512_randombound_epu32(generator.get_rand(key), bound);
+
+			const __mmask16 tail = (__mmask16)((1u << (m - i)) - 1);
+
+			_mm512_mask_storeu_pd(out + i, (__mmask8)tail,
+								  _mm512_mask_i32gather_pd(_mm512_setzero_pd(), (__mmask8)tail, _mm512_castsi512_si256(idx), src, 8));
+			_mm512_mask_storeu_pd(out + i + 8, (__mmask8)(tail >> 8),
+								  _mm512_mask_i32gather_pd(_mm512_setzero_pd(), (__mmask8)(tail >> 8), _mm512_extracti64x4_epi64(idx, 1), src, 8));
+		}
+	}
+#else
+	simd_xorshift128plus generator;
+
+	static key_type make_key(rng_pool& pool)
+	{
+		return pool.make_xorshift_key();
+	}
+
+	// Sum of m values drawn with replacement from src[0, n), n > 0
+	double resample_sum(const double* src, uint32_t n, uint32_t m, key_type& key)
+	{
+		const __m256i bound = _mm256_set1_epi32(n);
+
+		__m256d acc0 = _mm256_setzero_pd();
+		__m256d acc1 = _mm256_setzero_pd();
+
+		uint32_t i = 0;
+
+		const uint32_t block = sizeof(__m256i) / sizeof(uint32_t); // 8
+
+		while (i + block <= m)
+		{
+			__m256i idx = simd_xorshift128plus::avx_randombound_epu32(generator.get_rand(key), bound);
+
+			acc0 = _mm256_add_pd(acc0, _mm256_i32gather_pd(src, _mm256_castsi256_si128(idx), 8));
+			acc1 = _mm256_add_pd(acc1, _mm256_i32gather_pd(src, _mm256_extracti128_si256(idx, 1), 8));
+
+			i += block;
+		}
+
+		double buffer[4];
+
+		_mm256_storeu_pd(buffer, _mm256_add_pd(acc0, acc1));
+
+		double sum = (buffer[0] + buffer[1]) + (buffer[2] + buffer[3]);
+
+		if (i != m)
+		{
+			uint32_t idx[sizeof(__m256i) / sizeof(uint32_t)];
+
+			_mm256_storeu_si256((__m256i *)idx, simd_xorshift128plus::avx_randombound_epu32(generator.get_rand(key), bound));
+
+			for (uint32_t j = 0; j < m - i; j++)
+				sum += src[idx[j]];
+		}
+
+		return sum;
+	}
+
+	// Writes m values drawn with replacement from src[0, n) to out, n > 0
+	void resample_values(const double* src, uint32_t n, double* out, uint32_t m, key_type& key)
+	{
+		const __m256i bound = _mm256_set1_epi32(n);
+
+		uint32_t i = 0;
+
+		const uint32_t block = sizeof(__m256i) / sizeof(uint32_t); // 8
+
+		while (i + block <= m)
+		{
+			__m256i idx = simd_xorshift128plus::avx_randombound_epu32(generator.get_rand(key), bound);
+
+			_mm256_storeu_pd(out + i, _mm256_i32gather_pd(src, _mm256_castsi256_si128(idx), 8));
+			_mm256_storeu_pd(out + i + 4, _mm256_i32gather_pd(src, _mm256_extracti128_si256(idx, 1), 8));
+
+			i += block;
+		}
+
+		if (i != m)
+		{
+			uint32_t idx[sizeof(__m256i) / sizeof(uint32_t)];
+
+			_mm256_storeu_si256((__m256i *)idx, simd_xorshift128plus::avx_randombound_epu32(generator.get_rand(key), bound));
+
+			for (uint32_t j = 0; j < m - i; j++)
+				out[i + j] = src[idx[j]];
+		}
+	}
+#endif
+
+	// Runs fn(key, first, last) on blocks of resamples, one thread and pool substream per block
+	template <typename FN>
+	static void for_resamples(uint32_t n_resamples, unsigned n_threads, rng_pool& pool, FN fn)
+	{
+		n_threads = std::max(1u, std::min(n_threads, n_resamples));
+
+		std::vector<std::thread> threads;
+
+		for (unsigned t = 0; t < n_threads; t++)
+		{
+			const uint32_t first = uint32_t(uint64_t(n_resamples) * t / n_threads);
+			const uint32_t last = uint32_t(uint64_t(n_resamples) * (t + 1) / n_threads);
+
+			key_type key = make_key(pool);
+
+			if (n_threads == 1)
+				return fn(key, first, last);
+
+			threads.emplace_back([fn, key, first, last]() mutable { fn(key, first, last); });
+		}
+
+		for (auto& thread : threads)
+			thread.join();
+	}
+
+public:
+	bootstrap() {}
+
+	// The sum and the mean of one resample of size m
+	double sum(const double* src, uint32_t n, uint32_t m, key_type& key)
+	{
+		if (n == 0)
+			return 0;
+
+		return resample_sum(src, n, m, key);
+	}
+
+	double mean(const double* src, uint32_t n, uint32_t m, key_type& key)
+	{
+		if (n == 0)
+			return std::numeric_limits<double>::quiet_NaN();
+
+		return resample_sum(src, n, m, key) / m;
+	}
+
+	// One resample of size m written to out
+	void resample(const double* src, uint32_t n, double* out, uint32_t m, key_type& key)
+	{
+		if (n == 0)
+			return;
+
+		resample_values(src, n, out, m, key);
+	}
+
+	// The means of n_resamples resamples the size of the source, nothing is materialized
+	static void means(const double* src, uint32_t n, double* out, uint32_t n_resamples, unsigned n_threads, rng_pool& pool = rng_pool::global())
+	{
+		if (n == 0)
+			return std::fill(out, out + n_resamples, std::numeric_limits<double>::quiet_NaN());
+
+		for_resamples(n_resamples, n_threads, pool, [src, n, out](key_type& key, uint32_t first, uint32_t last)
+		{
+			bootstrap local;
+
+			for (uint32_t r = first; r < last; r++)
+				out[r] = local.resample_sum(src, n, n, key) / n;
+		});
+	}
+
+	// The q-quantile of each resample, each thread materializes one resample at a time
+	static void quantiles(const double* src, uint32_t n, double q, double* out, uint32_t n_resamples, unsigned n_threads, rng_pool& pool = rng_pool::global())
+	{
+		if (n == 0)
+			return std::fill(out, out + n_resamples, std::numeric_limits<double>::quiet_NaN());
+
+		const uint32_t rank = uint32_t(q * (n - 1));
+
+		for_resamples(n_resamples, n_threads, pool, [src, n, rank, out](key_type& key, uint32_t first, uint32_t last)
+		{
+			bootstrap local;
+
+			std::vector<double> scratch(n);
+
+			for (uint32_t r = first; r < last; r++)
+			{
+				local.resample_values(src, n, scratch.data(), n, key);
+
+				std::nth_element(scratch.begin(), scratch.begin() + rank, scratch.end());
+
+				out[r] = scratch[rank];
+			}
+		});
+	}
+};
+
+#endif
@@ -0,0 +1,215 @@
+#ifndef CANONICALSTREAM_H
+#define CANONICALSTREAM_H
+
+#include <cstring>
+#include <cstdint>
+#include <array>
+#include <algorithm>
+
+#include "simd_intrinsics.hpp"
+#include "randutils.hpp"
+#include "xorshift128plus.hpp"
+
+// The canonical stream has eight logical xorshift128+ lanes, lane n starting n jumps (n * 2^64 steps)
+// along from the seed. Each step of the eight lanes gives eight 64-bit words, stored in lane order
+// as sixteen 32-bit numbers. The order doesn't depend on the vector width, so the scalar, AVX2 and
+// AVX-512 kernels write bit-identical arrays from the same key.
+// The lanes use the reference xorshift128+ step of xorshift128plus, which the jump polynomial is for.
+// Explicit seeds are mixed with xorshift128plus_key::mix_seeds, lane 0 starts from the mixed state
+class canonical_xorshift128plus_key
+{
+protected:
+	void init_lanes(uint64_t seed1, uint64_t seed2)
+	{
+		xorshift128plus_key lane(seed1, seed2);
+
+		for (int n = 0; n < lanes; n++)
+		{
+			part1[n] = lane.seed1;
+			part2[n] = lane.seed2;
+
+			lane.jump();
+		}
+	}
+
+public:
+	static constexpr int lanes = 8;
+
+	canonical_xorshift128plus_key()
+	{
+		std::array<uint32_t, 4> seed_array;
+		randutils::auto_seed_128 seeder;
+		seeder.generate(seed_array.begin(), seed_array.end());
+
+		uint64_t seed_part1 = seed_array[0];
+		uint64_t seed_part2 = seed_array[1];
+		uint64_t seed_part3 = seed_array[2];
+		uint64_t seed_part4 = seed_array[3];
+
+		init_lanes(seed_part1 << 32 | seed_part2, seed_part3 << 32 | seed_part4);
+	}
+
+	// Explicitly seeded key, the same seeds give the same stream on every ISA
+	// Any pair gives a working key, (0, 0) included
+	canonical_xorshift128plus_key(uint64_t seed1, uint64_t seed2)
+	{
+		xorshift128plus_key::mix_seeds(seed1, seed2);
+
+		init_lanes(seed1, seed2);
+	}
+
+	// Plain arrays so a key can be saved, sent to another host and loaded by any kernel
+	alignas(64) uint64_t part1[lanes];
+	alignas(64) uint64_t part2[lanes];
+};
+
+
+class canonical_xorshift128plus
+{
+protected:
+	// 32-bit numbers per step of the eight lanes
+	static constexpr uint32_t block = 2 * canonical_xorshift128plus_key::lanes;
+
+	static inline uint64_t scalar_step(uint64_t& a, uint64_t& b)
+	{
+		uint64_t s1 = a;
+		const uint64_t s0 = b;
+		a = s0;
+		s1 ^= s1 << 23; // a
+		b = s1 ^ s0 ^ (s1 >> 18) ^ (s0 >> 5); // b, c
+		return b + s0;
+	}
+
+	static inline __m256i avx2_step(__m256i& a, __m256i& b)
+	{
+		__m256i s1 = a;
+		const __m256i s0 = b;
+		a = s0;
+		s1 = _mm256_xor_si256(s1, _mm256_slli_epi64(s1, 23));
+		b = _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(s1, s0), _mm256_srli_epi64(s1, 18)), _mm256_srli_epi64(s0, 5));
+		return _mm256_add_epi64(b, s0);
+	}
+
+	// A partial last step is still a whole step, so every kernel leaves the key in the same state
+	void populate_scalar(uint32_t* rand_arr, const uint32_t size, canonical_xorshift128plus_key& key)
+	{
+		uint64_t a[block / 2];
+		uint64_t b[block / 2];
+
+		std::memcpy(a, key.part1, sizeof(a));
+		std::memcpy(b, key.part2, sizeof(b));
+
+		uint64_t words[block / 2];
+
+		for (uint32_t i = 0; i < size; i += block)
+		{
+			for (uint32_t n = 0; n < block / 2; n++)
+				words[n] = scalar_step(a[n], b[n]);
+
+			std::memcpy(rand_arr + i, words, std::min(block, size - i) * sizeof(uint32_t));
+		}
+
+		std::memcpy(key.part1, a, sizeof(a));
+		std::memcpy(key.part2, b, sizeof(b));
+	}
+
+	// Lanes 0-3 and 4-7 in two registers, stored one after the other
+	void populate_avx2(uint32_t* rand_arr, const uint32_t size, canonical_xorshift128plus_key& key)
+	{
+		__m256i a_lo = _mm256_load_si256((const __m256i *)key.part1);
+		__m256i a_hi = _mm256_load_si256((const __m256i *)(key.part1 + 4));
+		__m256i b_lo = _mm256_load_si256((const __m256i *)key.part2);
+		__m256i b_hi = _mm256_load_si256((const __m256i *)(key.part2 + 4));
+
+		uint32_t i = 0;
+
+		for (; i + block <= size; i += block)
+		{
+			_mm256_storeu_si256((__m256i *)(rand_arr + i), avx2_step(a_lo, b_lo));
+			_mm256_storeu_si256((__m256i *)(rand_arr + i + 8), avx2_step(a_hi, b_hi));
+		}
+
+		if (i != size)
+		{
+			uint32_t buffer[block];
+
+			_mm256_storeu_si256((__m256i *)buffer, avx2_step(a_lo, b_lo));
+			_mm256_storeu_si256((__m256i *)(buffer + 8), avx2_step(a_hi, b_hi));
+
+			std::memcpy(rand_arr + i, buffer, (size - i) * sizeof(uint32_t));
+		}
+
+		_mm256_store_si256((__m256i *)key.part1, a_lo);
+		_mm256_store_si256((__m256i *)(key.part1 + 4), a_hi);
+		_mm256_store_si256((__m256i *)key.part2, b_lo);
+		_mm256_store_si256((__m256i *)(key.part2 + 4), b_hi);
+	}
+
+#if defined(__AVX512F__)
+	static inline __m512i avx512_step(__m512i& a, __m512i& b)
+	{
+		__m512i s1 = a;
+		const __m512i s0 = b;
+		a = s0;
+		s1 = _mm512_xor_si512(s1, _mm512_slli_epi64(s1, 23));
+		b = _mm512_xor_si512(_mm512_xor_si512(_mm512_xor_si512(s1, s0), _mm512_srli_epi64(s1, 18)), _mm512_srli_epi64(s0, 5));
+		return _mm512_add_epi64(b, s0);
+	}
+
+	// All eight lanes in one register
+	void populate_avx512(uint32_t* rand_arr, const uint32_t size, canonical_xorshift128plus_key& key)
+	{
+		__m512i a = _mm512_load_si512((const void *)key.part1);
+		__m512i b = _mm512_load_si512((const void *)key.part2);
+
+		uint32_t i = 0;
+
+		for (; i + block <= size; i += block)
+			_mm512_storeu_si512((void *)(rand_arr + i), avx512_step(a, b));
+
+		if (i != size)
+			_mm512_mask_storeu_epi32((void *)(rand_arr + i), __mmask16((1u << (size - i)) - 1), avx512_step(a, b));
+
+		_mm512_store_si512((void *)key.part1, a);
+		_mm512_store_si512((void *)key.part2, b);
+	}
+#endif
+
+public:
+	// The widest kernel this build has
+	void fill_array(uint32_t* rand_arr, uint32_t N_rands, canonical_xorshift128plus_key& key)
+	{
+#if defined(__AVX512F__)
+		return populate_avx512(rand_arr, N_rands, key);
+#else
+		return populate_avx2(rand_arr, N_rands, key);
+#endif
+	}
+
+	void fill_array(uint32_t* rand_arr, uint32_t N_rands)
+	{
+		canonical_xorshift128plus_key key;
+
+		return fill_array(rand_arr, N_rands, key);
+	}
+
+	// Each kernel on its own, all give the same array and leave key in the same state
+	void fill_array_scalar(uint32_t* rand_arr, uint32_t N_rands, canonical_xorshift128plus_key& key)
+	{
+		return populate_scalar(rand_arr, N_rands, key);
+	}
+
+	void fill_array_avx2(uint32_t* rand_arr, uint32_t N_rands, canonical_xorshift128plus_key& key)
+	{
+		return populate_avx2(rand_arr, N_rands, key);
+	}
+
+#if defined(__AVX512F__)
+	void fill_array_avx512(uint32_t* rand_arr, uint32_t N_rands, canonical_xorshift128plus_key& key)
+	{
+		return populate_avx512(rand_arr, N_rands, key);
+	}
+#endif
+};
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef KEYSTREAM_H
+#define KEYSTREAM_H
+
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <utility>
+
+#include "simd_intrinsics.hpp"
+
+// Shared pieces of the xor_keystream functions on the generators
+// The keystream is the sequence of bytes of the generator's output vectors, byte p of
+// the stream is byte p % sizeof(vector) of vector p / sizeof(vector)
+
+inline void keystream_store(unsigned char* p, __m256i v)
+{
+	_mm256_storeu_si256((__m256i *)p, v);
+}
+
+// p ^= rand for one vector of bytes
+inline void keystream_xor_vector(unsigned char* p, __m256i rand)
+{
+	_mm256_storeu_si256((__m256i *)p, _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)p), rand));
+}
+
+#if defined(__AVX512F__)
+inline void keystream_store(unsigned char* p, __m512i v)
+{
+	_mm512_storeu_si512((void *)p, v);
+}
+
+inline void keystream_xor_vector(unsigned char* p, __m512i rand)
+{
+	_mm512_storeu_si512((void *)p, _mm512_xor_si512(_mm512_loadu_si512((const void *)p), rand));
+}
+#endif
+
+// XORs n bytes with the output of state, starting skip bytes into its next vector
+// STATE is one of the register-resident generator states
+template <typename STATE, typename VEC = decltype(std::declval<STATE&>().next())>
+inline void keystream_xor_bytes(unsigned char* bytes, std::size_t n, std::size_t skip, STATE& state)
+{
+	const std::size_t block = sizeof(VEC);
+
+	alignas(64) unsigned char stream[sizeof(VEC)];
+
+	// A partial first vector when the range doesn't start on a vector of the stream
+	if (skip != 0 && n != 0)
+	{
+		keystream_store(stream, state.next());
+
+		const std::size_t m = std::min(n, block - skip);
+
+		for (std::size_t i = 0; i < m; i++)
+			bytes[i] ^= stream[skip + i];
+
+		bytes += m;
+		n -= m;
+	}
+
+	while (n >= block)
+	{
+		keystream_xor_vector(bytes, state.next());
+
+		bytes += block;
+		n -= block;
+	}
+
+	if (n != 0)
+	{
+		keystream_store(stream, state.next());
+
+		for (std::size_t i = 0; i < n; i++)
+			bytes[i] ^= stream[i];
+	}
+}
+
+// Splits the buffer into one range per thread, every range seeks to its own offset
+// Ranges are multiples of 64 KiB of stream so the xorshift keystreams don't repeat block set-up
+template <typename GEN, typename KEY>
+void keystream_xor_parallel(void* buf, std::size_t len, const KEY& key, uint64_t offset, unsigned n_threads)
+{
+	const std::size_t granule = std::size_t(1) << 16;
+
+	const std::size_t per_thread = (len / std::max(1u, n_threads) + granule - 1) / granule * granule;
+
+	if (n_threads < 2 || per_thread == 0 || per_thread >= len)
+		return GEN().xor_keystream(buf, len, key, offset);
+
+	std::vector<std::thread> threads;
+
+	unsigned char* bytes = (unsigned char *)buf;
+
+	for (std::size_t start = 0; start < len; start += per_thread)
+	{
+		const std::size_t n = std::min(per_thread, len - start);
+
+		threads.emplace_back([bytes, start, n, &key, offset]() { GEN().xor_keystream(bytes + start, n, key, offset + start); });
+	}
+
+	for (auto& thread : threads)
+		thread.join();
+}
+
+#endif
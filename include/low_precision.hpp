@@ -0,0 +1,363 @@
+#ifndef LOWPRECISION_H
+#define LOWPRECISION_H
+
+#include <cstring>
+#include <cstdint>
+
+#include "simd_intrinsics.hpp"
+#include "simd_xorshift128plus.hpp"
+#include "simd_distributions.hpp"
+
+#if defined(__AVX512F__)
+	#include "simd_avx512_xorshift128plus.hpp"
+	#include "simd_avx512_distributions.hpp"
+#endif
+
+// Uniform and normal arrays in bfloat16, IEEE half precision and int8, without an fp32 array
+// bf16 and fp16 values are returned as their uint16_t bit patterns.
+// Each 32-bit random lane gives two outputs: for uniforms the top bits of each 16-bit half are
+// injected into a mantissa, for normals the lane is split into the two Box-Muller uniforms.
+// The order of the outputs within a vector is not the order of the lanes.
+// fp16 needs F16C (or AVX-512), bf16 uses the AVX-512 BF16 conversions when available
+class low_precision
+{
+public:
+#if defined(__AVX512F__)
+	typedef simd_avx512_xorshift128plus_key key_type;
+#else
+	typedef simd_xorshift128plus_key key_type;
+#endif
+
+protected:
+	// Random mantissa bits for each format
+	static constexpr int bf16_bits = 7;
+	static constexpr int fp16_bits = 10;
+
+#if defined(__AVX512F__)
+	typedef __m512 vec_ps;
+	typedef __m512i vec_i;
+
+	simd_avx512_xorshift128plus generator;
+
+	static vec_ps set1(float x)
+	{
+		return _mm512_set1_ps(x);
+	}
+
+	static vec_ps min(vec_ps a, vec_ps b)
+	{
+		return _mm512_min_ps(a, b);
+	}
+
+	static void store(unsigned char* p, vec_i v)
+	{
+		_mm512_storeu_si512((void *)p, v);
+	}
+
+	// lo + width * u with u in [0, 1) on a grid of 2^-mantissa_bits, from each 16-bit half
+	static void uniform_pair(vec_i bits, int mantissa_bits, vec_ps lo, vec_ps width, vec_ps* a, vec_ps* b)
+	{
+		const vec_i mantissa = _mm512_set1_epi32(((1 << mantissa_bits) - 1) << (23 - mantissa_bits));
+		const vec_i one = _mm512_set1_epi32(0x3F800000);
+
+		vec_ps one_two_a = _mm512_castsi512_ps(_mm512_or_si512(_mm512_and_si512(_mm512_srli_epi32(bits, 9), mantissa), one));
+		vec_ps one_two_b = _mm512_castsi512_ps(_mm512_or_si512(_mm512_and_si512(_mm512_slli_epi32(bits, 7), mantissa), one));
+
+		*a = _mm512_fmadd_ps(_mm512_sub_ps(one_two_a, set1(1.0f)), width, lo);
+		*b = _mm512_fmadd_ps(_mm512_sub_ps(one_two_b, set1(1.0f)), width, lo);
+	}
+
+	// Box-Muller with the radius from the top 20 bits and the angle from the low 12 bits
+	// Normals are cut off at sqrt(2 log 2^20) ~ 5.3 standard deviations
+	static void normal_pair(vec_i bits, vec_ps mean, vec_ps stddev, vec_ps* z0, vec_ps* z1)
+	{
+		vec_ps u1 = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_add_epi32(_mm512_srli_epi32(bits, 12), _mm512_set1_epi32(1))), set1(1.0f / 1048576.0f));
+		vec_ps u2 = _mm512_fmadd_ps(_mm512_cvtepi32_ps(_mm512_and_si512(bits, _mm512_set1_epi32(0xFFF))), set1(1.0f / 4096.0f), set1(0.5f / 4096.0f));
+
+		vec_ps r = _mm512_mul_ps(_mm512_sqrt_ps(_mm512_mul_ps(set1(-2.0f), simd_avx512_distributions::log_ps(u1))), stddev);
+
+		vec_ps s, c;
+		simd_avx512_distributions::sincos_2pi_ps(u2, &s, &c);
+
+		*z0 = _mm512_fmadd_ps(r, c, mean);
+		*z1 = _mm512_fmadd_ps(r, s, mean);
+	}
+
+	static vec_i to_bf16(vec_ps a, vec_ps b)
+	{
+	#if defined(__AVX512BF16__)
+		return (vec_i)_mm512_cvtne2ps_pbh(a, b);
+	#else
+		// Round to nearest even on the top 16 bits, a in the high half of each lane
+		const vec_i lsb = _mm512_set1_epi32(1);
+		const vec_i half = _mm512_set1_epi32(0x7FFF);
+
+		vec_i ia = _mm512_castps_si512(a);
+		vec_i ib = _mm512_castps_si512(b);
+
+		ia = _mm512_add_epi32(ia, _mm512_add_epi32(half, _mm512_and_si512(_mm512_srli_epi32(ia, 16), lsb)));
+		ib = _mm512_add_epi32(ib, _mm512_add_epi32(half, _mm512_and_si512(_mm512_srli_epi32(ib, 16), lsb)));
+
+		return _mm512_or_si512(_mm512_and_si512(ia, _mm512_set1_epi32(0xFFFF0000)), _mm512_srli_epi32(ib, 16));
+	#endif
+	}
+
+	static vec_i to_fp16(vec_ps a, vec_ps b)
+	{
+		return _mm512_inserti64x4(_mm512_castsi256_si512(_mm512_cvtps_ph(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)),
+								  _mm512_cvtps_ph(b, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC), 1);
+	}
+
+	// Rounded and saturated to [-127, 127]
+	static vec_i to_int8(vec_ps a, vec_ps b, vec_ps c, vec_ps d)
+	{
+		const vec_i low = _mm512_set1_epi32(-127);
+
+		vec_i v = _mm512_castsi128_si512(_mm512_cvtsepi32_epi8(_mm512_max_epi32(_mm512_cvtps_epi32(a), low)));
+
+		v = _mm512_inserti32x4(v, _mm512_cvtsepi32_epi8(_mm512_max_epi32(_mm512_cvtps_epi32(b), low)), 1);
+		v = _mm512_inserti32x4(v, _mm512_cvtsepi32_epi8(_mm512_max_epi32(_mm512_cvtps_epi32(c), low)), 2);
+		v = _mm512_inserti32x4(v, _mm512_cvtsepi32_epi8(_mm512_max_epi32(_mm512_cvtps_epi32(d), low)), 3);
+
+		return v;
+	}
+#else
+	typedef __m256 vec_ps;
+	typedef __m256i vec_i;
+
+	simd_xorshift128plus generator;
+
+	static vec_ps set1(float x)
+	{
+		return _mm256_set1_ps(x);
+	}
+
+	static vec_ps min(vec_ps a, vec_ps b)
+	{
+		return _mm256_min_ps(a, b);
+	}
+
+	static void store(unsigned char* p, vec_i v)
+	{
+		_mm256_storeu_si256((__m256i *)p, v);
+	}
+
+	// lo + width * u with u in [0, 1) on a grid of 2^-mantissa_bits, from each 16-bit half
+	static void uniform_pair(vec_i bits, int mantissa_bits, vec_ps lo, vec_ps width, vec_ps* a, vec_ps* b)
+	{
+		const vec_i mantissa = _mm256_set1_epi32(((1 << mantissa_bits) - 1) << (23 - mantissa_bits));
+		const vec_i one = _mm256_set1_epi32(0x3F800000);
+
+		vec_ps one_two_a = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(bits, 9), mantissa), one));
+		vec_ps one_two_b = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(bits, 7), mantissa), one));
+
+		*a = _mm256_fmadd_ps(_mm256_sub_ps(one_two_a, set1(1.0f)), width, lo);
+		*b = _mm256_fmadd_ps(_mm256_sub_ps(one_two_b, set1(1.0f)), width, lo);
+	}
+
+	// Box-Muller with the radius from the top 20 bits and the angle from the low 12 bits
+	// Normals are cut off at sqrt(2 log 2^20) ~ 5.3 standard deviations
+	static void normal_pair(vec_i bits, vec_ps mean, vec_ps stddev, vec_ps* z0, vec_ps* z1)
+	{
+		vec_ps u1 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_srli_epi32(bits, 12), _mm256_set1_epi32(1))), set1(1.0f / 1048576.0f));
+		vec_ps u2 = _mm256_fmadd_ps(_mm256_cvtepi32_ps(_mm256_and_si256(bits, _mm256_set1_epi32(0xFFF))), set1(1.0f / 4096.0f), set1(0.5f / 4096.0f));
+
+		vec_ps r = _mm256_mul_ps(_mm256_sqrt_ps(_mm256_mul_ps(set1(-2.0f), simd_distributions::log_ps(u1))), stddev);
+
+		vec_ps s, c;
+		simd_distributions::sincos_2pi_ps(u2, &s, &c);
+
+		*z0 = _mm256_fmadd_ps(r, c, mean);
+		*z1 = _mm256_fmadd_ps(r, s, mean);
+	}
+
+	static vec_i to_bf16(vec_ps a, vec_ps b)
+	{
+		// Round to nearest even on the top 16 bits, a in the high half of each lane
+		const vec_i lsb = _mm256_set1_epi32(1);
+		const vec_i half = _mm256_set1_epi32(0x7FFF);
+
+		vec_i ia = _mm256_castps_si256(a);
+		vec_i ib = _mm256_castps_si256(b);
+
+		ia = _mm256_add_epi32(ia, _mm256_add_epi32(half, _mm256_and_si256(_mm256_srli_epi32(ia, 16), lsb)));
+		ib = _mm256_add_epi32(ib, _mm256_add_epi32(half, _mm256_and_si256(_mm256_srli_epi32(ib, 16), lsb)));
+
+		return _mm256_or_si256(_mm256_and_si256(ia, _mm256_set1_epi32(0xFFFF0000)), _mm256_srli_epi32(ib, 16));
+	}
+
+#if defined(__F16C__)
+	static vec_i to_fp16(vec_ps a, vec_ps b)
+	{
+		return _mm256_set_m128i(_mm256_cvtps_ph(b, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC),
+								_mm256_cvtps_ph(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+	}
+#endif
+
+	// Rounded and saturated to [-127, 127]
+	static vec_i to_int8(vec_ps a, vec_ps b, vec_ps c, vec_ps d)
+	{
+		vec_i ab = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+		vec_i cd = _mm256_packs_epi32(_mm256_cvtps_epi32(c), _mm256_cvtps_epi32(d));
+
+		return _mm256_max_epi8(_mm256_packs_epi16(ab, cd), _mm256_set1_epi8(-127));
+	}
+#endif
+
+	// The 16-bit pattern of the next value down, bf16 and fp16 are both sign and magnitude
+	static uint16_t next_below(uint16_t h)
+	{
+		if ((h & 0x7FFF) == 0)
+			return 0x8001;
+
+		return (h & 0x8000) ? uint16_t(h + 1) : uint16_t(h - 1);
+	}
+
+	static float bf16_to_float(uint16_t h)
+	{
+		uint32_t bits = uint32_t(h) << 16;
+		float x;
+
+		std::memcpy(&x, &bits, sizeof(x));
+
+		return x;
+	}
+
+	// The largest bf16 value below hi
+	// Uniforms are clamped to it in fp32, so rounding to the format can't reach hi
+	static float bf16_below(float hi)
+	{
+		uint32_t bits;
+
+		std::memcpy(&bits, &hi, sizeof(bits));
+
+		uint16_t h = uint16_t((bits + 0x7FFF + ((bits >> 16) & 1)) >> 16);
+
+		if (bf16_to_float(h) >= hi)
+			h = next_below(h);
+
+		return bf16_to_float(h);
+	}
+
+#if defined(__AVX512F__) || defined(__F16C__)
+	// The largest fp16 value below hi
+	static float fp16_below(float hi)
+	{
+		uint16_t h = _cvtss_sh(hi, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+
+		if (_cvtsh_ss(h) >= hi)
+			h = next_below(h);
+
+		return _cvtsh_ss(h);
+	}
+#endif
+
+	// Fills n_bytes with the vectors returned by next, the last one partially
+	template <typename FN>
+	static void fill_vectors(void* out, std::size_t n_bytes, FN next)
+	{
+		unsigned char* p = (unsigned char *)out;
+
+		const std::size_t block = sizeof(vec_i);
+
+		std::size_t i = 0;
+
+		for (; i + block <= n_bytes; i += block)
+			store(p + i, next());
+
+		if (i != n_bytes)
+		{
+			unsigned char buffer[sizeof(vec_i)];
+
+			store(buffer, next());
+
+			std::memcpy(p + i, buffer, n_bytes - i);
+		}
+	}
+
+public:
+	low_precision() {}
+
+	// Uniform in [lo, hi), 2^7 values per unit interval before scaling
+	// Values that would round up to hi give the largest bf16 below it instead
+	void uniform_bf16(uint16_t* out, uint32_t N, float lo, float hi, key_type& key)
+	{
+		const vec_ps base = set1(lo);
+		const vec_ps width = set1(hi - lo);
+		const vec_ps top = set1(bf16_below(hi));
+
+		fill_vectors(out, std::size_t(N) * sizeof(uint16_t), [&]()
+		{
+			vec_ps a, b;
+			uniform_pair(generator.get_rand(key), bf16_bits, base, width, &a, &b);
+
+			return to_bf16(min(a, top), min(b, top));
+		});
+	}
+
+	void normal_bf16(uint16_t* out, uint32_t N, float mean, float stddev, key_type& key)
+	{
+		const vec_ps m = set1(mean);
+		const vec_ps sd = set1(stddev);
+
+		fill_vectors(out, std::size_t(N) * sizeof(uint16_t), [&]()
+		{
+			vec_ps z0, z1;
+			normal_pair(generator.get_rand(key), m, sd, &z0, &z1);
+
+			return to_bf16(z0, z1);
+		});
+	}
+
+#if defined(__AVX512F__) || defined(__F16C__)
+	// Uniform in [lo, hi), 2^10 values per unit interval before scaling
+	// Values that would round up to hi give the largest fp16 below it instead
+	void uniform_fp16(uint16_t* out, uint32_t N, float lo, float hi, key_type& key)
+	{
+		const vec_ps base = set1(lo);
+		const vec_ps width = set1(hi - lo);
+		const vec_ps top = set1(fp16_below(hi));
+
+		fill_vectors(out, std::size_t(N) * sizeof(uint16_t), [&]()
+		{
+			vec_ps a, b;
+			uniform_pair(generator.get_rand(key), fp16_bits, base, width, &a, &b);
+
+			return to_fp16(min(a, top), min(b, top));
+		});
+	}
+
+	void normal_fp16(uint16_t* out, uint32_t N, float mean, float stddev, key_type& key)
+	{
+		const vec_ps m = set1(mean);
+		const vec_ps sd = set1(stddev);
+
+		fill_vectors(out, std::size_t(N) * sizeof(uint16_t), [&]()
+		{
+			vec_ps z0, z1;
+			normal_pair(generator.get_rand(key), m, sd, &z0, &z1);
+
+			return to_fp16(z0, z1);
+		});
+	}
+#endif
+
+	// Normal with the given standard deviation in units of the quantization step,
+	// rounded and saturated to [-127, 127]
+	void normal_int8(int8_t* out, uint32_t N, float stddev, key_type& key)
+	{
+		const vec_ps zero = set1(0.0f);
+		const vec_ps sd = set1(stddev);
+
+		fill_vectors(out, N, [&]()
+		{
+			vec_ps z0, z1, z2, z3;
+			normal_pair(generator.get_rand(key), zero, sd, &z0, &z1);
+			normal_pair(generator.get_rand(key), zero, sd, &z2, &z3);
+
+			return to_int8(z0, z1, z2, z3);
+		});
+	}
+};
+
+#endif
@@ -0,0 +1,346 @@
+#ifndef NUMAPARALLEL_H
+#define NUMAPARALLEL_H
+
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <new>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "simd_xorshift128plus.hpp"
+#include "rng_pool.hpp"
+
+// The NUMA nodes this process may run on, read from sysfs
+// Without NUMA information every allowed CPU is put in one node with id -1
+class numa_topology
+{
+public:
+	struct node
+	{
+		int id;
+		std::vector<int> cpus;
+	};
+
+	std::vector<node> nodes;
+
+	numa_topology()
+	{
+		cpu_set_t allowed;
+		CPU_ZERO(&allowed);
+
+		if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+			for (int c = 0; c < int(std::max(1u, std::thread::hardware_concurrency())); c++)
+				CPU_SET(c, &allowed);
+
+		for (int id : parse_list(read_file("/sys/devices/system/node/online")))
+		{
+			node n{id, {}};
+
+			for (int c : parse_list(read_file("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist")))
+				if (c < CPU_SETSIZE && CPU_ISSET(c, &allowed))
+					n.cpus.push_back(c);
+
+			if (!n.cpus.empty())
+				nodes.push_back(n);
+		}
+
+		if (nodes.empty())
+		{
+			node n{-1, {}};
+
+			for (int c = 0; c < CPU_SETSIZE; c++)
+				if (CPU_ISSET(c, &allowed))
+					n.cpus.push_back(c);
+
+			nodes.push_back(n);
+		}
+	}
+
+	// Lists like "0-3,8-11"
+	static std::vector<int> parse_list(const std::string& list)
+	{
+		std::vector<int> values;
+		std::stringstream ss(list);
+		std::string range;
+
+		while (std::getline(ss, range, ','))
+		{
+			int first, last;
+
+			if (std::sscanf(range.c_str(), "%d-%d", &first, &last) == 2)
+				for (int v = first; v <= last; v++)
+					values.push_back(v);
+			else if (std::sscanf(range.c_str(), "%d", &first) == 1)
+				values.push_back(first);
+		}
+
+		return values;
+	}
+
+	static std::string read_file(const std::string& path)
+	{
+		std::ifstream in(path);
+		std::string line;
+
+		std::getline(in, line);
+
+		return line;
+	}
+
+	static const numa_topology& system()
+	{
+		static const numa_topology topology;
+
+		return topology;
+	}
+};
+
+
+// Where numa_parallel puts the pages of a buffer
+// local binds each worker's region to the worker's node, interleaved spreads pages over all nodes
+enum class numa_placement { local, interleaved };
+
+
+// Parallel fill and batch shuffle with workers pinned per NUMA node
+// Each worker's region is placed on its node before it is touched and each key is created after
+// pinning in a page on the worker's node. Placement uses the raw mbind system call, if it fails
+// (no NUMA kernel, or not allowed) pinned first touch still puts the pages on the right node.
+// Linux only
+class numa_parallel
+{
+protected:
+	// From linux/mempolicy.h
+	static constexpr int mpol_preferred = 1;
+	static constexpr int mpol_interleave = 3;
+	static constexpr unsigned mpol_mf_move = 1 << 1;
+
+	static constexpr std::size_t page_size = 4096;
+
+	static long mbind_nodes(void* addr, std::size_t len, int mode, const std::vector<int>& node_ids, unsigned flags)
+	{
+		unsigned long mask[16] = {0};
+
+		for (int id : node_ids)
+			if (id >= 0 && id < int(sizeof(mask) * 8))
+				mask[id / 64] |= 1ul << (id % 64);
+
+		return syscall(SYS_mbind, addr, len, mode, mask, sizeof(mask) * 8, flags);
+	}
+
+	// [addr, addr + len) widened to whole pages
+	static void place(void* addr, std::size_t len, int mode, const std::vector<int>& node_ids)
+	{
+		if (len == 0 || node_ids.empty() || node_ids[0] < 0)
+			return;
+
+		uintptr_t first = uintptr_t(addr) & ~uintptr_t(page_size - 1);
+		uintptr_t last = (uintptr_t(addr) + len + page_size - 1) & ~uintptr_t(page_size - 1);
+
+		// Pages already touched are moved where the kernel allows it
+		mbind_nodes((void *)first, last - first, mode, node_ids, mpol_mf_move);
+	}
+
+	static void pin_to(const numa_topology::node& n)
+	{
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+
+		for (int c : n.cpus)
+			CPU_SET(c, &cpus);
+
+		pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	}
+
+	// A share [first, last) of the items for one pinned thread on node n
+	struct worker
+	{
+		const numa_topology::node* n;
+		std::size_t first, last;
+	};
+
+	// One worker per CPU of each node (at most threads_per_node if it isn't 0), shares of [0, n_items)
+	// proportional to the workers on each node. A node's workers are consecutive
+	static std::vector<worker> split_work(std::size_t n_items, unsigned threads_per_node)
+	{
+		const numa_topology& topology = numa_topology::system();
+
+		std::vector<worker> workers;
+
+		for (auto& n : topology.nodes)
+		{
+			const std::size_t count = threads_per_node ? std::min<std::size_t>(threads_per_node, n.cpus.size()) : n.cpus.size();
+
+			for (std::size_t w = 0; w < count; w++)
+				workers.push_back(worker{&n, 0, 0});
+		}
+
+		for (std::size_t w = 0; w < workers.size(); w++)
+		{
+			workers[w].first = n_items * w / workers.size();
+			workers[w].last = n_items * (w + 1) / workers.size();
+		}
+
+		return workers;
+	}
+
+	// Places the pages of each worker's region of base
+	static void place_regions(void* base, std::size_t item_bytes, numa_placement placement, const std::vector<worker>& workers)
+	{
+		char* bytes = (char *)base;
+
+		if (placement == numa_placement::interleaved)
+		{
+			std::vector<int> all_ids;
+
+			for (auto& n : numa_topology::system().nodes)
+				all_ids.push_back(n.id);
+
+			place(bytes, workers.back().last * item_bytes, mpol_interleave, all_ids);
+		}
+		else
+		{
+			// One call per node
+			for (std::size_t w = 0; w < workers.size(); )
+			{
+				std::size_t end = w;
+
+				while (end < workers.size() && workers[end].n == workers[w].n)
+					end++;
+
+				place(bytes + workers[w].first * item_bytes, (workers[end - 1].last - workers[w].first) * item_bytes,
+					  mpol_preferred, std::vector<int>{workers[w].n->id});
+
+				w = end;
+			}
+		}
+	}
+
+	// Runs fn(w, index) for each worker w on its own thread, pinned to its node
+	template <typename FN>
+	static void run_workers(const std::vector<worker>& workers, FN fn)
+	{
+		std::vector<std::thread> threads;
+
+		for (std::size_t index = 0; index < workers.size(); index++)
+		{
+			threads.emplace_back([&workers, index, fn]()
+			{
+				pin_to(*workers[index].n);
+
+				fn(workers[index], index);
+			});
+		}
+
+		for (auto& thread : threads)
+			thread.join();
+	}
+
+	// Runs fn(key, first, last) on the workers' shares of [0, n_items), after placing their regions of base
+	template <typename FN>
+	static void run_on_nodes(void* base, std::size_t n_items, std::size_t item_bytes, numa_placement placement,
+							 unsigned threads_per_node, rng_pool& pool, FN fn)
+	{
+		const std::vector<worker> workers = split_work(n_items, threads_per_node);
+
+		place_regions(base, item_bytes, placement, workers);
+
+		// Substreams are claimed here so they don't depend on thread start order
+		std::vector<uint64_t> substreams;
+
+		for (std::size_t w = 0; w < workers.size(); w++)
+			substreams.push_back(pool.claim_substream());
+
+		run_workers(workers, [&pool, &substreams, fn](const worker& w, std::size_t index)
+		{
+			// The key lives in its own page, placed on this node and first touched here
+			// Without a page, the key goes on this thread's stack, which it first-touches too
+			void* page = allocate(page_size);
+
+			if (page == nullptr)
+			{
+				simd_xorshift128plus_key key = pool.xorshift_key(substreams[index]);
+
+				return fn(key, w.first, w.last);
+			}
+
+			place(page, page_size, mpol_preferred, std::vector<int>{w.n->id});
+
+			simd_xorshift128plus_key* key = new (page) simd_xorshift128plus_key(pool.xorshift_key(substreams[index]));
+
+			fn(*key, w.first, w.last);
+
+			key->~simd_xorshift128plus_key();
+
+			deallocate(page, page_size);
+		});
+	}
+
+public:
+	// Pages from mmap, none is touched until a worker writes to it
+	// Use these rather than std::vector so the main thread doesn't first-touch the whole buffer
+	static void* allocate(std::size_t bytes)
+	{
+		void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		return p == MAP_FAILED ? nullptr : p;
+	}
+
+	static void deallocate(void* p, std::size_t bytes)
+	{
+		if (p != nullptr)
+			munmap(p, bytes);
+	}
+
+	// fill_array over n numbers, each worker filling its own region
+	static void fill_array(uint32_t* rand_arr, std::size_t n, numa_placement placement = numa_placement::local,
+						   unsigned threads_per_node = 0, rng_pool& pool = rng_pool::global())
+	{
+		run_on_nodes(rand_arr, n, sizeof(uint32_t), placement, threads_per_node, pool,
+					 [rand_arr](simd_xorshift128plus_key& key, std::size_t first, std::size_t last)
+		{
+			simd_xorshift128plus generator;
+
+			const std::size_t chunk = std::size_t(1) << 30;
+
+			for (std::size_t i = first; i < last; i += chunk)
+				generator.fill_array(rand_arr + i, uint32_t(std::min(chunk, last - i)), key);
+		});
+	}
+
+	// shuffle_batch over n_arrays arrays of K elements, whole arrays per worker
+	// Pages of an existing buffer are moved to the workers' nodes where the kernel allows it
+	static void shuffle_batch(uint32_t* arrays, std::size_t n_arrays, uint32_t K, numa_placement placement = numa_placement::local,
+							  unsigned threads_per_node = 0, rng_pool& pool = rng_pool::global())
+	{
+		run_on_nodes(arrays, n_arrays, std::size_t(K) * sizeof(uint32_t), placement, threads_per_node, pool,
+					 [arrays, K](simd_xorshift128plus_key& key, std::size_t first, std::size_t last)
+		{
+			simd_xorshift128plus generator;
+
+			const std::size_t chunk = std::size_t(1) << 30;
+
+			for (std::size_t i = first; i < last; i += chunk)
+				generator.shuffle_batch(arrays + i * K, uint32_t(std::min(chunk, last - i)), K, key);
+		});
+	}
+
+	// Runs fn(first, last) on the same regions as fill_array and shuffle_batch, from the same
+	// pinned workers, without moving any pages. For consumers of the results
+	template <typename FN>
+	static void for_each_region(std::size_t n_items, unsigned threads_per_node, FN fn)
+	{
+		run_workers(split_work(n_items, threads_per_node), [fn](const worker& w, std::size_t) { fn(w.first, w.last); });
+	}
+};
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef PREFILLRING_H
+#define PREFILLRING_H
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+#include "simd_intrinsics.hpp"
+#include "simd_xorshift128plus.hpp"
+#include "rng_pool.hpp"
+
+// A single producer, single consumer ring of pre-generated random blocks
+// A background thread runs the interleaved fill kernel into free blocks
+// and the consumer takes ready blocks without ever generating inline.
+// Use one ring per consumer thread, each ring has its own producer
+class prefill_ring
+{
+public:
+	// 4 KiB of random numbers per block
+	static constexpr std::size_t block_words = 1024;
+
+protected:
+	struct alignas(64) block
+	{
+		uint32_t data[block_words];
+	};
+
+	std::unique_ptr<block[]> blocks;
+
+	// Number of blocks, a power of two
+	const std::size_t n_blocks;
+	const std::size_t mask;
+
+	// Blocks published by the producer, only the producer writes this
+	alignas(64) std::atomic<uint64_t> head{0};
+
+	// Blocks released by the consumer, only the consumer writes this
+	alignas(64) std::atomic<uint64_t> tail{0};
+
+	// Consumer side state, kept on its own cache line
+	alignas(64) uint64_t consumer_tail = 0;
+	uint64_t cached_head = 0;
+	const uint32_t* current = nullptr;
+	std::size_t current_pos = block_words;
+
+	alignas(64) std::atomic<bool> running{true};
+
+	std::thread producer;
+
+	// A producer facing a full ring yields this many times, then sleeps between checks so an
+	// idle consumer doesn't cost a core. Sleeps are short next to draining a full ring
+	static constexpr unsigned full_yields = 64;
+	static constexpr std::chrono::microseconds full_sleep{50};
+
+	static std::size_t round_up_pow2(std::size_t n)
+	{
+		std::size_t p = 2;
+
+		while(p < n)
+			p <<= 1;
+
+		return p;
+	}
+
+	void producer_loop()
+	{
+		simd_xorshift128plus generator;
+
+		// Two substreams so the fill kernel can interleave them
+		simd_xorshift128plus_key key1 = rng_pool::global().make_xorshift_key();
+		simd_xorshift128plus_key key2 = rng_pool::global().make_xorshift_key();
+
+		uint64_t producer_head = 0;
+		uint64_t cached_tail = 0;
+
+		unsigned full_waits = 0;
+
+		while(running.load(std::memory_order_relaxed))
+		{
+			// Only reload the consumer's position when the ring looks full
+			if(producer_head - cached_tail == n_blocks)
+			{
+				cached_tail = tail.load(std::memory_order_acquire);
+
+				if(producer_head - cached_tail == n_blocks)
+				{
+					if(++full_waits < full_yields)
+						std::this_thread::yield();
+					else
+						std::this_thread::sleep_for(full_sleep);
+
+					continue;
+				}
+			}
+
+			full_waits = 0;
+
+			generator.fill_array_two(blocks[producer_head & mask].data, block_words, key1, key2);
+
+			head.store(++producer_head, std::memory_order_release);
+		}
+	}
+
+public:
+	prefill_ring(std::size_t ring_blocks = 64) : blocks(new block[round_up_pow2(ring_blocks)]),
+												 n_blocks(round_up_pow2(ring_blocks)), mask(round_up_pow2(ring_blocks) - 1)
+	{
+		producer = std::thread(&prefill_ring::producer_loop, this);
+	}
+
+	~prefill_ring()
+	{
+		running.store(false, std::memory_order_relaxed);
+		producer.join();
+	}
+
+	prefill_ring(const prefill_ring&) = delete;
+	prefill_ring& operator=(const prefill_ring&) = delete;
+
+	// Returns the next ready block or nullptr if the producer is behind
+	// The block stays valid until release() is called
+	const uint32_t* try_acquire()
+	{
+		if(consumer_tail == cached_head)
+		{
+			cached_head = head.load(std::memory_order_acquire);
+
+			if(consumer_tail == cached_head)
+				return nullptr;
+		}
+
+		return blocks[consumer_tail & mask].data;
+	}
+
+	// Waits for a block if none are ready
+	const uint32_t* acquire()
+	{
+		const uint32_t* ready;
+
+		while((ready = try_acquire()) == nullptr)
+			std::this_thread::yield();
+
+		return ready;
+	}
+
+	// Hands the oldest acquired block back to the producer
+	void release()
+	{
+		tail.store(++consumer_tail, std::memory_order_release);
+	}
+
+	// Copy N_rands random numbers out of the ring, moving on to new blocks as needed
+	// Don't mix take() and next() with acquire() and release() on the same ring
+	void take(uint32_t* rand_arr, std::size_t N_rands)
+	{
+		while(N_rands != 0)
+		{
+			if(current_pos == block_words)
+			{
+				if(current != nullptr)
+					release();
+
+				current = acquire();
+				current_pos = 0;
+			}
+
+			std::size_t n = std::min(N_rands, block_words - current_pos);
+
+			std::memcpy(rand_arr, current + current_pos, n * sizeof(uint32_t));
+
+			current_pos += n;
+			rand_arr += n;
+			N_rands -= n;
+		}
+	}
+
+	uint32_t next()
+	{
+		if(current_pos == block_words)
+		{
+			if(current != nullptr)
+				release();
+
+			current = acquire();
+			current_pos = 0;
+		}
+
+		return current[current_pos++];
+	}
+};
+
+#endif
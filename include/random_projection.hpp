@@ -0,0 +1,379 @@
+#ifndef RANDOMPROJECTION_H
+#define RANDOMPROJECTION_H
+
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#include "simd_intrinsics.hpp"
+#include "simd_xorshift128plus.hpp"
+#include "simd_distributions.hpp"
+#include "rng_pool.hpp"
+
+#if defined(__AVX512F__)
+	#include "simd_avx512_xorshift128plus.hpp"
+	#include "simd_avx512_distributions.hpp"
+#endif
+
+// Random projection matrices for sketching, written row-major as float or int8_t
+// Rademacher entries are +-scale from one random bit each. Sparse ternary entries are
+// nonzero with probability 1 / 2^k, costing k bits for the nonzero test and one for the sign,
+// so k = 1 is two bits per entry. Set bits give the negative value. Bits are expanded
+// straight into lanes: with AVX-512 the bits are the blend masks, with AVX2 each bit is
+// shifted into the lane's sign bit or spread over a byte with a shuffle and compare
+class random_projection
+{
+public:
+#if defined(__AVX512F__)
+	typedef simd_avx512_xorshift128plus_key key_type;
+#else
+	typedef simd_xorshift128plus_key key_type;
+#endif
+
+protected:
+#if defined(__AVX512F__)
+	simd_avx512_xorshift128plus generator;
+	simd_avx512_distributions dist;
+
+	static key_type make_key(rng_pool& pool)
+	{
+		return pool.make_avx512_xorshift_key();
+	}
+
+	// 512 entries per sign vector, 16 floats per 16 bits of mask
+	template <bool sparse>
+	void sign_entries(float* out, std::size_t n, float scale, unsigned k, key_type& key)
+	{
+		const __m512 pos = _mm512_set1_ps(scale);
+		const __m512 neg = _mm512_set1_ps(-scale);
+
+		alignas(64) uint16_t sign_bits[32];
+		alignas(64) uint16_t nonzero_bits[32];
+
+		std::size_t i = 0;
+
+		while (i < n)
+		{
+			_mm512_store_si512((__m512i *)sign_bits, generator.get_rand(key));
+
+			if (sparse)
+			{
+				__m512i nonzero = generator.get_rand(key);
+
+				for (unsigned j = 1; j < k; j++)
+					nonzero = _mm512_and_si512(nonzero, generator.get_rand(key));
+
+				_mm512_store_si512((__m512i *)nonzero_bits, nonzero);
+			}
+
+			for (int w = 0; w < 32 && i < n; w++, i += 16)
+			{
+				__m512 v = _mm512_mask_blend_ps(sign_bits[w], pos, neg);
+
+				if (sparse)
+					v = _mm512_maskz_mov_ps(nonzero_bits[w], v);
+
+				if (i + 16 <= n)
+					_mm512_storeu_ps(out + i, v);
+				else
+					_mm512_mask_storeu_ps(out + i, (__mmask16)((1u << (n - i)) - 1), v);
+			}
+		}
+	}
+
+	// 512 entries per sign vector, 64 bytes per 64 bits of mask
+	template <bool sparse>
+	void sign_entries(int8_t* out, std::size_t n, unsigned k, key_type& key)
+	{
+		alignas(64) uint64_t sign_bits[8];
+		alignas(64) uint64_t nonzero_bits[8];
+
+		std::size_t i = 0;
+
+		while (i < n)
+		{
+			_mm512_store_si512((__m512i *)sign_bits, generator.get_rand(key));
+
+			if (sparse)
+			{
+				__m512i nonzero = generator.get_rand(key);
+
+				for (unsigned j = 1; j < k; j++)
+					nonzero = _mm512_and_si512(nonzero, generator.get_rand(key));
+
+				_mm512_store_si512((__m512i *)nonzero_bits, nonzero);
+			}
+
+			for (int w = 0; w < 8 && i < n; w++, i += 64)
+			{
+				const __mmask64 nonzero = sparse ? (__mmask64)nonzero_bits[w] : ~(__mmask64)0;
+				const __mmask64 tail = i + 64 <= n ? ~(__mmask64)0 : ((__mmask64)1 << (n - i)) - 1;
+
+			#if defined(__AVX512BW__)
+				__m512i v = _mm512_maskz_mov_epi8(nonzero, _mm512_mask_blend_epi8((__mmask64)sign_bits[w], _mm512_set1_epi8(1), _mm512_set1_epi8(-1)));
+
+				_mm512_mask_storeu_epi8(out + i, tail, v);
+			#else
+				for (int b = 0; b < 64 && i + b < n; b++)
+					out[i + b] = (nonzero >> b & 1) ? ((sign_bits[w] >> b & 1) ? -1 : 1) : 0;
+
+				(void)tail;
+			#endif
+			}
+		}
+	}
+
+	void normal_entries(float* out, uint32_t n, float stddev, key_type& key)
+	{
+		dist.normal_array(out, n, 0.0f, stddev, key);
+	}
+#else
+	simd_xorshift128plus generator;
+	simd_distributions dist;
+
+	static key_type make_key(rng_pool& pool)
+	{
+		return pool.make_xorshift_key();
+	}
+
+	// 256 entries per sign vector, 8 floats per byte of bits
+	// Each lane shifts its own bit of the byte up to bit 31
+	template <bool sparse>
+	void sign_entries(float* out, std::size_t n, float scale, unsigned k, key_type& key)
+	{
+		const __m256i shifts = _mm256_setr_epi32(31, 30, 29, 28, 27, 26, 25, 24);
+		const __m256i sign_bit = _mm256_set1_epi32(0x80000000);
+		const __m256 value = _mm256_set1_ps(scale);
+
+		alignas(32) uint8_t sign_bytes[32];
+		alignas(32) uint8_t nonzero_bytes[32];
+
+		std::size_t i = 0;
+
+		while (i < n)
+		{
+			_mm256_store_si256((__m256i *)sign_bytes, generator.get_rand(key));
+
+			if (sparse)
+			{
+				__m256i nonzero = generator.get_rand(key);
+
+				for (unsigned j = 1; j < k; j++)
+					nonzero = _mm256_and_si256(nonzero, generator.get_rand(key));
+
+				_mm256_store_si256((__m256i *)nonzero_bytes, nonzero);
+			}
+
+			for (int b = 0; b < 32 && i < n; b++, i += 8)
+			{
+				__m256i sign = _mm256_and_si256(_mm256_sllv_epi32(_mm256_set1_epi32(sign_bytes[b]), shifts), sign_bit);
+
+				__m256 v = _mm256_xor_ps(value, _mm256_castsi256_ps(sign));
+
+				if (sparse)
+				{
+					__m256i nonzero = _mm256_srai_epi32(_mm256_sllv_epi32(_mm256_set1_epi32(nonzero_bytes[b]), shifts), 31);
+
+					v = _mm256_and_ps(v, _mm256_castsi256_ps(nonzero));
+				}
+
+				if (i + 8 <= n)
+					_mm256_storeu_ps(out + i, v);
+				else
+					_mm256_maskstore_ps(out + i, _mm256_cmpgt_epi32(_mm256_set1_epi32(int(n - i)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)), v);
+			}
+		}
+	}
+
+	// Spreads the 32 bits of a word over 32 bytes, 0xFF where the bit is set
+	static __m256i expand_bits_epi8(uint32_t word)
+	{
+		// Bytes 0 and 1 of the word feed the low 128 bits, bytes 2 and 3 the high 128 bits
+		const __m256i byte_select = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+													 2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+		const __m256i bit_select = _mm256_set1_epi64x(0x8040201008040201);
+
+		__m256i bytes = _mm256_shuffle_epi8(_mm256_set1_epi32(word), byte_select);
+
+		return _mm256_cmpeq_epi8(_mm256_and_si256(bytes, bit_select), bit_select);
+	}
+
+	// 256 entries per sign vector, 32 bytes per 32 bits
+	template <bool sparse>
+	void sign_entries(int8_t* out, std::size_t n, unsigned k, key_type& key)
+	{
+		const __m256i one = _mm256_set1_epi8(1);
+
+		alignas(32) uint32_t sign_words[8];
+		alignas(32) uint32_t nonzero_words[8];
+
+		std::size_t i = 0;
+
+		while (i < n)
+		{
+			_mm256_store_si256((__m256i *)sign_words, generator.get_rand(key));
+
+			if (sparse)
+			{
+				__m256i nonzero = generator.get_rand(key);
+
+				for (unsigned j = 1; j < k; j++)
+					nonzero = _mm256_and_si256(nonzero, generator.get_rand(key));
+
+				_mm256_store_si256((__m256i *)nonzero_words, nonzero);
+			}
+
+			for (int w = 0; w < 8 && i < n; w++, i += 32)
+			{
+				// 0xFF | 1 is -1 and 0 | 1 is +1
+				__m256i v = _mm256_or_si256(expand_bits_epi8(sign_words[w]), one);
+
+				if (sparse)
+					v = _mm256_and_si256(v, expand_bits_epi8(nonzero_words[w]));
+
+				if (i + 32 <= n)
+					_mm256_storeu_si256((__m256i *)(out + i), v);
+				else
+				{
+					int8_t buffer[32];
+
+					_mm256_storeu_si256((__m256i *)buffer, v);
+
+					std::memcpy(out + i, buffer, n - i);
+				}
+			}
+		}
+	}
+
+	void normal_entries(float* out, uint32_t n, float stddev, key_type& key)
+	{
+		dist.normal_array(out, n, 0.0f, stddev, key);
+	}
+#endif
+
+	// Splits the rows into tiles that the threads take in turn, each thread with its own substream
+	template <typename FN>
+	static void for_row_tiles(std::size_t rows, std::size_t cols, unsigned n_threads, rng_pool& pool, FN fn)
+	{
+		// About 1 MiB of floats per tile
+		const std::size_t tile_rows = std::max<std::size_t>(1, (std::size_t(1) << 18) / std::max<std::size_t>(1, cols));
+
+		const std::size_t n_tiles = (rows + tile_rows - 1) / tile_rows;
+
+		std::atomic<std::size_t> next_tile{0};
+
+		auto worker = [&](key_type key)
+		{
+			random_projection local;
+
+			for (std::size_t t; (t = next_tile.fetch_add(1, std::memory_order_relaxed)) < n_tiles; )
+			{
+				const std::size_t first = t * tile_rows;
+				const std::size_t last = std::min(rows, first + tile_rows);
+
+				fn(local, key, first * cols, (last - first) * cols);
+			}
+		};
+
+		n_threads = unsigned(std::max<std::size_t>(1, std::min<std::size_t>(n_threads, n_tiles)));
+
+		std::vector<std::thread> threads;
+
+		for (unsigned t = 1; t < n_threads; t++)
+			threads.emplace_back(worker, make_key(pool));
+
+		worker(make_key(pool));
+
+		for (auto& thread : threads)
+			thread.join();
+	}
+
+public:
+	random_projection() {}
+
+	// n entries of +-scale, one random bit each
+	void rademacher(float* out, std::size_t n, float scale, key_type& key)
+	{
+		sign_entries<false>(out, n, scale, 0, key);
+	}
+
+	// n entries of +-1
+	void rademacher(int8_t* out, std::size_t n, key_type& key)
+	{
+		sign_entries<false>(out, n, 0, key);
+	}
+
+	// n entries of +-scale with probability 1 / 2^(k + 1) each and 0 otherwise, k + 1 random bits each
+	// With scale sqrt(2^k) this is the sparse projection of Li, Hastie and Church (2006) with s = 2^k,
+	// the s = 3 of Achlioptas (2003) can't be drawn from whole bits so s = 2 or 4 stands in for it
+	void sparse_ternary(float* out, std::size_t n, unsigned k, float scale, key_type& key)
+	{
+		if (k == 0)
+			return rademacher(out, n, scale, key);
+
+		sign_entries<true>(out, n, scale, k, key);
+	}
+
+	void sparse_ternary(int8_t* out, std::size_t n, unsigned k, key_type& key)
+	{
+		if (k == 0)
+			return rademacher(out, n, key);
+
+		sign_entries<true>(out, n, k, key);
+	}
+
+	// n normal entries with mean 0
+	void gaussian(float* out, std::size_t n, float stddev, key_type& key)
+	{
+		const std::size_t chunk = std::size_t(1) << 20;
+
+		for (std::size_t i = 0; i < n; i += chunk)
+			normal_entries(out + i, uint32_t(std::min(chunk, n - i)), stddev, key);
+	}
+
+	// rows x cols row-major matrices split over threads, for matrices too big for one core
+	static void rademacher_parallel(float* out, std::size_t rows, std::size_t cols, float scale, unsigned n_threads, rng_pool& pool = rng_pool::global())
+	{
+		for_row_tiles(rows, cols, n_threads, pool, [out, scale](random_projection& local, key_type& key, std::size_t first, std::size_t n)
+		{
+			local.rademacher(out + first, n, scale, key);
+		});
+	}
+
+	static void rademacher_parallel(int8_t* out, std::size_t rows, std::size_t cols, unsigned n_threads, rng_pool& pool = rng_pool::global())
+	{
+		for_row_tiles(rows, cols, n_threads, pool, [out](random_projection& local, key_type& key, std::size_t first, std::size_t n)
+		{
+			local.rademacher(out + first, n, key);
+		});
+	}
+
+	static void sparse_ternary_parallel(float* out, std::size_t rows, std::size_t cols, unsigned k, float scale, unsigned n_threads, rng_pool& pool = rng_pool::global())
+	{
+		for_row_tiles(rows, cols, n_threads, pool, [out, k, scale](random_projection& local, key_type& key, std::size_t first, std::size_t n)
+		{
+			local.sparse_ternary(out + first, n, k, scale, key);
+		});
+	}
+
+	static void sparse_ternary_parallel(int8_t* out, std::size_t rows, std::size_t cols, unsigned k, unsigned n_threads, rng_pool& pool = rng_pool::global())
+	{
+		for_row_tiles(rows, cols, n_threads, pool, [out, k](random_projection& local, key_type& key, std::size_t first, std::size_t n)
+		{
+			local.sparse_ternary(out + first, n, k, key);
+		});
+	}
+
+	static void gaussian_parallel(float* out, std::size_t rows, std::size_t cols, float stddev, unsigned n_threads, rng_pool& pool = rng_pool::global())
+	{
+		for_row_tiles(rows, cols, n_threads, pool, [out, stddev](random_projection& local, key_type& key, std::size_t first, std::size_t n)
+		{
+			local.gaussian(out + first, n, stddev, key);
+		});
+	}
+};
+
+#endif
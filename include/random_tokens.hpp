@@ -0,0 +1,343 @@
+#ifndef RANDOMTOKENS_H
+#define RANDOMTOKENS_H
+
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+
+#include "simd_intrinsics.hpp"
+#include "aes_dragontamer.hpp"
+
+// An alphabet of 1 to 64 characters for random_tokens
+// Characters are looked up with _mm256_shuffle_epi8 from four tables of 16
+class token_alphabet
+{
+public:
+	// Throws std::invalid_argument for an empty alphabet, which no character can be drawn from,
+	// or one of more than 64 characters, which the tables can't hold
+	explicit token_alphabet(const std::string& chars)
+	{
+		if (chars.empty() || chars.size() > 64)
+			throw std::invalid_argument("token_alphabet needs 1 to 64 characters");
+
+		size = uint32_t(chars.size());
+
+		bits = 0;
+
+		while ((1u << bits) < size)
+			bits++;
+
+		alignas(16) char table[64] = {0};
+
+		std::memcpy(table, chars.data(), size);
+
+		for (int t = 0; t < 4; t++)
+			tables[t] = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)(table + 16 * t)));
+	}
+
+	static token_alphabet hex()
+	{
+		return token_alphabet("0123456789abcdef");
+	}
+
+	static token_alphabet digits()
+	{
+		return token_alphabet("0123456789");
+	}
+
+	static token_alphabet alphanumeric()
+	{
+		return token_alphabet("0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz");
+	}
+
+	static token_alphabet base64url()
+	{
+		return token_alphabet("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_");
+	}
+
+	// The characters for 32 indices below 64
+	// Bits 4 and 5 of each index pick the table, moved up to bit 7 for the byte blends
+	inline __m256i lookup(__m256i idx) const
+	{
+		__m256i low = _mm256_blendv_epi8(_mm256_shuffle_epi8(tables[0], idx), _mm256_shuffle_epi8(tables[1], idx), _mm256_slli_epi16(idx, 3));
+		__m256i high = _mm256_blendv_epi8(_mm256_shuffle_epi8(tables[2], idx), _mm256_shuffle_epi8(tables[3], idx), _mm256_slli_epi16(idx, 3));
+
+		return _mm256_blendv_epi8(low, high, _mm256_slli_epi16(idx, 2));
+	}
+
+	__m256i tables[4];
+
+	uint32_t size;
+
+	// Random bits per character, indices of size or more are rejected
+	uint32_t bits;
+};
+
+
+// Batched random strings over an alphabet and UUIDv4s on the AES generator
+// Records are fixed width and stride apart in one buffer, nothing is written between them.
+// The AES generator is fast rather than cryptographically secure, don't use it for secrets
+class random_tokens
+{
+protected:
+	aes_dragontamer generator;
+
+	// Characters kept between records of strings()
+	static constexpr std::size_t pool_size = 256;
+
+#if !(defined(__AVX512VBMI2__) && defined(__AVX512VL__) && defined(__AVX512BW__))
+	// Shuffles that move the set bytes of an 8-byte group to its front, one per movemask byte
+	struct compaction_table
+	{
+		alignas(8) uint8_t shuffles[256][8];
+
+		compaction_table()
+		{
+			for (int mask = 0; mask < 256; mask++)
+			{
+				int n = 0;
+
+				for (int b = 0; b < 8; b++)
+					if (mask >> b & 1)
+						shuffles[mask][n++] = uint8_t(b);
+
+				while (n < 8)
+					shuffles[mask][n++] = 0x80;
+			}
+		}
+	};
+
+	static const compaction_table& compaction()
+	{
+		static const compaction_table table;
+
+		return table;
+	}
+#endif
+
+	// Writes the characters for 32 indices to out, dropping those past the alphabet
+	// out needs room for 32 characters, returns the number written
+	static std::size_t emit(char* out, __m256i idx, const token_alphabet& alphabet)
+	{
+		__m256i chars = alphabet.lookup(idx);
+
+		if (alphabet.size == (1u << alphabet.bits))
+		{
+			_mm256_storeu_si256((__m256i *)out, chars);
+
+			return 32;
+		}
+
+	#if defined(__AVX512VBMI2__) && defined(__AVX512VL__) && defined(__AVX512BW__)
+		const __mmask32 valid = _mm256_cmpgt_epi8_mask(_mm256_set1_epi8(char(alphabet.size)), idx);
+
+		_mm256_storeu_si256((__m256i *)out, _mm256_maskz_compress_epi8(valid, chars));
+
+		return __builtin_popcount(valid);
+	#else
+		const uint32_t valid = _mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_set1_epi8(char(alphabet.size)), idx));
+
+		alignas(32) char bytes[32];
+
+		_mm256_store_si256((__m256i *)bytes, chars);
+
+		std::size_t n = 0;
+
+		for (int g = 0; g < 4; g++)
+		{
+			const uint32_t group = (valid >> (8 * g)) & 0xFF;
+
+			__m128i shuffle = _mm_loadl_epi64((const __m128i *)compaction().shuffles[group]);
+
+			_mm_storel_epi64((__m128i *)(out + n), _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i *)(bytes + 8 * g)), shuffle));
+
+			n += __builtin_popcount(group);
+		}
+
+		return n;
+	#endif
+	}
+
+	// Characters from one random vector, two per byte when 4 bits are enough
+	// out needs room for 64 characters, returns the number written
+	static std::size_t chars_from_vector(char* out, __m256i rand, const token_alphabet& alphabet)
+	{
+		const __m256i mask = _mm256_set1_epi8(char((1u << alphabet.bits) - 1));
+
+		std::size_t n = emit(out, _mm256_and_si256(rand, mask), alphabet);
+
+		if (alphabet.bits <= 4)
+			n += emit(out + n, _mm256_and_si256(_mm256_srli_epi16(rand, 4), mask), alphabet);
+
+		return n;
+	}
+
+	// len random characters written contiguously
+	static void fill_chars(char* out, std::size_t len, const token_alphabet& alphabet, aes_dragontamer_state& state)
+	{
+		std::size_t i = 0;
+
+		while (len - i >= 64)
+			i += chars_from_vector(out + i, state.next(), alphabet);
+
+		char buffer[128];
+		std::size_t have = 0;
+
+		while (have < len - i)
+			have += chars_from_vector(buffer + have, state.next(), alphabet);
+
+		std::memcpy(out + i, buffer, len - i);
+	}
+
+	// Sets the version 4 and variant 1 bits of the two UUIDs in a vector, one per 128-bit lane
+	static __m256i uuid_bits(__m256i rand)
+	{
+		const __m256i keep = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, -1, -1, -1, -1, -1, 0x0F, -1, 0x3F, -1, -1, -1, -1, -1, -1, -1));
+		const __m256i set = _mm256_broadcastsi128_si256(_mm_setr_epi8(0, 0, 0, 0, 0, 0, 0x40, 0, char(0x80), 0, 0, 0, 0, 0, 0, 0));
+
+		return _mm256_or_si256(_mm256_and_si256(rand, keep), set);
+	}
+
+	// Formats the two UUIDs of a vector as 36 characters each
+	// a and b are characters 0-15 and 16-31 and c holds 32-35 in its last 32 bits, per 128-bit lane
+	static void uuid_format(__m256i uuid, __m256i* a, __m256i* b, __m256i* c)
+	{
+		const __m256i hex_digits = _mm256_broadcastsi128_si256(_mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'));
+		const __m256i nibble = _mm256_set1_epi8(0x0F);
+
+		__m256i high = _mm256_and_si256(_mm256_srli_epi16(uuid, 4), nibble);
+		__m256i low = _mm256_and_si256(uuid, nibble);
+
+		// Hex digits of bytes 0-7 and 8-15, high nibble first
+		__m256i hex_lo = _mm256_shuffle_epi8(hex_digits, _mm256_unpacklo_epi8(high, low));
+		__m256i hex_hi = _mm256_shuffle_epi8(hex_digits, _mm256_unpackhi_epi8(high, low));
+
+		// xxxxxxxx-xxxx-4xxx-Vxxx-xxxxxxxxxxxx, -1 selects a zero to put a dash in
+		const __m256i a_lo = _mm256_broadcastsi128_si256(_mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, -1, 8, 9, 10, 11, -1, 12, 13));
+		const __m256i a_dash = _mm256_broadcastsi128_si256(_mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, '-', 0, 0, 0, 0, '-', 0, 0));
+		const __m256i b_lo = _mm256_broadcastsi128_si256(_mm_setr_epi8(14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+		const __m256i b_hi = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, -1, -1, 0, 1, 2, 3, -1, 4, 5, 6, 7, 8, 9, 10, 11));
+		const __m256i b_dash = _mm256_broadcastsi128_si256(_mm_setr_epi8(0, 0, '-', 0, 0, 0, 0, '-', 0, 0, 0, 0, 0, 0, 0, 0));
+
+		*a = _mm256_or_si256(_mm256_shuffle_epi8(hex_lo, a_lo), a_dash);
+		*b = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(hex_lo, b_lo), _mm256_shuffle_epi8(hex_hi, b_hi)), b_dash);
+		*c = hex_hi;
+	}
+
+	static void uuid_store(char* out, __m128i a, __m128i b, __m128i c)
+	{
+		const uint32_t last = uint32_t(_mm_extract_epi32(c, 3));
+
+		_mm_storeu_si128((__m128i *)out, a);
+		_mm_storeu_si128((__m128i *)(out + 16), b);
+
+		std::memcpy(out + 32, &last, sizeof(last));
+	}
+
+public:
+	random_tokens() {}
+
+	// n strings of width characters, the i-th at out + i * stride
+	void strings(char* out, std::size_t n, std::size_t width, std::size_t stride, const token_alphabet& alphabet, aes_dragontamer_key& key)
+	{
+		aes_dragontamer_state state(key);
+
+		if (stride == width)
+		{
+			fill_chars(out, n * width, alphabet, state);
+		}
+		else
+		{
+			// Leftover characters carry over to the next record
+			char pool[pool_size + 64];
+			std::size_t have = 0, pos = 0;
+
+			for (std::size_t r = 0; r < n; r++)
+			{
+				char* record = out + r * stride;
+
+				for (std::size_t done = 0; done < width; )
+				{
+					if (pos == have)
+					{
+						for (have = 0; have < pool_size; )
+							have += chars_from_vector(pool + have, state.next(), alphabet);
+
+						pos = 0;
+					}
+
+					const std::size_t m = std::min(width - done, have - pos);
+
+					std::memcpy(record + done, pool + pos, m);
+
+					done += m;
+					pos += m;
+				}
+			}
+		}
+
+		state.store_state(key);
+	}
+
+	void strings(char* out, std::size_t n, std::size_t width, std::size_t stride, const token_alphabet& alphabet)
+	{
+		aes_dragontamer_key key;
+
+		return strings(out, n, width, stride, alphabet, key);
+	}
+
+	// n random UUIDv4s as 16 bytes each
+	void uuid_bytes(unsigned char* out, std::size_t n, aes_dragontamer_key& key)
+	{
+		aes_dragontamer_state state(key);
+
+		std::size_t i = 0;
+
+		for (; i + 2 <= n; i += 2)
+			_mm256_storeu_si256((__m256i *)(out + 16 * i), uuid_bits(state.next()));
+
+		if (i != n)
+			_mm_storeu_si128((__m128i *)(out + 16 * i), _mm256_castsi256_si128(uuid_bits(state.next())));
+
+		state.store_state(key);
+	}
+
+	void uuid_bytes(unsigned char* out, std::size_t n)
+	{
+		aes_dragontamer_key key;
+
+		return uuid_bytes(out, n, key);
+	}
+
+	// n random UUIDv4s as 36 lower case characters, the i-th at out + i * stride
+	// stride must be at least 36
+	void uuids(char* out, std::size_t n, std::size_t stride, aes_dragontamer_key& key)
+	{
+		aes_dragontamer_state state(key);
+
+		__m256i a, b, c;
+
+		for (std::size_t i = 0; i < n; i += 2)
+		{
+			uuid_format(uuid_bits(state.next()), &a, &b, &c);
+
+			uuid_store(out + i * stride, _mm256_castsi256_si128(a), _mm256_castsi256_si128(b), _mm256_castsi256_si128(c));
+
+			if (i + 1 < n)
+				uuid_store(out + (i + 1) * stride, _mm256_extracti128_si256(a, 1), _mm256_extracti128_si256(b, 1), _mm256_extracti128_si256(c, 1));
+		}
+
+		state.store_state(key);
+	}
+
+	void uuids(char* out, std::size_t n, std::size_t stride)
+	{
+		aes_dragontamer_key key;
+
+		return uuids(out, n, stride, key);
+	}
+};
+
+#endif
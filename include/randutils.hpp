@@ -467,9 +467,10 @@ class auto_seeded : public SeedSeq
         static uint32_t random_int = std::random_device{}();
 
         // The heap can vary from run to run as well.
+        // Hashed before the free, a freed pointer may not be used
         void* malloc_addr = malloc(sizeof(int));
-        free(malloc_addr);
         auto heap  = hash(malloc_addr);
+        free(malloc_addr);
         auto stack = hash(&malloc_addr);
 
         // Every call, we increment our random int.  We don't care about race
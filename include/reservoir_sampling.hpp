@@ -0,0 +1,290 @@
+#ifndef RESERVOIRSAMPLING_H
+#define RESERVOIRSAMPLING_H
+
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+#include "simd_intrinsics.hpp"
+#include "simd_xorshift128plus.hpp"
+#include "simd_distributions.hpp"
+
+// The randoms used by the reservoir samplers, generated 64 at a time
+// Log-uniforms come from the vectorized log and slots from the SIMD bounded kernel
+class reservoir_randoms
+{
+protected:
+	simd_xorshift128plus generator;
+	simd_xorshift128plus_key key;
+
+	static constexpr uint32_t batch = 64;
+
+	alignas(32) double log_u[batch];
+	alignas(32) uint32_t slots[batch];
+
+	uint32_t log_pos = batch;
+	uint32_t slot_pos = batch;
+
+	// Slots are in [0, k)
+	__m256i bound;
+
+public:
+	reservoir_randoms(uint32_t k, const simd_xorshift128plus_key& k0) : key(k0), bound(_mm256_set1_epi32(k)) {}
+
+	// log(u) for u in (0, 1]
+	double next_log_uniform()
+	{
+		if (log_pos == batch)
+		{
+			for (uint32_t i = 0; i < batch; i += 4)
+				_mm256_store_pd(log_u + i, simd_distributions::log_pd(simd_distributions::uniform_pd(generator.get_rand(key))));
+
+			log_pos = 0;
+		}
+
+		return log_u[log_pos++];
+	}
+
+	double next_uniform()
+	{
+		return std::exp(next_log_uniform());
+	}
+
+	// A random reservoir slot
+	uint32_t next_slot()
+	{
+		if (slot_pos == batch)
+		{
+			for (uint32_t i = 0; i < batch; i += 8)
+				_mm256_store_si256((__m256i *)(slots + i), simd_xorshift128plus::avx_randombound_epu32(generator.get_rand(key), bound));
+
+			slot_pos = 0;
+		}
+
+		return slots[slot_pos++];
+	}
+};
+
+
+// Uniform reservoir sampling of k records from a stream of batches with Li's Algorithm L (1994)
+// After the reservoir fills, the number of records to skip before the next replacement
+// is drawn directly, so skipped records are never touched
+template <typename T>
+class reservoir_sampler
+{
+protected:
+	std::vector<T> reservoir;
+
+	const uint32_t k;
+
+	reservoir_randoms randoms;
+
+	// Records seen so far
+	uint64_t seen = 0;
+
+	// Records left to skip before the next one goes in the reservoir
+	uint64_t skip = 0;
+
+	// Largest of the k smallest uniform keys so far
+	double W = 1.0;
+
+	void next_skip()
+	{
+		W *= std::exp(randoms.next_log_uniform() / k);
+
+		// floor(log(u) / log(1 - W)), capped so the count can't overflow
+		skip = uint64_t(std::min(std::floor(randoms.next_log_uniform() / std::log1p(-W)), 9.0e18));
+	}
+
+public:
+	reservoir_sampler(uint32_t sample_size, const simd_xorshift128plus_key& key = simd_xorshift128plus_key())
+		: k(sample_size), randoms(sample_size, key)
+	{
+		reservoir.reserve(k);
+	}
+
+	// Offer a batch of records
+	void add(const T* records, std::size_t count)
+	{
+		if (k == 0)
+		{
+			seen += count;
+			return;
+		}
+
+		// Fill the reservoir first
+		while (reservoir.size() < k && count != 0)
+		{
+			reservoir.push_back(*records++);
+			count--;
+			seen++;
+
+			if (reservoir.size() == k)
+				next_skip();
+		}
+
+		while (count != 0)
+		{
+			if (skip >= count)
+			{
+				skip -= count;
+				seen += count;
+
+				return;
+			}
+
+			records += skip;
+			count -= skip;
+			seen += skip;
+
+			reservoir[randoms.next_slot()] = *records++;
+			count--;
+			seen++;
+
+			next_skip();
+		}
+	}
+
+	const std::vector<T>& sample() const
+	{
+		return reservoir;
+	}
+
+	uint64_t records_seen() const
+	{
+		return seen;
+	}
+};
+
+
+// Weighted reservoir sampling with Efraimidis and Spirakis' A-ExpJ (2006)
+// Record i gets the key u^(1 / w_i) and the k largest keys are kept. Rather than a key per
+// record the total weight to skip before the next insertion is drawn directly.
+// Keys are kept as logs so small weights don't underflow
+template <typename T>
+class weighted_reservoir_sampler
+{
+protected:
+	// (log key, record) as a min-heap on the key
+	std::vector<std::pair<double, T>> reservoir;
+
+	const uint32_t k;
+
+	reservoir_randoms randoms;
+
+	uint64_t seen = 0;
+
+	// Weight left to skip before the next insertion
+	double weight_to_skip = 0.0;
+
+	static bool heap_order(const std::pair<double, T>& a, const std::pair<double, T>& b)
+	{
+		return a.first > b.first;
+	}
+
+	// log of the smallest key in the reservoir
+	double min_log_key() const
+	{
+		return reservoir.front().first;
+	}
+
+	void next_skip()
+	{
+		// X_w = log(r) / log(T_w)
+		weight_to_skip = randoms.next_log_uniform() / min_log_key();
+	}
+
+	void insert(const T& record, double w)
+	{
+		// The new key is uniform in (T_w^w, 1) raised to 1 / w
+		const double t = std::exp(w * min_log_key());
+
+		const double r = t + (1.0 - t) * randoms.next_uniform();
+
+		std::pop_heap(reservoir.begin(), reservoir.end(), heap_order);
+
+		reservoir.back() = std::make_pair(std::log(r) / w, record);
+
+		std::push_heap(reservoir.begin(), reservoir.end(), heap_order);
+
+		next_skip();
+	}
+
+public:
+	weighted_reservoir_sampler(uint32_t sample_size, const simd_xorshift128plus_key& key = simd_xorshift128plus_key())
+		: k(sample_size), randoms(sample_size, key)
+	{
+		reservoir.reserve(k);
+	}
+
+	// Offer a batch of records with positive weights
+	void add(const T* records, const double* weights, std::size_t count)
+	{
+		seen += count;
+
+		if (k == 0)
+			return;
+
+		std::size_t i = 0;
+
+		for (; reservoir.size() < k && i < count; i++)
+		{
+			reservoir.emplace_back(randoms.next_log_uniform() / weights[i], records[i]);
+			std::push_heap(reservoir.begin(), reservoir.end(), heap_order);
+
+			if (reservoir.size() == k)
+				next_skip();
+		}
+
+		while (i < count)
+		{
+			// Only the weights of skipped records are read, whole groups of 8 first
+			// as their sums don't depend on weight_to_skip
+			while (i + 8 <= count)
+			{
+				__m256d w = _mm256_add_pd(_mm256_loadu_pd(weights + i), _mm256_loadu_pd(weights + i + 4));
+				__m128d w2 = _mm_add_pd(_mm256_castpd256_pd128(w), _mm256_extractf128_pd(w, 1));
+
+				const double group = _mm_cvtsd_f64(_mm_add_sd(w2, _mm_unpackhi_pd(w2, w2)));
+
+				if (weight_to_skip < group)
+					break;
+
+				weight_to_skip -= group;
+				i += 8;
+			}
+
+			while (i < count && weight_to_skip >= weights[i])
+				weight_to_skip -= weights[i++];
+
+			if (i == count)
+				break;
+
+			insert(records[i], weights[i]);
+			i++;
+		}
+	}
+
+	uint64_t records_seen() const
+	{
+		return seen;
+	}
+
+	// The sampled records, in no particular order
+	std::vector<T> sample() const
+	{
+		std::vector<T> result;
+
+		result.reserve(reservoir.size());
+
+		for (auto& entry : reservoir)
+			result.push_back(entry.second);
+
+		return result;
+	}
+};
+
+#endif
@@ -0,0 +1,274 @@
+#ifndef RNGPOOL_H
+#define RNGPOOL_H
+
+#include <atomic>
+#include <array>
+#include <vector>
+#include <cstdint>
+
+#include "simd_intrinsics.hpp"
+#include "randutils.hpp"
+
+#include "xorshift128plus.hpp"
+#include "simd_xorshift128plus.hpp"
+#include "aes_dragontamer.hpp"
+
+#if defined(__AVX512F__)
+	#include "simd_avx512_xorshift128plus.hpp"
+#endif
+
+// Hands out independent generator states to any number of threads
+// Every key claims the next substream index with a single atomic increment so
+// no locks are needed. An xorshift substream n starts 4n jumps (2^64 steps each)
+// from the base seed, one jump per SIMD lane, and a dragontamer substream n starts
+// (n mod 2^16) * 2^48 counter increments from the base state of epoch n / 2^16.
+// Any number of jumps is composed from precomputed jumps by powers of two, so deriving a
+// key costs O(log n) rather than O(n)
+class rng_pool
+{
+protected:
+	// All substreams are derived from this state
+	uint64_t base_seed1 = 0;
+	uint64_t base_seed2 = 0;
+
+	// The next free substream
+	std::atomic<uint64_t> next_substream{0};
+
+	// Number of calls to the dragontamer generator between substreams
+	static constexpr uint64_t dragontamer_stride = uint64_t(1) << 48;
+
+	// The dragontamer counters are two 64-bit lanes, so n * 2^48 increments come round again
+	// after 2^16 substreams. Each epoch of 2^16 substreams starts from its own base state
+	static constexpr unsigned dragontamer_epoch_bits = 16;
+
+	// Number of jumps used by each SIMD xorshift key, one per lane
+	static constexpr uint64_t xorshift_lanes = sizeof(__m256i) / sizeof(uint64_t);
+
+	// A number of jumps as a 128x128 matrix over GF(2), the state is linear in the seed
+	// Column j is the jumped state of the seed with only bit j set, seed1 holding bits 0-63
+	struct jump_matrix
+	{
+		uint64_t column[128][2];
+	};
+
+	static void apply(const jump_matrix& m, uint64_t& seed1, uint64_t& seed2)
+	{
+		uint64_t s1 = 0;
+		uint64_t s2 = 0;
+
+		for (int j = 0; j < 128; j++)
+		{
+			const uint64_t bit = j < 64 ? seed1 >> j : seed2 >> (j - 64);
+
+			// All ones when the bit is set
+			const uint64_t mask = 0 - (bit & 1);
+
+			s1 ^= m.column[j][0] & mask;
+			s2 ^= m.column[j][1] & mask;
+		}
+
+		seed1 = s1;
+		seed2 = s2;
+	}
+
+	// powers()[i] is 2^i jumps, built once by squaring
+	static const std::vector<jump_matrix>& powers()
+	{
+		static const std::vector<jump_matrix> table = []()
+		{
+			std::vector<jump_matrix> p(64);
+
+			for (int j = 0; j < 128; j++)
+			{
+				xorshift128plus_key unit(j < 64 ? uint64_t(1) << j : 0, j < 64 ? 0 : uint64_t(1) << (j - 64));
+
+				unit.jump();
+
+				p[0].column[j][0] = unit.seed1;
+				p[0].column[j][1] = unit.seed2;
+			}
+
+			for (int i = 1; i < 64; i++)
+			{
+				for (int j = 0; j < 128; j++)
+				{
+					p[i].column[j][0] = p[i - 1].column[j][0];
+					p[i].column[j][1] = p[i - 1].column[j][1];
+
+					apply(p[i - 1], p[i].column[j][0], p[i].column[j][1]);
+				}
+			}
+
+			return p;
+		}();
+
+		return table;
+	}
+
+	// The base seed moved on by n jumps
+	xorshift128plus_key jumped(uint64_t n) const
+	{
+		xorshift128plus_key key(base_seed1, base_seed2);
+
+		const std::vector<jump_matrix>& p = powers();
+
+		for (int i = 0; n != 0; i++, n >>= 1)
+			if (n & 1)
+				apply(p[i], key.seed1, key.seed2);
+
+		return key;
+	}
+
+public:
+	rng_pool()
+	{
+		std::array<uint32_t, 4> seed_array;
+
+	    randutils::auto_seed_128 seeder;
+
+		seeder.generate(seed_array.begin(), seed_array.end());
+
+		uint64_t seed_part1 = seed_array[0];
+		uint64_t seed_part2 = seed_array[1];
+		uint64_t seed_part3 = seed_array[2];
+		uint64_t seed_part4 = seed_array[3];
+
+		// Create some 64-bit numbers
+		base_seed1 = seed_part1 << 32 | seed_part2;
+		base_seed2 = seed_part3 << 32 | seed_part4;
+	}
+
+	// Explicitly seeded pool, substream n is the same every run
+	// The seeds are mixed with xorshift128plus_key::mix_seeds, so (0, 0) and small seeds work too
+	rng_pool(uint64_t seed1, uint64_t seed2)
+	{
+		xorshift128plus_key::mix_seeds(seed1, seed2);
+
+		base_seed1 = seed1;
+		base_seed2 = seed2;
+	}
+
+	rng_pool(const rng_pool&) = delete;
+	rng_pool& operator=(const rng_pool&) = delete;
+
+	// Reserve a substream index, lock-free and safe to call from any thread
+	uint64_t claim_substream()
+	{
+		return next_substream.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Reserve count consecutive substream indices, returns the first
+	uint64_t claim_substreams(uint64_t count)
+	{
+		return next_substream.fetch_add(count, std::memory_order_relaxed);
+	}
+
+	// The key for a given substream, this doesn't claim it
+	simd_xorshift128plus_key xorshift_key(uint64_t substream) const
+	{
+		xorshift128plus_key base = jumped(xorshift_lanes * substream);
+
+		return simd_xorshift128plus_key::from_state(base.seed1, base.seed2);
+	}
+
+	aes_dragontamer_key dragontamer_key(uint64_t substream) const
+	{
+		uint64_t epoch = substream >> dragontamer_epoch_bits;
+
+		uint64_t seed1 = base_seed1;
+		uint64_t seed2 = base_seed2;
+
+		// Epoch 0 starts from the base seed itself, later epochs from a state mixed from it
+		if (epoch != 0)
+		{
+			uint64_t x = base_seed1 ^ xorshift128plus_key::splitmix64(epoch);
+
+			seed1 = xorshift128plus_key::splitmix64(x);
+			seed2 = xorshift128plus_key::splitmix64(x) ^ base_seed2;
+		}
+
+		aes_dragontamer_key key(seed1, seed2);
+
+		key.advance((substream & ((uint64_t(1) << dragontamer_epoch_bits) - 1)) * dragontamer_stride);
+
+		return key;
+	}
+
+	// Claim a substream and return its key
+	simd_xorshift128plus_key make_xorshift_key()
+	{
+		return xorshift_key(claim_substream());
+	}
+
+#if defined(__AVX512F__)
+	// An AVX-512 key has 8 lanes so it covers two consecutive substreams
+	simd_avx512_xorshift128plus_key avx512_xorshift_key(uint64_t substream) const
+	{
+		xorshift128plus_key base = jumped(xorshift_lanes * substream);
+
+		return simd_avx512_xorshift128plus_key::from_state(base.seed1, base.seed2);
+	}
+
+	simd_avx512_xorshift128plus_key make_avx512_xorshift_key()
+	{
+		return avx512_xorshift_key(claim_substreams(2));
+	}
+#endif
+
+	aes_dragontamer_key make_dragontamer_key()
+	{
+		return dragontamer_key(claim_substream());
+	}
+
+	// The process wide pool used by thread_rng
+	static rng_pool& global()
+	{
+		static rng_pool pool;
+
+		return pool;
+	}
+};
+
+
+// Per-thread generators drawn from the global pool
+// A thread's keys are created the first time it asks for them, after that
+// every call is a plain thread_local access with no synchronization
+class thread_rng
+{
+public:
+	static simd_xorshift128plus_key& xorshift_key()
+	{
+		thread_local simd_xorshift128plus_key key = rng_pool::global().make_xorshift_key();
+
+		return key;
+	}
+
+	static aes_dragontamer_key& dragontamer_key()
+	{
+		thread_local aes_dragontamer_key key = rng_pool::global().make_dragontamer_key();
+
+		return key;
+	}
+
+	static __m256i xorshift_rand()
+	{
+		return simd_xorshift128plus().get_rand(xorshift_key());
+	}
+
+	static __m256i dragontamer_rand()
+	{
+		return aes_dragontamer().get_rand(dragontamer_key());
+	}
+
+	static void fill_array(uint32_t* rand_arr, uint32_t N_rands)
+	{
+		simd_xorshift128plus().fill_array(rand_arr, N_rands, xorshift_key());
+	}
+
+	static void fill_array_dragontamer(uint32_t* rand_arr, uint32_t N_rands)
+	{
+		aes_dragontamer().fill_array(rand_arr, N_rands, dragontamer_key());
+	}
+};
+
+#endif
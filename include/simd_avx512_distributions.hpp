@@ -0,0 +1,447 @@
+#ifndef SIMD512DISTRIBUTIONS_H
+#define SIMD512DISTRIBUTIONS_H
+
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+
+#include "simd_intrinsics.hpp"
+#include "simd_avx512_xorshift128plus.hpp"
+#include "simd_distributions.hpp"
+
+// The AVX-512 version of simd_distributions
+// Rejected lanes are retried under a __mmask8 until every lane has been accepted
+class simd_avx512_distributions
+{
+protected:
+	simd_avx512_xorshift128plus generator;
+
+	// Inversion, each lane counts the entries of F below its uniform
+	static __m512d inversion_pd(__m512d u, const std::vector<double>& F)
+	{
+		__m512d k = _mm512_setzero_pd();
+
+		const __m512d one = _mm512_set1_pd(1.0);
+
+		for (std::size_t j = 0; j < F.size(); j++)
+		{
+			__mmask8 above = _mm512_cmp_pd_mask(u, _mm512_set1_pd(F[j]), _CMP_GT_OQ);
+
+			if (above == 0)
+				break;
+
+			k = _mm512_mask_add_pd(k, above, k, one);
+		}
+
+		return k;
+	}
+
+	// Stores 8 integer valued doubles as uint32_t
+	static void store_counts(uint32_t* out, __m512d k, __mmask8 lanes = 0xFF)
+	{
+		_mm256_mask_storeu_epi32(out, lanes, _mm512_cvttpd_epi32(k));
+	}
+
+	// Eight uniforms in [0, 1) from a fresh random vector
+	__m512d next_uniform_pd(simd_avx512_xorshift128plus_key& key)
+	{
+		return _mm512_sub_pd(_mm512_set1_pd(1.0), uniform_pd(generator.get_rand(key)));
+	}
+
+	// PTRS, see simd_distributions::poisson_ptrs
+	__m512d poisson_ptrs(const simd_distributions::ptrs_constants& pc, simd_avx512_xorshift128plus_key& key)
+	{
+		const double lambda = pc.lambda, loglam = pc.loglam, b = pc.b, a = pc.a, loginvalpha = pc.loginvalpha, vr = pc.vr;
+
+		const __m512d half = _mm512_set1_pd(0.5);
+
+		__m512d result = _mm512_setzero_pd();
+
+		// Lanes that still need a value
+		__mmask8 pending = 0xFF;
+
+		while (pending != 0)
+		{
+			__m512d U = _mm512_sub_pd(next_uniform_pd(key), half);
+			__m512d V = uniform_pd(generator.get_rand(key));
+
+			__m512d us = _mm512_sub_pd(half, _mm512_abs_pd(U));
+
+			// k = floor((2a / us + b) * U + lam + 0.43)
+			__m512d k = _mm512_roundscale_pd(_mm512_fmadd_pd(_mm512_add_pd(_mm512_div_pd(_mm512_set1_pd(2 * a), us), _mm512_set1_pd(b)), U,
+															 _mm512_set1_pd(lambda + 0.43)), _MM_FROUND_TO_NEG_INF);
+
+			// The quick acceptance region
+			__mmask8 accept = _mm512_cmp_pd_mask(us, _mm512_set1_pd(0.07), _CMP_GE_OQ) & _mm512_cmp_pd_mask(V, _mm512_set1_pd(vr), _CMP_LE_OQ);
+
+			// Outright rejections
+			__mmask8 reject = _mm512_cmp_pd_mask(k, _mm512_setzero_pd(), _CMP_LT_OQ) |
+							  (_mm512_cmp_pd_mask(us, _mm512_set1_pd(0.013), _CMP_LT_OQ) & _mm512_cmp_pd_mask(V, us, _CMP_GT_OQ));
+
+			__m512d lhs = _mm512_sub_pd(_mm512_add_pd(log_pd(V), _mm512_set1_pd(loginvalpha)),
+										log_pd(_mm512_add_pd(_mm512_div_pd(_mm512_set1_pd(a), _mm512_mul_pd(us, us)), _mm512_set1_pd(b))));
+
+			__m512d rhs = _mm512_sub_pd(_mm512_fmadd_pd(k, _mm512_set1_pd(loglam), _mm512_set1_pd(-lambda)), log_factorial_pd(_mm512_max_pd(k, _mm512_setzero_pd())));
+
+			accept = (accept | (~reject & _mm512_cmp_pd_mask(lhs, rhs, _CMP_LE_OQ))) & pending;
+
+			result = _mm512_mask_blend_pd(accept, result, k);
+			pending &= ~accept;
+		}
+
+		return result;
+	}
+
+	// BTRS, see simd_distributions::binomial_btrs, needs p <= 0.5
+	__m512d binomial_btrs(const simd_distributions::btrs_constants& bc, simd_avx512_xorshift128plus_key& key)
+	{
+		const uint32_t n = bc.n;
+		const double b = bc.b, a = bc.a, c = bc.c, vr = bc.vr, alpha = bc.alpha, lpq = bc.lpq, m = bc.m, h = bc.h;
+
+		const __m512d half = _mm512_set1_pd(0.5);
+		const __m512d n_pd = _mm512_set1_pd(n);
+
+		__m512d result = _mm512_setzero_pd();
+
+		__mmask8 pending = 0xFF;
+
+		while (pending != 0)
+		{
+			__m512d U = _mm512_sub_pd(next_uniform_pd(key), half);
+			__m512d V = uniform_pd(generator.get_rand(key));
+
+			__m512d us = _mm512_sub_pd(half, _mm512_abs_pd(U));
+
+			// k = floor((2a / us + b) * U + c)
+			__m512d k = _mm512_roundscale_pd(_mm512_fmadd_pd(_mm512_add_pd(_mm512_div_pd(_mm512_set1_pd(2 * a), us), _mm512_set1_pd(b)), U,
+															 _mm512_set1_pd(c)), _MM_FROUND_TO_NEG_INF);
+
+			__mmask8 reject = _mm512_cmp_pd_mask(k, _mm512_setzero_pd(), _CMP_LT_OQ) | _mm512_cmp_pd_mask(k, n_pd, _CMP_GT_OQ);
+
+			__mmask8 accept = _mm512_cmp_pd_mask(us, _mm512_set1_pd(0.07), _CMP_GE_OQ) & _mm512_cmp_pd_mask(V, _mm512_set1_pd(vr), _CMP_LE_OQ);
+
+			// Keep k in [0, n] for the log factorials, rejected lanes are masked out anyway
+			__m512d kc = _mm512_min_pd(_mm512_max_pd(k, _mm512_setzero_pd()), n_pd);
+
+			__m512d lhs = log_pd(_mm512_div_pd(_mm512_mul_pd(V, _mm512_set1_pd(alpha)),
+											   _mm512_add_pd(_mm512_div_pd(_mm512_set1_pd(a), _mm512_mul_pd(us, us)), _mm512_set1_pd(b))));
+
+			__m512d rhs = _mm512_sub_pd(_mm512_sub_pd(_mm512_set1_pd(h), log_factorial_pd(kc)), log_factorial_pd(_mm512_sub_pd(n_pd, kc)));
+
+			rhs = _mm512_fmadd_pd(_mm512_sub_pd(kc, _mm512_set1_pd(m)), _mm512_set1_pd(lpq), rhs);
+
+			accept = ~reject & (accept | _mm512_cmp_pd_mask(lhs, rhs, _CMP_LE_OQ)) & pending;
+
+			result = _mm512_mask_blend_pd(accept, result, k);
+			pending &= ~accept;
+		}
+
+		return result;
+	}
+
+public:
+	simd_avx512_distributions() {}
+
+	// Uniform floats in (0, 1] from the top 23 bits of each 32-bit lane
+	static __m512 uniform_ps(__m512i bits)
+	{
+		__m512 one_two = _mm512_castsi512_ps(_mm512_or_si512(_mm512_srli_epi32(bits, 9), _mm512_set1_epi32(0x3F800000)));
+
+		return _mm512_sub_ps(_mm512_set1_ps(2.0f), one_two);
+	}
+
+	// Uniform doubles in (0, 1] from the top 52 bits of each 64-bit lane
+	static __m512d uniform_pd(__m512i bits)
+	{
+		__m512d one_two = _mm512_castsi512_pd(_mm512_or_si512(_mm512_srli_epi64(bits, 12), _mm512_set1_epi64(0x3FF0000000000000)));
+
+		return _mm512_sub_pd(_mm512_set1_pd(2.0), one_two);
+	}
+
+	// Natural log of 16 positive, normal floats
+	// getexp and scalef split x into m * 2^e with m in [3/4, 3/2), then log(m) = 2 atanh((m - 1) / (m + 1))
+	static __m512 log_ps(__m512 x)
+	{
+		__m512 e = _mm512_getexp_ps(_mm512_mul_ps(x, _mm512_set1_ps(4.0f / 3.0f)));
+
+		__m512 m = _mm512_scalef_ps(x, _mm512_sub_ps(_mm512_setzero_ps(), e));
+
+		__m512 z = _mm512_div_ps(_mm512_sub_ps(m, _mm512_set1_ps(1.0f)), _mm512_add_ps(m, _mm512_set1_ps(1.0f)));
+
+		__m512 z2 = _mm512_mul_ps(z, z);
+
+		__m512 poly = _mm512_set1_ps(2.0f / 9.0f);
+		poly = _mm512_fmadd_ps(poly, z2, _mm512_set1_ps(2.0f / 7.0f));
+		poly = _mm512_fmadd_ps(poly, z2, _mm512_set1_ps(2.0f / 5.0f));
+		poly = _mm512_fmadd_ps(poly, z2, _mm512_set1_ps(2.0f / 3.0f));
+		poly = _mm512_fmadd_ps(poly, z2, _mm512_set1_ps(2.0f));
+
+		return _mm512_fmadd_ps(e, _mm512_set1_ps(0.69314718f), _mm512_mul_ps(poly, z));
+	}
+
+	// Natural log of 8 positive, normal doubles, as log_ps
+	static __m512d log_pd(__m512d x)
+	{
+		__m512d e = _mm512_getexp_pd(_mm512_mul_pd(x, _mm512_set1_pd(4.0 / 3.0)));
+
+		__m512d m = _mm512_scalef_pd(x, _mm512_sub_pd(_mm512_setzero_pd(), e));
+
+		__m512d z = _mm512_div_pd(_mm512_sub_pd(m, _mm512_set1_pd(1.0)), _mm512_add_pd(m, _mm512_set1_pd(1.0)));
+
+		__m512d z2 = _mm512_mul_pd(z, z);
+
+		// 2 * (1 + z^2 / 3 + z^4 / 5 + ... + z^20 / 21)
+		__m512d poly = _mm512_set1_pd(2.0 / 21.0);
+
+		for (int t = 19; t >= 1; t -= 2)
+			poly = _mm512_fmadd_pd(poly, z2, _mm512_set1_pd(2.0 / t));
+
+		return _mm512_fmadd_pd(e, _mm512_set1_pd(0.69314718055994531), _mm512_mul_pd(poly, z));
+	}
+
+	// sin and cos of 2 pi (u - 1/2) for u in [0, 1), see simd_distributions::sincos_2pi_ps
+	static void sincos_2pi_ps(__m512 u, __m512* s, __m512* c)
+	{
+		__m512 h = _mm512_mul_ps(_mm512_sub_ps(u, _mm512_set1_ps(0.5f)), _mm512_set1_ps(3.14159265f));
+
+		__m512 h2 = _mm512_mul_ps(h, h);
+
+		__m512 sp = _mm512_set1_ps(-1.0f / 39916800.0f);
+		sp = _mm512_fmadd_ps(sp, h2, _mm512_set1_ps(1.0f / 362880.0f));
+		sp = _mm512_fmadd_ps(sp, h2, _mm512_set1_ps(-1.0f / 5040.0f));
+		sp = _mm512_fmadd_ps(sp, h2, _mm512_set1_ps(1.0f / 120.0f));
+		sp = _mm512_fmadd_ps(sp, h2, _mm512_set1_ps(-1.0f / 6.0f));
+		sp = _mm512_fmadd_ps(sp, h2, _mm512_set1_ps(1.0f));
+
+		__m512 sh = _mm512_mul_ps(sp, h);
+
+		__m512 cp = _mm512_set1_ps(1.0f / 479001600.0f);
+		cp = _mm512_fmadd_ps(cp, h2, _mm512_set1_ps(-1.0f / 3628800.0f));
+		cp = _mm512_fmadd_ps(cp, h2, _mm512_set1_ps(1.0f / 40320.0f));
+		cp = _mm512_fmadd_ps(cp, h2, _mm512_set1_ps(-1.0f / 720.0f));
+		cp = _mm512_fmadd_ps(cp, h2, _mm512_set1_ps(1.0f / 24.0f));
+		cp = _mm512_fmadd_ps(cp, h2, _mm512_set1_ps(-0.5f));
+		cp = _mm512_fmadd_ps(cp, h2, _mm512_set1_ps(1.0f));
+
+		// Double angle formulas
+		*s = _mm512_mul_ps(_mm512_set1_ps(2.0f), _mm512_mul_ps(sh, cp));
+		*c = _mm512_fnmadd_ps(_mm512_set1_ps(2.0f), _mm512_mul_ps(sh, sh), _mm512_set1_ps(1.0f));
+	}
+
+	// log(k!) of 8 non-negative integer valued doubles
+	static __m512d log_factorial_pd(__m512d k)
+	{
+		// Stirling's series for lgamma(x) with x = k + 1
+		__m512d x = _mm512_add_pd(k, _mm512_set1_pd(1.0));
+		__m512d inv = _mm512_div_pd(_mm512_set1_pd(1.0), x);
+		__m512d inv2 = _mm512_mul_pd(inv, inv);
+
+		__m512d series = _mm512_set1_pd(1.0 / 1260.0);
+		series = _mm512_fmadd_pd(series, inv2, _mm512_set1_pd(-1.0 / 360.0));
+		series = _mm512_fmadd_pd(series, inv2, _mm512_set1_pd(1.0 / 12.0));
+		series = _mm512_mul_pd(series, inv);
+
+		__m512d stirling = _mm512_fmsub_pd(_mm512_sub_pd(x, _mm512_set1_pd(0.5)), log_pd(x), x);
+		stirling = _mm512_add_pd(stirling, _mm512_add_pd(series, _mm512_set1_pd(0.91893853320467274))); // log(2 pi) / 2
+
+		// Small k come from the table
+		__mmask8 small = _mm512_cmp_pd_mask(k, _mm512_set1_pd(10.0), _CMP_LT_OQ);
+
+		__m256i idx = _mm512_cvttpd_epi32(_mm512_min_pd(k, _mm512_set1_pd(9.0)));
+
+		return _mm512_mask_i32gather_pd(stirling, small, idx, simd_distributions::log_factorial_table(), 8);
+	}
+
+	// Exponential with rate lambda, -log(u) / lambda
+	void exponential_array(float* out, uint32_t N, float lambda, simd_avx512_xorshift128plus_key& key)
+	{
+		const __m512 scale = _mm512_set1_ps(-1.0f / lambda);
+
+		uint32_t i = 0;
+
+		const uint32_t block = sizeof(__m512) / sizeof(float); // 16
+
+		while (i + block <= N)
+		{
+			_mm512_storeu_ps(out + i, _mm512_mul_ps(log_ps(uniform_ps(generator.get_rand(key))), scale));
+
+			i += block;
+		}
+
+		if (i != N)
+			_mm512_mask_storeu_ps(out + i, (__mmask16)((1u << (N - i)) - 1), _mm512_mul_ps(log_ps(uniform_ps(generator.get_rand(key))), scale));
+	}
+
+	void exponential_array(double* out, uint32_t N, double lambda, simd_avx512_xorshift128plus_key& key)
+	{
+		const __m512d scale = _mm512_set1_pd(-1.0 / lambda);
+
+		uint32_t i = 0;
+
+		const uint32_t block = sizeof(__m512d) / sizeof(double); // 8
+
+		while (i + block <= N)
+		{
+			_mm512_storeu_pd(out + i, _mm512_mul_pd(log_pd(uniform_pd(generator.get_rand(key))), scale));
+
+			i += block;
+		}
+
+		if (i != N)
+			_mm512_mask_storeu_pd(out + i, (__mmask8)((1u << (N - i)) - 1), _mm512_mul_pd(log_pd(uniform_pd(generator.get_rand(key))), scale));
+	}
+
+	// Geometric, see simd_distributions::geometric_array
+	void geometric_array(uint64_t* out, uint32_t N, double p, simd_avx512_xorshift128plus_key& key)
+	{
+		const __m512d scale = _mm512_set1_pd(1.0 / std::log1p(-p));
+		const __m512d cap = _mm512_set1_pd(4503599627370495.0);
+		const __m512d magic = _mm512_set1_pd(4503599627370496.0); // 2^52
+
+		auto next = [&]()
+		{
+			__m512d g = _mm512_roundscale_pd(_mm512_mul_pd(log_pd(uniform_pd(generator.get_rand(key))), scale), _MM_FROUND_TO_NEG_INF);
+
+			return _mm512_xor_si512(_mm512_castpd_si512(_mm512_add_pd(_mm512_min_pd(g, cap), magic)), _mm512_castpd_si512(magic));
+		};
+
+		uint32_t i = 0;
+
+		const uint32_t block = sizeof(__m512i) / sizeof(uint64_t); // 8
+
+		while (i + block <= N)
+		{
+			_mm512_storeu_si512((__m512i *)(out + i), next());
+
+			i += block;
+		}
+
+		if (i != N)
+			_mm512_mask_storeu_epi64(out + i, (__mmask8)((1u << (N - i)) - 1), next());
+	}
+
+	// Normal with the given mean and standard deviation using the Box-Muller transform
+	// Each pair of random vectors gives 32 outputs
+	void normal_array(float* out, uint32_t N, float mean, float stddev, simd_avx512_xorshift128plus_key& key)
+	{
+		const __m512 m = _mm512_set1_ps(mean);
+		const __m512 sd = _mm512_set1_ps(stddev);
+
+		auto next_pair = [&](__m512* z0, __m512* z1)
+		{
+			// r = sqrt(-2 log u1)
+			__m512 r = _mm512_sqrt_ps(_mm512_mul_ps(_mm512_set1_ps(-2.0f), log_ps(uniform_ps(generator.get_rand(key)))));
+
+			__m512 s, c;
+			sincos_2pi_ps(_mm512_sub_ps(_mm512_set1_ps(1.0f), uniform_ps(generator.get_rand(key))), &s, &c);
+
+			*z0 = _mm512_fmadd_ps(_mm512_mul_ps(r, c), sd, m);
+			*z1 = _mm512_fmadd_ps(_mm512_mul_ps(r, s), sd, m);
+		};
+
+		uint32_t i = 0;
+
+		const uint32_t block = sizeof(__m512) / sizeof(float); // 16
+
+		__m512 z0, z1;
+
+		while (i + 2 * block <= N)
+		{
+			next_pair(&z0, &z1);
+
+			_mm512_storeu_ps(out + i, z0);
+			_mm512_storeu_ps(out + i + block, z1);
+
+			i += 2 * block;
+		}
+
+		if (i != N)
+		{
+			float buffer[2 * sizeof(__m512) / sizeof(float)];
+
+			next_pair(&z0, &z1);
+
+			_mm512_storeu_ps(buffer, z0);
+			_mm512_storeu_ps(buffer + block, z1);
+
+			std::memcpy(out + i, buffer, sizeof(float) * (N - i));
+		}
+	}
+
+	void poisson_array(uint32_t* out, uint32_t N, double lambda, simd_avx512_xorshift128plus_key& key)
+	{
+		const uint32_t block = sizeof(__m512d) / sizeof(double); // 8
+
+		const __mmask8 tail = (__mmask8)((1u << (N % block)) - 1);
+
+		uint32_t i = 0;
+
+		if (lambda < simd_distributions::inversion_cutoff)
+		{
+			const std::vector<double> F = simd_distributions::poisson_cdf(lambda);
+
+			for (; i + block <= N; i += block)
+				store_counts(out + i, inversion_pd(next_uniform_pd(key), F));
+
+			if (i != N)
+				store_counts(out + i, inversion_pd(next_uniform_pd(key), F), tail);
+
+			return;
+		}
+
+		const simd_distributions::ptrs_constants pc(lambda);
+
+		for (; i + block <= N; i += block)
+			store_counts(out + i, poisson_ptrs(pc, key));
+
+		if (i != N)
+			store_counts(out + i, poisson_ptrs(pc, key), tail);
+	}
+
+	void binomial_array(uint32_t* out, uint32_t N, uint32_t n, double p, simd_avx512_xorshift128plus_key& key)
+	{
+		const uint32_t block = sizeof(__m512d) / sizeof(double); // 8
+
+		const __mmask8 tail = (__mmask8)((1u << (N % block)) - 1);
+
+		// Both methods want p <= 1/2, the result is flipped back at the end
+		const bool flip = p > 0.5;
+		const double pp = flip ? 1.0 - p : p;
+
+		uint32_t i = 0;
+
+		if (pp == 0.0)
+		{
+			std::fill(out, out + N, flip ? n : 0);
+			return;
+		}
+
+		if (n * pp < simd_distributions::inversion_cutoff)
+		{
+			const std::vector<double> F = simd_distributions::binomial_cdf(n, pp);
+
+			for (; i + block <= N; i += block)
+				store_counts(out + i, inversion_pd(next_uniform_pd(key), F));
+
+			if (i != N)
+				store_counts(out + i, inversion_pd(next_uniform_pd(key), F), tail);
+		}
+		else
+		{
+			const simd_distributions::btrs_constants bc(n, pp);
+
+			for (; i + block <= N; i += block)
+				store_counts(out + i, binomial_btrs(bc, key));
+
+			if (i != N)
+				store_counts(out + i, binomial_btrs(bc, key), tail);
+		}
+
+		if (flip)
+			for (i = 0; i < N; i++)
+				out[i] = n - out[i];
+	}
+};
+
+#endif
@@ -4,9 +4,11 @@
 #include <cstring>
 #include <iostream>
 #include <array>
-#include <immintrin.h>
+#include <vector>
 
+#include "simd_intrinsics.hpp"
 #include "randutils.hpp"
+#include "simd_xorshift128plus.hpp"
 
 
 
@@ -49,6 +51,30 @@ protected:
         output2[0] = s1;
     };
 
+    // Fill the eight lanes with states that are each one jump (2^64 steps) apart
+    void init_lanes(uint64_t seed1, uint64_t seed2)
+    {
+		uint64_t S0[8];
+		uint64_t S1[8];
+
+		S0[0] = seed1;
+		S1[0] = seed2;
+
+		// GJ - fixed for full array initialization
+		for (int lane = 1; lane < 8; lane++)
+			xorshift128plus_jump_onkeys(S0[lane - 1], S1[lane - 1], S0 + lane, S1 + lane);
+
+		part1 = _mm512_loadu_si512((const __m512i *) S0);
+		part2 = _mm512_loadu_si512((const __m512i *) S1);
+    }
+
+    struct unmixed {};
+
+    simd_avx512_xorshift128plus_key(uint64_t seed1, uint64_t seed2, unmixed)
+    {
+        init_lanes(seed1, seed2);
+    }
+
 public:
     simd_avx512_xorshift128plus_key()
     {
@@ -57,9 +83,6 @@ public:
         randutils::auto_seed_128 seeder;
         seeder.generate(seed_array.begin(), seed_array.end());
 
-		uint64_t S0[8];
-		uint64_t S1[8];
-
 		uint64_t seed_part1 = seed_array[0];
 		uint64_t seed_part2 = seed_array[1];
 		uint64_t seed_part3 = seed_array[2];
@@ -68,24 +91,55 @@ public:
 		// Create some 64-bit numbers
 		uint64_t seed1 = seed_part1 << 32 | seed_part2;
 		uint64_t seed2 = seed_part3 << 32 | seed_part4;
-		
-		S0[0] = seed1;
-		S1[0] = seed2;
 
-	    // todo: fix this so that the init is correct - Fixed
+		init_lanes(seed1, seed2);
+    }
 
-		// GJ - fixed for full array initialization
-		xorshift128plus_jump_onkeys(*S0, *S1, S0 + 1, S1 + 1);
-		xorshift128plus_jump_onkeys(*(S0 + 1), *(S1 + 1), S0 + 2, S1 + 2);
-		xorshift128plus_jump_onkeys(*(S0 + 2), *(S1 + 2), S0 + 3, S1 + 3);
-		xorshift128plus_jump_onkeys(*(S0 + 3), *(S1 + 3), S0 + 4, S1 + 4);
-		xorshift128plus_jump_onkeys(*(S0 + 4), *(S1 + 4), S0 + 5, S1 + 5);
-		xorshift128plus_jump_onkeys(*(S0 + 5), *(S1 + 5), S0 + 6, S1 + 6);
-		xorshift128plus_jump_onkeys(*(S0 + 6), *(S1 + 6), S0 + 7, S1 + 7);
+    // Explicitly seeded key, reproducible from the seeds. Any pair gives a working key, (0, 0)
+    // included, the seeds are mixed with xorshift128plus_key::mix_seeds before use
+    simd_avx512_xorshift128plus_key(uint64_t seed1, uint64_t seed2)
+    {
+        xorshift128plus_key::mix_seeds(seed1, seed2);
 
-		part1 = _mm512_loadu_si512((const __m512i *) S0);
-		part2 = _mm512_loadu_si512((const __m512i *) S1);            
-		       
+        init_lanes(seed1, seed2);
+    }
+
+    // A key whose lane n starts n jumps along from the state (seed1, seed2) itself, unmixed
+    // For callers that place keys on the jump grid, such as rng_pool. The state must not be all zero
+    static simd_avx512_xorshift128plus_key from_state(uint64_t seed1, uint64_t seed2)
+    {
+        return simd_avx512_xorshift128plus_key(seed1, seed2, unmixed());
+    }
+
+    // A child key for a forked task, see simd_xorshift128plus_key::split
+    simd_avx512_xorshift128plus_key split()
+    {
+		const __m512i s0 = part2;
+
+		part1 = part2;
+
+		__m512i s1 = _mm512_xor_si512(part2, _mm512_slli_epi64(part2, 23));
+
+		part2 = _mm512_xor_si512(_mm512_xor_si512(_mm512_xor_si512(s1, s0), _mm512_srli_epi64(s1, 18)), _mm512_srli_epi64(s0, 5));
+
+		alignas(64) uint64_t x[8];
+		alignas(64) uint64_t c1[8];
+		alignas(64) uint64_t c2[8];
+
+		_mm512_store_si512((__m512i *)x, _mm512_add_epi64(part2, s0));
+
+		for (int lane = 0; lane < 8; lane++)
+		{
+			c1[lane] = xorshift128plus_key::splitmix64(x[lane]);
+			c2[lane] = xorshift128plus_key::splitmix64(x[lane]) | 1; // Never all zero
+		}
+
+		simd_avx512_xorshift128plus_key child(*this);
+
+		child.part1 = _mm512_load_si512((const __m512i *)c1);
+		child.part2 = _mm512_load_si512((const __m512i *)c2);
+
+		return child;
     }
 
     __m512i part1;
@@ -93,9 +147,55 @@ public:
 };
 
 
+// A value type copy of a key for use inside hand-written AVX-512 loops
+// See simd_xorshift128plus_state
+class simd_avx512_xorshift128plus_state
+{
+public:
+	simd_avx512_xorshift128plus_state() {}
+
+	explicit simd_avx512_xorshift128plus_state(const simd_avx512_xorshift128plus_key& key)
+	{
+		load_state(key);
+	}
+
+	inline __attribute__((always_inline)) void load_state(const simd_avx512_xorshift128plus_key& key)
+	{
+		part1 = key.part1;
+		part2 = key.part2;
+	}
+
+	inline __attribute__((always_inline)) void store_state(simd_avx512_xorshift128plus_key& key) const
+	{
+		key.part1 = part1;
+		key.part2 = part2;
+	}
+
+	// Same sequence as simd_avx512_xorshift128plus::get_rand
+	inline __attribute__((always_inline)) __m512i next()
+	{
+		const __m512i s0 = part2;
+
+		part1 = part2;
+
+		__m512i s1 = _mm512_xor_si512(part2, _mm512_slli_epi64(part2, 23));
+
+		part2 = _mm512_xor_si512(_mm512_xor_si512(_mm512_xor_si512(s1, s0), _mm512_srli_epi64(s1, 18)), _mm512_srli_epi64(s0, 5));
+
+		return _mm512_add_epi64(part2, s0);
+	}
+
+	__m512i part1;
+	__m512i part2;
+};
+
+
 class simd_avx512_xorshift128plus
 {
 protected:
+	// Aligned fills of at least this many numbers (16 MiB) bypass the caches
+	static constexpr uint32_t stream_threshold = uint32_t(1) << 22;
+
 	simd_avx512_xorshift128plus_key mykey;
 
     __m512i simd_avx512_xorshift128plus_rand(simd_avx512_xorshift128plus_key& key) 
@@ -115,14 +215,37 @@ protected:
 
     void populateRandom_avx512_xorshift128plus(uint32_t* rand_arr, const uint32_t size)
     {
-        uint32_t i = 0;
-
         // Automatically seeded 512-bit state variables
         simd_avx512_xorshift128plus_key my_key1;
 
+        populateRandom_avx512_xorshift128plus(rand_arr, size, my_key1);
+    }
+
+    // As above but continues the stream of a caller-owned key
+    void populateRandom_avx512_xorshift128plus(uint32_t* rand_arr, const uint32_t size, simd_avx512_xorshift128plus_key& my_key1)
+    {
+        uint32_t i = 0;
+
 		// This should be 16
 		const uint32_t block = sizeof(__m512i) / sizeof(uint32_t);
 
+        if (uintptr_t(rand_arr) % sizeof(__m512i) == 0)
+        {
+            // See simd_xorshift128plus::populate_array_simd_xorshift128plus
+            if (size >= stream_threshold)
+            {
+                for (; i + block <= size; i += block)
+                    _mm512_stream_si512((__m512i *)(rand_arr + i), simd_avx512_xorshift128plus_rand(my_key1));
+
+                _mm_sfence();
+            }
+            else
+            {
+                for (; i + block <= size; i += block)
+                    _mm512_store_si512((__m512i *)(rand_arr + i), simd_avx512_xorshift128plus_rand(my_key1));
+            }
+        }
+
         while (i + block <= size) 
         {
             // Fill the array with random numbers
@@ -224,7 +347,194 @@ protected:
 	}
 
 
+	// Writes one random number in [0, bounds[i]) for every bound
+	void populate_bounded_avx512_xorshift128plus(const uint32_t* bounds, uint32_t* rand_arr, const uint32_t size, simd_avx512_xorshift128plus_key& my_key1)
+	{
+		uint32_t i = 0;
+
+		const uint32_t block = sizeof(__m512i) / sizeof(uint32_t); // 16
+
+		while (i + block <= size) 
+		{
+			__m512i upperbound = _mm512_loadu_si512((const __m512i *)(bounds + i));
+
+			_mm512_storeu_si512((__m512i *)(rand_arr + i), avx512_randombound_epu32(simd_avx512_xorshift128plus_rand(my_key1), upperbound));
+
+			i += block;
+		}
+
+		if (i != size) 
+		{
+			// Masked load and store handle the remaining elements
+			__mmask16 tail = (__mmask16)((1u << (size - i)) - 1);
+
+			__m512i upperbound = _mm512_maskz_loadu_epi32(tail, bounds + i);
+
+			_mm512_mask_storeu_epi32(rand_arr + i, tail, avx512_randombound_epu32(simd_avx512_xorshift128plus_rand(my_key1), upperbound));
+		}
+	}
+
+	// The AVX-512 version of simd_xorshift128plus::populate_bernoulli_simd_xorshift128plus
+	// Each bit is set with probability P / 2^digits, one random word per binary digit
+	void populate_bernoulli_avx512_xorshift128plus(uint64_t* mask, const uint64_t n_bits, const uint64_t P, const unsigned int digits, simd_avx512_xorshift128plus_key& my_key1)
+	{
+		const uint64_t block = sizeof(__m512i) / sizeof(uint64_t); // 8 words, 512 bits
+
+		const uint64_t n_words = (n_bits + 63) / 64;
+
+		uint64_t i = 0;
+
+		auto next_mask = [&]()
+		{
+			__m512i m = _mm512_setzero_si512();
+
+			for (unsigned int t = 0; t < digits; t++) 
+			{
+				if ((P >> t) & 1)
+					m = _mm512_or_si512(m, simd_avx512_xorshift128plus_rand(my_key1));
+				else
+					m = _mm512_and_si512(m, simd_avx512_xorshift128plus_rand(my_key1));
+			}
+
+			return m;
+		};
+
+		while ((i + block) * 64 <= n_bits) 
+		{
+			_mm512_storeu_si512((__m512i *)(mask + i), next_mask());
+
+			i += block;
+		}
+
+		if (i != n_words) 
+		{
+			__mmask8 tail = (__mmask8)((1u << (n_words - i)) - 1);
+
+			_mm512_mask_storeu_epi64(mask + i, tail, next_mask());
+		}
+
+		// Clear the bits past the end
+		if (n_bits % 64 != 0)
+			mask[n_words - 1] &= (UINT64_C(1) << (n_bits % 64)) - 1;
+	}
+
+	// Bounded indices for a Fisher-Yates shuffle of K elements into positions
+	// positions[t] is in [0, K - t) for t = 0..K-2, enough space for a multiple of 16 is needed
+	void fisher_yates_positions(uint32_t* positions, const uint32_t K, simd_avx512_xorshift128plus_key& my_key1)
+	{
+		__m512i interval = _mm512_sub_epi32(_mm512_set1_epi32(K), _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+
+		const __m512i vec16 = _mm512_set1_epi32(16);
+
+		for (uint32_t t = 0; t + 1 < K; t += 16) 
+		{
+			_mm512_storeu_si512((__m512i *)(positions + t), avx512_randombound_epu32(simd_avx512_xorshift128plus_rand(my_key1), interval));
+
+			interval = _mm512_sub_epi32(interval, vec16);
+		}
+	}
+
+	// Arrays of up to 16 elements, each array is shuffled in one register
+	void shuffle_batch_one_register(uint32_t* arrays, const uint32_t n_arrays, const uint32_t K, simd_avx512_xorshift128plus_key& my_key1)
+	{
+		uint32_t positions[16];
+
+		const __m512i nibble_shift = _mm512_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28, 0, 4, 8, 12, 16, 20, 24, 28);
+		const __m512i nibble_mask = _mm512_set1_epi32(0xF);
+
+		const __mmask16 load_mask = (__mmask16)((1u << K) - 1);
+
+		for (uint32_t a = 0; a < n_arrays; a++) 
+		{
+			uint32_t* array = arrays + size_t(a) * K;
+
+			fisher_yates_positions(positions, K, my_key1);
+
+			uint64_t perm = simd_xorshift128plus::nibble_permutation(positions, K);
+
+			// Low 32 bits of the permutation to the first 8 lanes and the high 32 bits to the rest
+			__m512i spread = _mm512_inserti64x4(_mm512_castsi256_si512(_mm256_set1_epi32(uint32_t(perm))), _mm256_set1_epi32(uint32_t(perm >> 32)), 1);
+
+			__m512i idx = _mm512_and_si512(_mm512_srlv_epi32(spread, nibble_shift), nibble_mask);
+
+			__m512i v = _mm512_maskz_loadu_epi32(load_mask, array);
+
+			_mm512_mask_storeu_epi32(array, load_mask, _mm512_permutexvar_epi32(idx, v));
+		}
+	}
+
+	// Arrays of 17 to 32 elements, the permutation is built as bytes and applied with a two register permute
+	void shuffle_batch_two_registers(uint32_t* arrays, const uint32_t n_arrays, const uint32_t K, simd_avx512_xorshift128plus_key& my_key1)
+	{
+		uint32_t positions[32];
+
+		alignas(32) uint8_t perm[32];
+
+		const __mmask16 load_mask = (__mmask16)((1u << (K - 16)) - 1);
+
+		for (uint32_t a = 0; a < n_arrays; a++) 
+		{
+			uint32_t* array = arrays + size_t(a) * K;
+
+			fisher_yates_positions(positions, K, my_key1);
+
+			_mm256_store_si256((__m256i *)perm, _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+																16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31));
+
+			for (uint32_t i = K - 1; i > 0; i--) 
+			{
+				uint32_t j = positions[K - 1 - i];
+				uint8_t tmp = perm[i];
+				perm[i] = perm[j];
+				perm[j] = tmp;
+			}
+
+			__m512i idx_lo = _mm512_cvtepu8_epi32(_mm_load_si128((const __m128i *)perm));
+			__m512i idx_hi = _mm512_cvtepu8_epi32(_mm_load_si128((const __m128i *)(perm + 16)));
+
+			__m512i v_lo = _mm512_loadu_si512((const __m512i *)array);
+			__m512i v_hi = _mm512_maskz_loadu_epi32(load_mask, array + 16);
+
+			_mm512_storeu_si512((__m512i *)array, _mm512_permutex2var_epi32(v_lo, idx_lo, v_hi));
+			_mm512_mask_storeu_epi32(array + 16, load_mask, _mm512_permutex2var_epi32(v_lo, idx_hi, v_hi));
+		}
+	}
+
+	// Arrays too large for registers are shuffled in place, but still without any per-array setup
+	void shuffle_batch_fisher_yates(uint32_t* arrays, const uint32_t n_arrays, const uint32_t K, simd_avx512_xorshift128plus_key& my_key1)
+	{
+		std::vector<uint32_t> positions((K + 15) / 16 * 16);
+
+		for (uint32_t a = 0; a < n_arrays; a++) 
+		{
+			uint32_t* array = arrays + size_t(a) * K;
+
+			fisher_yates_positions(positions.data(), K, my_key1);
+
+			for (uint32_t i = K - 1; i > 0; i--) 
+			{
+				uint32_t nextpos = positions[K - 1 - i];
+				uint32_t tmp = array[i];
+				array[i] = array[nextpos];
+				array[nextpos] = tmp;
+			}
+		}
+	}
+
 public:
+	// The AVX-512 version of simd_xorshift128plus::avx_randombound_epu32
+	// Gives 16 random 32-bit integers less than the integers in upperbound
+	// using ( randomval * upperbound ) >> 32
+	static __m512i avx512_randombound_epu32(__m512i randomvals, __m512i upperbound) 
+	{
+		__m512i evenparts = _mm512_srli_epi64(_mm512_mul_epu32(randomvals, upperbound), 32);
+
+		__m512i oddparts = _mm512_mul_epu32(_mm512_srli_epi64(randomvals, 32), _mm512_srli_epi64(upperbound, 32));
+
+		// The odd results are already in the high half of each 64-bit element
+		return _mm512_mask_blend_epi32(0xAAAA, evenparts, oddparts);
+	}
+
     // Do nothing at the moment
     simd_avx512_xorshift128plus(){}
     
@@ -233,6 +543,11 @@ public:
     	return populateRandom_avx512_xorshift128plus(rand_arr, N_rands);
     }
 
+    void fill_array(uint32_t* rand_arr, uint32_t N_rands, simd_avx512_xorshift128plus_key& key)
+    {
+    	return populateRandom_avx512_xorshift128plus(rand_arr, N_rands, key);
+    }
+
     void fill_array_two(uint32_t* rand_arr, uint32_t N_rands)
     {
     	return populateRandom_avx512_xorshift128plus_two(rand_arr, N_rands);
@@ -243,6 +558,71 @@ public:
     	return populateRandom_avx512_xorshift128plus_four(rand_arr, N_rands);
     }
 
+    // Random numbers in [0, bounds[i]) for each of the N_rands bounds
+    void bounded_array(const uint32_t* bounds, uint32_t* rand_arr, uint32_t N_rands)
+    {
+    	simd_avx512_xorshift128plus_key key;
+
+    	return populate_bounded_avx512_xorshift128plus(bounds, rand_arr, N_rands, key);
+    }
+
+    void bounded_array(const uint32_t* bounds, uint32_t* rand_arr, uint32_t N_rands, simd_avx512_xorshift128plus_key& key)
+    {
+    	return populate_bounded_avx512_xorshift128plus(bounds, rand_arr, N_rands, key);
+    }
+
+    // Bit-packed mask of n_bits where each bit is set with probability p
+    // p is rounded to precision binary digits, a random word is used per digit
+    void bernoulli_mask(uint64_t* mask, uint64_t n_bits, double p, unsigned int precision, simd_avx512_xorshift128plus_key& key)
+    {
+    	uint64_t P, fill;
+    	unsigned int digits;
+
+    	if (!simd_xorshift128plus::bernoulli_digits(p, precision, &P, &digits, &fill))
+    		return simd_xorshift128plus::fill_bernoulli_constant(mask, n_bits, fill);
+
+    	return populate_bernoulli_avx512_xorshift128plus(mask, n_bits, P, digits, key);
+    }
+
+    void bernoulli_mask(uint64_t* mask, uint64_t n_bits, double p, unsigned int precision = 16)
+    {
+    	simd_avx512_xorshift128plus_key key;
+
+    	return bernoulli_mask(mask, n_bits, p, precision, key);
+    }
+
+    // Exact p = 1 / 2^k, the AND of k random words
+    void bernoulli_mask_pow2(uint64_t* mask, uint64_t n_bits, unsigned int k, simd_avx512_xorshift128plus_key& key)
+    {
+    	if (k == 0)
+    		return simd_xorshift128plus::fill_bernoulli_constant(mask, n_bits, ~UINT64_C(0));
+
+    	return populate_bernoulli_avx512_xorshift128plus(mask, n_bits, 1, k, key);
+    }
+
+    // Shuffles n_arrays arrays of K elements each, stored back to back
+    // Arrays of up to 32 elements are permuted inside one or two vector registers
+    void shuffle_batch(uint32_t* arrays, uint32_t n_arrays, uint32_t K, simd_avx512_xorshift128plus_key& key)
+    {
+    	if (K < 2)
+    		return;
+
+    	if (K <= 16)
+    		return shuffle_batch_one_register(arrays, n_arrays, K, key);
+
+    	if (K <= 32)
+    		return shuffle_batch_two_registers(arrays, n_arrays, K, key);
+
+    	return shuffle_batch_fisher_yates(arrays, n_arrays, K, key);
+    }
+
+    void shuffle_batch(uint32_t* arrays, uint32_t n_arrays, uint32_t K)
+    {
+    	simd_avx512_xorshift128plus_key key;
+
+    	return shuffle_batch(arrays, n_arrays, K, key);
+    }
+
     __m512i get_rand(simd_avx512_xorshift128plus_key& key)
     {
     	return simd_avx512_xorshift128plus_rand(key);
@@ -252,6 +632,115 @@ public:
     {
     	return simd_avx512_xorshift128plus_rand(key);
     }
+
+    // Calls fn(rand, x) on each 512-bit vector x of data and stores the result back in place
+    // See simd_xorshift128plus::transform_with_random
+    template <typename T, typename FN>
+    void transform_with_random(T* data, std::size_t n, FN&& fn, simd_avx512_xorshift128plus_key& key)
+    {
+    	simd_avx512_xorshift128plus_state state(key);
+
+    	unsigned char* bytes = (unsigned char *)data;
+
+    	const std::size_t size = n * sizeof(T);
+    	const std::size_t block = sizeof(__m512i);
+
+    	std::size_t i = 0;
+
+    	while (i + block <= size)
+    	{
+    		_mm512_storeu_si512((__m512i *)(bytes + i), fn(state.next(), _mm512_loadu_si512((const __m512i *)(bytes + i))));
+
+    		i += block;
+    	}
+
+    	if (i != size)
+    	{
+    		unsigned char buffer[sizeof(__m512i)] = {0};
+
+    		std::memcpy(buffer, bytes + i, size - i);
+
+    		_mm512_storeu_si512((__m512i *)buffer, fn(state.next(), _mm512_loadu_si512((const __m512i *)buffer)));
+
+    		std::memcpy(bytes + i, buffer, size - i);
+    	}
+
+    	state.store_state(key);
+    }
+
+    template <typename T, typename FN>
+    void transform_with_random(T* data, std::size_t n, FN&& fn)
+    {
+    	simd_avx512_xorshift128plus_key key;
+
+    	return transform_with_random(data, n, fn, key);
+    }
+
+    // Vectors of keystream generated from each block key, 64 KiB
+    static constexpr uint64_t keystream_block = 1024;
+
+    // The key of keystream block b, see simd_xorshift128plus::keystream_key
+    static simd_avx512_xorshift128plus_key keystream_key(const simd_avx512_xorshift128plus_key& key, uint64_t b)
+    {
+    	alignas(64) uint64_t s1[8];
+    	alignas(64) uint64_t s2[8];
+
+    	_mm512_store_si512((__m512i *)s1, key.part1);
+    	_mm512_store_si512((__m512i *)s2, key.part2);
+
+    	for (int lane = 0; lane < 8; lane++)
+    	{
+    		uint64_t x = s1[lane] ^ simd_xorshift128plus::splitmix64(b);
+
+    		s1[lane] = simd_xorshift128plus::splitmix64(x) ^ s2[lane];
+    		s2[lane] = simd_xorshift128plus::splitmix64(x) | 1; // Never all zero
+    	}
+
+    	simd_avx512_xorshift128plus_key block_key(key);
+
+    	block_key.part1 = _mm512_load_si512((const __m512i *)s1);
+    	block_key.part2 = _mm512_load_si512((const __m512i *)s2);
+
+    	return block_key;
+    }
+
+    // XORs len bytes at buf with the keystream of key, starting at byte offset of the stream
+    // See simd_xorshift128plus::xor_keystream
+    void xor_keystream(void* buf, std::size_t len, const simd_avx512_xorshift128plus_key& key, uint64_t offset = 0)
+    {
+    	unsigned char* bytes = (unsigned char *)buf;
+
+    	const uint64_t block_bytes = keystream_block * sizeof(__m512i);
+
+    	while (len != 0)
+    	{
+    		const uint64_t pos = offset % block_bytes;
+    		const std::size_t n = std::min<uint64_t>(len, block_bytes - pos);
+
+    		simd_avx512_xorshift128plus_state state(keystream_key(key, offset / block_bytes));
+
+    		for (uint64_t v = 0; v < pos / sizeof(__m512i); v++)
+    			state.next();
+
+    		keystream_xor_bytes(bytes, n, pos % sizeof(__m512i), state);
+
+    		bytes += n;
+    		len -= n;
+    		offset += n;
+    	}
+    }
+
+    void xor_keystream(void* buf, std::size_t len)
+    {
+    	simd_avx512_xorshift128plus_key key;
+
+    	return xor_keystream(buf, len, key);
+    }
+
+    void xor_keystream_parallel(void* buf, std::size_t len, const simd_avx512_xorshift128plus_key& key, uint64_t offset, unsigned n_threads)
+    {
+    	return keystream_xor_parallel<simd_avx512_xorshift128plus>(buf, len, key, offset, n_threads);
+    }
 };
 
 
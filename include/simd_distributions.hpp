@@ -0,0 +1,648 @@
+#ifndef SIMDDISTRIBUTIONS_H
+#define SIMDDISTRIBUTIONS_H
+
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+
+#include "simd_intrinsics.hpp"
+#include "simd_xorshift128plus.hpp"
+
+// Non-uniform distributions built on simd_xorshift128plus
+// Exponential and normal use a vectorized log, Poisson and binomial use inversion
+// for small means and Hormann's transformed rejection (PTRS / BTRS) for large ones,
+// with rejected lanes retried under a mask until every lane has been accepted
+class simd_distributions
+{
+protected:
+	simd_xorshift128plus generator;
+
+public:
+	// The PTRS set-up, computed once per array rather than once per vector
+	struct ptrs_constants
+	{
+		double lambda, loglam, b, a, loginvalpha, vr;
+
+		ptrs_constants(double lam) : lambda(lam), loglam(std::log(lam))
+		{
+			b = 0.931 + 2.53 * std::sqrt(lam);
+			a = -0.059 + 0.02483 * b;
+			loginvalpha = std::log(1.1239 + 1.1328 / (b - 3.4));
+			vr = 0.9277 - 3.6224 / (b - 2);
+		}
+	};
+
+	// The BTRS set-up, p <= 0.5
+	struct btrs_constants
+	{
+		uint32_t n;
+		double b, a, c, vr, alpha, lpq, m, h;
+
+		btrs_constants(uint32_t trials, double p) : n(trials)
+		{
+			const double q = 1.0 - p;
+			const double spq = std::sqrt(n * p * q);
+
+			b = 1.15 + 2.53 * spq;
+			a = -0.0873 + 0.0248 * b + 0.01 * p;
+			c = n * p + 0.5;
+			vr = 0.92 - 4.2 / b;
+			alpha = (2.83 + 5.1 / b) * spq;
+			lpq = std::log(p / q);
+			m = std::floor((n + 1) * p);
+			h = std::lgamma(m + 1) + std::lgamma(n - m + 1);
+		}
+	};
+
+protected:
+	// Inversion, each lane counts the entries of F below its uniform
+	// All four lanes share the table walk so no per-lane branching is needed
+	static __m256d inversion_pd(__m256d u, const std::vector<double>& F)
+	{
+		__m256d k = _mm256_setzero_pd();
+
+		const __m256d one = _mm256_set1_pd(1.0);
+
+		for (std::size_t j = 0; j < F.size(); j++)
+		{
+			__m256d above = _mm256_cmp_pd(u, _mm256_set1_pd(F[j]), _CMP_GT_OQ);
+
+			if (_mm256_movemask_pd(above) == 0)
+				break;
+
+			k = _mm256_add_pd(k, _mm256_and_pd(above, one));
+		}
+
+		return k;
+	}
+
+	// Stores 4 integer valued doubles as uint32_t
+	static void store_counts(uint32_t* out, __m256d k)
+	{
+		_mm_storeu_si128((__m128i *)out, _mm256_cvttpd_epi32(k));
+	}
+
+	static void store_counts_partial(uint32_t* out, __m256d k, uint32_t n)
+	{
+		uint32_t buffer[4];
+
+		store_counts(buffer, k);
+
+		std::memcpy(out, buffer, sizeof(uint32_t) * n);
+	}
+
+	// Four uniforms in [0, 1) from a fresh random vector
+	__m256d next_uniform_pd(simd_xorshift128plus_key& key)
+	{
+		return _mm256_sub_pd(_mm256_set1_pd(1.0), uniform_pd(generator.get_rand(key)));
+	}
+
+	// PTRS, Hormann (1993) "The transformed rejection method for generating Poisson random variables"
+	__m256d poisson_ptrs(const ptrs_constants& pc, simd_xorshift128plus_key& key)
+	{
+		const double lambda = pc.lambda, loglam = pc.loglam, b = pc.b, a = pc.a, loginvalpha = pc.loginvalpha, vr = pc.vr;
+
+		const __m256d half = _mm256_set1_pd(0.5);
+		const __m256d sign_mask = _mm256_set1_pd(-0.0);
+
+		__m256d result = _mm256_setzero_pd();
+
+		// Lanes that still need a value
+		__m256d pending = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+
+		while (_mm256_movemask_pd(pending) != 0)
+		{
+			__m256d U = _mm256_sub_pd(next_uniform_pd(key), half);
+			__m256d V = uniform_pd(generator.get_rand(key));
+
+			__m256d us = _mm256_sub_pd(half, _mm256_andnot_pd(sign_mask, U));
+
+			// k = floor((2a / us + b) * U + lam + 0.43)
+			__m256d k = _mm256_floor_pd(_mm256_fmadd_pd(_mm256_add_pd(_mm256_div_pd(_mm256_set1_pd(2 * a), us), _mm256_set1_pd(b)), U,
+														 _mm256_set1_pd(lambda + 0.43)));
+
+			// The quick acceptance region
+			__m256d accept = _mm256_and_pd(_mm256_cmp_pd(us, _mm256_set1_pd(0.07), _CMP_GE_OQ), _mm256_cmp_pd(V, _mm256_set1_pd(vr), _CMP_LE_OQ));
+
+			// Outright rejections
+			__m256d reject = _mm256_or_pd(_mm256_cmp_pd(k, _mm256_setzero_pd(), _CMP_LT_OQ),
+										  _mm256_and_pd(_mm256_cmp_pd(us, _mm256_set1_pd(0.013), _CMP_LT_OQ), _mm256_cmp_pd(V, us, _CMP_GT_OQ)));
+
+			// log(V) + log(invalpha) - log(a / (us * us) + b) <= -lam + k * loglam - log(k!)
+			__m256d lhs = _mm256_sub_pd(_mm256_add_pd(log_pd(V), _mm256_set1_pd(loginvalpha)),
+										log_pd(_mm256_add_pd(_mm256_div_pd(_mm256_set1_pd(a), _mm256_mul_pd(us, us)), _mm256_set1_pd(b))));
+
+			__m256d rhs = _mm256_sub_pd(_mm256_fmadd_pd(k, _mm256_set1_pd(loglam), _mm256_set1_pd(-lambda)), log_factorial_pd(_mm256_max_pd(k, _mm256_setzero_pd())));
+
+			accept = _mm256_or_pd(accept, _mm256_andnot_pd(reject, _mm256_cmp_pd(lhs, rhs, _CMP_LE_OQ)));
+
+			accept = _mm256_and_pd(accept, pending);
+
+			result = _mm256_blendv_pd(result, k, accept);
+			pending = _mm256_andnot_pd(accept, pending);
+		}
+
+		return result;
+	}
+
+	// BTRS, Hormann (1993) "The generation of binomial random variates", needs p <= 0.5
+	__m256d binomial_btrs(const btrs_constants& bc, simd_xorshift128plus_key& key)
+	{
+		const uint32_t n = bc.n;
+		const double b = bc.b, a = bc.a, c = bc.c, vr = bc.vr, alpha = bc.alpha, lpq = bc.lpq, m = bc.m, h = bc.h;
+
+		const __m256d half = _mm256_set1_pd(0.5);
+		const __m256d sign_mask = _mm256_set1_pd(-0.0);
+		const __m256d n_pd = _mm256_set1_pd(n);
+
+		__m256d result = _mm256_setzero_pd();
+
+		__m256d pending = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+
+		while (_mm256_movemask_pd(pending) != 0)
+		{
+			__m256d U = _mm256_sub_pd(next_uniform_pd(key), half);
+			__m256d V = uniform_pd(generator.get_rand(key));
+
+			__m256d us = _mm256_sub_pd(half, _mm256_andnot_pd(sign_mask, U));
+
+			// k = floor((2a / us + b) * U + c)
+			__m256d k = _mm256_floor_pd(_mm256_fmadd_pd(_mm256_add_pd(_mm256_div_pd(_mm256_set1_pd(2 * a), us), _mm256_set1_pd(b)), U, _mm256_set1_pd(c)));
+
+			__m256d reject = _mm256_or_pd(_mm256_cmp_pd(k, _mm256_setzero_pd(), _CMP_LT_OQ), _mm256_cmp_pd(k, n_pd, _CMP_GT_OQ));
+
+			__m256d accept = _mm256_and_pd(_mm256_cmp_pd(us, _mm256_set1_pd(0.07), _CMP_GE_OQ), _mm256_cmp_pd(V, _mm256_set1_pd(vr), _CMP_LE_OQ));
+
+			// Keep k in [0, n] for the log factorials, rejected lanes are masked out anyway
+			__m256d kc = _mm256_min_pd(_mm256_max_pd(k, _mm256_setzero_pd()), n_pd);
+
+			// log(V * alpha / (a / (us * us) + b)) <= h - log(k!) - log((n - k)!) + (k - m) * lpq
+			__m256d lhs = log_pd(_mm256_div_pd(_mm256_mul_pd(V, _mm256_set1_pd(alpha)),
+											   _mm256_add_pd(_mm256_div_pd(_mm256_set1_pd(a), _mm256_mul_pd(us, us)), _mm256_set1_pd(b))));
+
+			__m256d rhs = _mm256_sub_pd(_mm256_sub_pd(_mm256_set1_pd(h), log_factorial_pd(kc)), log_factorial_pd(_mm256_sub_pd(n_pd, kc)));
+
+			rhs = _mm256_fmadd_pd(_mm256_sub_pd(kc, _mm256_set1_pd(m)), _mm256_set1_pd(lpq), rhs);
+
+			accept = _mm256_andnot_pd(reject, _mm256_or_pd(accept, _mm256_cmp_pd(lhs, rhs, _CMP_LE_OQ)));
+
+			accept = _mm256_and_pd(accept, pending);
+
+			result = _mm256_blendv_pd(result, k, accept);
+			pending = _mm256_andnot_pd(accept, pending);
+		}
+
+		return result;
+	}
+
+public:
+	simd_distributions() {}
+
+	// log(k!) for k < 10, larger k use Stirling's series
+	static const double* log_factorial_table()
+	{
+		static const double table[10] = {0.0, 0.0, 0.69314718055994531, 1.79175946922805500, 3.17805383034794562,
+										 4.78749174278204599, 6.57925121201010100, 8.52516136106541430,
+										 10.60460290274525023, 12.80182748008146961};
+		return table;
+	}
+
+	// Below this mean Poisson and binomial use inversion
+	static constexpr double inversion_cutoff = 10.0;
+
+	// Cumulative probabilities for inversion, F[j] = P(X <= j)
+	// Stops once the remaining probability is negligible
+	static std::vector<double> poisson_cdf(double lambda)
+	{
+		std::vector<double> F;
+
+		double p = std::exp(-lambda);
+		double sum = p;
+
+		F.push_back(sum);
+
+		for (uint32_t j = 1; sum < 1.0 - 1e-16 && j < 1000; j++)
+		{
+			p *= lambda / j;
+			sum += p;
+			F.push_back(sum);
+		}
+
+		return F;
+	}
+
+	static std::vector<double> binomial_cdf(uint32_t n, double p)
+	{
+		std::vector<double> F;
+
+		const double q = 1.0 - p;
+		const double s = p / q;
+
+		double r = std::pow(q, double(n));
+		double sum = r;
+
+		F.push_back(sum);
+
+		for (uint32_t j = 1; j <= n && sum < 1.0 - 1e-16; j++)
+		{
+			r *= s * double(n - j + 1) / j;
+			sum += r;
+			F.push_back(sum);
+		}
+
+		return F;
+	}
+
+	// Uniform floats in (0, 1] from the top 23 bits of each 32-bit lane
+	// The bits are injected into the mantissa of 1.0 to give [1, 2), which is flipped to (0, 1]
+	static __m256 uniform_ps(__m256i bits)
+	{
+		__m256 one_two = _mm256_castsi256_ps(_mm256_or_si256(_mm256_srli_epi32(bits, 9), _mm256_set1_epi32(0x3F800000)));
+
+		return _mm256_sub_ps(_mm256_set1_ps(2.0f), one_two);
+	}
+
+	// Uniform doubles in (0, 1] from the top 52 bits of each 64-bit lane
+	static __m256d uniform_pd(__m256i bits)
+	{
+		__m256d one_two = _mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(bits, 12), _mm256_set1_epi64x(0x3FF0000000000000)));
+
+		return _mm256_sub_pd(_mm256_set1_pd(2.0), one_two);
+	}
+
+	// Natural log of 8 positive, normal floats
+	// x = m * 2^e with m in [sqrt(1/2), sqrt(2)), then log(m) = 2 atanh((m - 1) / (m + 1))
+	static __m256 log_ps(__m256 x)
+	{
+		const __m256i offset = _mm256_set1_epi32(0x3F3504F3); // sqrt(1/2)
+
+		__m256i shifted = _mm256_sub_epi32(_mm256_castps_si256(x), offset);
+
+		__m256 e = _mm256_cvtepi32_ps(_mm256_srai_epi32(shifted, 23));
+
+		__m256 m = _mm256_castsi256_ps(_mm256_add_epi32(_mm256_and_si256(shifted, _mm256_set1_epi32(0x007FFFFF)), offset));
+
+		__m256 z = _mm256_div_ps(_mm256_sub_ps(m, _mm256_set1_ps(1.0f)), _mm256_add_ps(m, _mm256_set1_ps(1.0f)));
+
+		__m256 z2 = _mm256_mul_ps(z, z);
+
+		__m256 poly = _mm256_set1_ps(2.0f / 9.0f);
+		poly = _mm256_fmadd_ps(poly, z2, _mm256_set1_ps(2.0f / 7.0f));
+		poly = _mm256_fmadd_ps(poly, z2, _mm256_set1_ps(2.0f / 5.0f));
+		poly = _mm256_fmadd_ps(poly, z2, _mm256_set1_ps(2.0f / 3.0f));
+		poly = _mm256_fmadd_ps(poly, z2, _mm256_set1_ps(2.0f));
+
+		return _mm256_fmadd_ps(e, _mm256_set1_ps(0.69314718f), _mm256_mul_ps(poly, z));
+	}
+
+	// Natural log of 4 positive, normal doubles, as log_ps
+	static __m256d log_pd(__m256d x)
+	{
+		const __m256i offset = _mm256_set1_epi64x(0x3FE6A09E667F3BCD); // sqrt(1/2)
+
+		__m256i shifted = _mm256_sub_epi64(_mm256_castpd_si256(x), offset);
+
+		// There's no 64-bit arithmetic shift or int64 to double in AVX2,
+		// sign extend the 12-bit exponent and convert it with the 1.5 * 2^52 trick
+		__m256i e_bits = _mm256_srli_epi64(shifted, 52);
+		e_bits = _mm256_sub_epi64(_mm256_xor_si256(e_bits, _mm256_set1_epi64x(0x800)), _mm256_set1_epi64x(0x800));
+
+		const __m256d magic = _mm256_set1_pd(6755399441055744.0); // 1.5 * 2^52
+
+		__m256d e = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_add_epi64(e_bits, _mm256_castpd_si256(magic))), magic);
+
+		__m256d m = _mm256_castsi256_pd(_mm256_sub_epi64(_mm256_castpd_si256(x), _mm256_and_si256(shifted, _mm256_set1_epi64x(0xFFF0000000000000))));
+
+		__m256d z = _mm256_div_pd(_mm256_sub_pd(m, _mm256_set1_pd(1.0)), _mm256_add_pd(m, _mm256_set1_pd(1.0)));
+
+		__m256d z2 = _mm256_mul_pd(z, z);
+
+		// 2 * (1 + z^2 / 3 + z^4 / 5 + ... + z^20 / 21)
+		__m256d poly = _mm256_set1_pd(2.0 / 21.0);
+
+		for (int t = 19; t >= 1; t -= 2)
+			poly = _mm256_fmadd_pd(poly, z2, _mm256_set1_pd(2.0 / t));
+
+		return _mm256_fmadd_pd(e, _mm256_set1_pd(0.69314718055994531), _mm256_mul_pd(poly, z));
+	}
+
+	// sin and cos of 2 pi (u - 1/2) for u in [0, 1)
+	// Works from the half angle in [-pi/2, pi/2) where short Taylor series are accurate enough for floats
+	static void sincos_2pi_ps(__m256 u, __m256* s, __m256* c)
+	{
+		__m256 h = _mm256_mul_ps(_mm256_sub_ps(u, _mm256_set1_ps(0.5f)), _mm256_set1_ps(3.14159265f));
+
+		__m256 h2 = _mm256_mul_ps(h, h);
+
+		__m256 sp = _mm256_set1_ps(-1.0f / 39916800.0f);
+		sp = _mm256_fmadd_ps(sp, h2, _mm256_set1_ps(1.0f / 362880.0f));
+		sp = _mm256_fmadd_ps(sp, h2, _mm256_set1_ps(-1.0f / 5040.0f));
+		sp = _mm256_fmadd_ps(sp, h2, _mm256_set1_ps(1.0f / 120.0f));
+		sp = _mm256_fmadd_ps(sp, h2, _mm256_set1_ps(-1.0f / 6.0f));
+		sp = _mm256_fmadd_ps(sp, h2, _mm256_set1_ps(1.0f));
+
+		__m256 sh = _mm256_mul_ps(sp, h);
+
+		__m256 cp = _mm256_set1_ps(1.0f / 479001600.0f);
+		cp = _mm256_fmadd_ps(cp, h2, _mm256_set1_ps(-1.0f / 3628800.0f));
+		cp = _mm256_fmadd_ps(cp, h2, _mm256_set1_ps(1.0f / 40320.0f));
+		cp = _mm256_fmadd_ps(cp, h2, _mm256_set1_ps(-1.0f / 720.0f));
+		cp = _mm256_fmadd_ps(cp, h2, _mm256_set1_ps(1.0f / 24.0f));
+		cp = _mm256_fmadd_ps(cp, h2, _mm256_set1_ps(-0.5f));
+		cp = _mm256_fmadd_ps(cp, h2, _mm256_set1_ps(1.0f));
+
+		// Double angle formulas
+		*s = _mm256_mul_ps(_mm256_set1_ps(2.0f), _mm256_mul_ps(sh, cp));
+		*c = _mm256_fnmadd_ps(_mm256_set1_ps(2.0f), _mm256_mul_ps(sh, sh), _mm256_set1_ps(1.0f));
+	}
+
+	// log(k!) of 4 non-negative integer valued doubles
+	static __m256d log_factorial_pd(__m256d k)
+	{
+		// Stirling's series for lgamma(x) with x = k + 1
+		__m256d x = _mm256_add_pd(k, _mm256_set1_pd(1.0));
+		__m256d inv = _mm256_div_pd(_mm256_set1_pd(1.0), x);
+		__m256d inv2 = _mm256_mul_pd(inv, inv);
+
+		__m256d series = _mm256_set1_pd(1.0 / 1260.0);
+		series = _mm256_fmadd_pd(series, inv2, _mm256_set1_pd(-1.0 / 360.0));
+		series = _mm256_fmadd_pd(series, inv2, _mm256_set1_pd(1.0 / 12.0));
+		series = _mm256_mul_pd(series, inv);
+
+		__m256d stirling = _mm256_fmsub_pd(_mm256_sub_pd(x, _mm256_set1_pd(0.5)), log_pd(x), x);
+		stirling = _mm256_add_pd(stirling, _mm256_add_pd(series, _mm256_set1_pd(0.91893853320467274))); // log(2 pi) / 2
+
+		// Small k come from the table
+		__m128i idx = _mm256_cvttpd_epi32(_mm256_min_pd(k, _mm256_set1_pd(9.0)));
+
+		__m256d small = _mm256_i32gather_pd(log_factorial_table(), idx, 8);
+
+		return _mm256_blendv_pd(stirling, small, _mm256_cmp_pd(k, _mm256_set1_pd(10.0), _CMP_LT_OQ));
+	}
+
+	// Uniform in [0, 1), the mantissa bits of uniform_ps and uniform_pd counted up from 0
+	void uniform_array(float* out, uint32_t N, simd_xorshift128plus_key& key)
+	{
+		const __m256 one = _mm256_set1_ps(1.0f);
+
+		uint32_t i = 0;
+
+		const uint32_t block = sizeof(__m256) / sizeof(float); // 8
+
+		while (i + block <= N)
+		{
+			_mm256_storeu_ps(out + i, _mm256_sub_ps(one, uniform_ps(generator.get_rand(key))));
+
+			i += block;
+		}
+
+		if (i != N)
+		{
+			float buffer[sizeof(__m256) / sizeof(float)];
+
+			_mm256_storeu_ps(buffer, _mm256_sub_ps(one, uniform_ps(generator.get_rand(key))));
+
+			std::memcpy(out + i, buffer, sizeof(float) * (N - i));
+		}
+	}
+
+	void uniform_array(double* out, uint32_t N, simd_xorshift128plus_key& key)
+	{
+		const __m256d one = _mm256_set1_pd(1.0);
+
+		uint32_t i = 0;
+
+		const uint32_t block = sizeof(__m256d) / sizeof(double); // 4
+
+		while (i + block <= N)
+		{
+			_mm256_storeu_pd(out + i, _mm256_sub_pd(one, uniform_pd(generator.get_rand(key))));
+
+			i += block;
+		}
+
+		if (i != N)
+		{
+			double buffer[sizeof(__m256d) / sizeof(double)];
+
+			_mm256_storeu_pd(buffer, _mm256_sub_pd(one, uniform_pd(generator.get_rand(key))));
+
+			std::memcpy(out + i, buffer, sizeof(double) * (N - i));
+		}
+	}
+
+	// Exponential with rate lambda, -log(u) / lambda
+	void exponential_array(float* out, uint32_t N, float lambda, simd_xorshift128plus_key& key)
+	{
+		const __m256 scale = _mm256_set1_ps(-1.0f / lambda);
+
+		uint32_t i = 0;
+
+		const uint32_t block = sizeof(__m256) / sizeof(float); // 8
+
+		while (i + block <= N)
+		{
+			_mm256_storeu_ps(out + i, _mm256_mul_ps(log_ps(uniform_ps(generator.get_rand(key))), scale));
+
+			i += block;
+		}
+
+		if (i != N)
+		{
+			float buffer[sizeof(__m256) / sizeof(float)];
+
+			_mm256_storeu_ps(buffer, _mm256_mul_ps(log_ps(uniform_ps(generator.get_rand(key))), scale));
+
+			std::memcpy(out + i, buffer, sizeof(float) * (N - i));
+		}
+	}
+
+	void exponential_array(double* out, uint32_t N, double lambda, simd_xorshift128plus_key& key)
+	{
+		const __m256d scale = _mm256_set1_pd(-1.0 / lambda);
+
+		uint32_t i = 0;
+
+		const uint32_t block = sizeof(__m256d) / sizeof(double); // 4
+
+		while (i + block <= N)
+		{
+			_mm256_storeu_pd(out + i, _mm256_mul_pd(log_pd(uniform_pd(generator.get_rand(key))), scale));
+
+			i += block;
+		}
+
+		if (i != N)
+		{
+			double buffer[sizeof(__m256d) / sizeof(double)];
+
+			_mm256_storeu_pd(buffer, _mm256_mul_pd(log_pd(uniform_pd(generator.get_rand(key))), scale));
+
+			std::memcpy(out + i, buffer, sizeof(double) * (N - i));
+		}
+	}
+
+	// Integer valued doubles in [0, 2^52) to uint64_t, converted with the 2^52 trick
+	static __m256i cvt_pd_epu64(__m256d k)
+	{
+		const __m256d magic = _mm256_set1_pd(4503599627370496.0); // 2^52
+
+		return _mm256_xor_si256(_mm256_castpd_si256(_mm256_add_pd(k, magic)), _mm256_castpd_si256(magic));
+	}
+
+	// Geometric, the number of failures before the first success of Bernoulli(p) trials
+	// floor(log(u) / log(1 - p)), values are capped at 2^52 - 1
+	void geometric_array(uint64_t* out, uint32_t N, double p, simd_xorshift128plus_key& key)
+	{
+		const __m256d scale = _mm256_set1_pd(1.0 / std::log1p(-p));
+		const __m256d cap = _mm256_set1_pd(4503599627370495.0);
+
+		auto next = [&]()
+		{
+			__m256d g = _mm256_floor_pd(_mm256_mul_pd(log_pd(uniform_pd(generator.get_rand(key))), scale));
+
+			return cvt_pd_epu64(_mm256_min_pd(g, cap));
+		};
+
+		uint32_t i = 0;
+
+		const uint32_t block = sizeof(__m256i) / sizeof(uint64_t); // 4
+
+		while (i + block <= N)
+		{
+			_mm256_storeu_si256((__m256i *)(out + i), next());
+
+			i += block;
+		}
+
+		if (i != N)
+		{
+			uint64_t buffer[sizeof(__m256i) / sizeof(uint64_t)];
+
+			_mm256_storeu_si256((__m256i *)buffer, next());
+
+			std::memcpy(out + i, buffer, sizeof(uint64_t) * (N - i));
+		}
+	}
+
+	// Normal with the given mean and standard deviation using the Box-Muller transform
+	// Each pair of random vectors gives 16 outputs
+	void normal_array(float* out, uint32_t N, float mean, float stddev, simd_xorshift128plus_key& key)
+	{
+		const __m256 m = _mm256_set1_ps(mean);
+		const __m256 sd = _mm256_set1_ps(stddev);
+
+		auto next_pair = [&](__m256* z0, __m256* z1)
+		{
+			// r = sqrt(-2 log u1)
+			__m256 r = _mm256_sqrt_ps(_mm256_mul_ps(_mm256_set1_ps(-2.0f), log_ps(uniform_ps(generator.get_rand(key)))));
+
+			__m256 s, c;
+			sincos_2pi_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), uniform_ps(generator.get_rand(key))), &s, &c);
+
+			*z0 = _mm256_fmadd_ps(_mm256_mul_ps(r, c), sd, m);
+			*z1 = _mm256_fmadd_ps(_mm256_mul_ps(r, s), sd, m);
+		};
+
+		uint32_t i = 0;
+
+		const uint32_t block = sizeof(__m256) / sizeof(float); // 8
+
+		__m256 z0, z1;
+
+		while (i + 2 * block <= N)
+		{
+			next_pair(&z0, &z1);
+
+			_mm256_storeu_ps(out + i, z0);
+			_mm256_storeu_ps(out + i + block, z1);
+
+			i += 2 * block;
+		}
+
+		if (i != N)
+		{
+			float buffer[2 * sizeof(__m256) / sizeof(float)];
+
+			next_pair(&z0, &z1);
+
+			_mm256_storeu_ps(buffer, z0);
+			_mm256_storeu_ps(buffer + block, z1);
+
+			std::memcpy(out + i, buffer, sizeof(float) * (N - i));
+		}
+	}
+
+	void poisson_array(uint32_t* out, uint32_t N, double lambda, simd_xorshift128plus_key& key)
+	{
+		const uint32_t block = sizeof(__m256d) / sizeof(double); // 4
+
+		uint32_t i = 0;
+
+		if (lambda < inversion_cutoff)
+		{
+			const std::vector<double> F = poisson_cdf(lambda);
+
+			for (; i + block <= N; i += block)
+				store_counts(out + i, inversion_pd(next_uniform_pd(key), F));
+
+			if (i != N)
+				store_counts_partial(out + i, inversion_pd(next_uniform_pd(key), F), N - i);
+
+			return;
+		}
+
+		const ptrs_constants pc(lambda);
+
+		for (; i + block <= N; i += block)
+			store_counts(out + i, poisson_ptrs(pc, key));
+
+		if (i != N)
+			store_counts_partial(out + i, poisson_ptrs(pc, key), N - i);
+	}
+
+	void binomial_array(uint32_t* out, uint32_t N, uint32_t n, double p, simd_xorshift128plus_key& key)
+	{
+		const uint32_t block = sizeof(__m256d) / sizeof(double); // 4
+
+		// Both methods want p <= 1/2, the result is flipped back at the end
+		const bool flip = p > 0.5;
+		const double pp = flip ? 1.0 - p : p;
+
+		uint32_t i = 0;
+
+		if (pp == 0.0)
+		{
+			std::fill(out, out + N, flip ? n : 0);
+			return;
+		}
+
+		if (n * pp < inversion_cutoff)
+		{
+			const std::vector<double> F = binomial_cdf(n, pp);
+
+			for (; i + block <= N; i += block)
+				store_counts(out + i, inversion_pd(next_uniform_pd(key), F));
+
+			if (i != N)
+				store_counts_partial(out + i, inversion_pd(next_uniform_pd(key), F), N - i);
+		}
+		else
+		{
+			const btrs_constants bc(n, pp);
+
+			for (; i + block <= N; i += block)
+				store_counts(out + i, binomial_btrs(bc, key));
+
+			if (i != N)
+				store_counts_partial(out + i, binomial_btrs(bc, key), N - i);
+		}
+
+		if (flip)
+			for (i = 0; i < N; i++)
+				out[i] = n - out[i];
+	}
+};
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef SIMDINTRINSICS_H
+#define SIMDINTRINSICS_H
+
+// The headers include the intrinsics through here, before anything else can include them
+// GCC 12's AVX-512 intrinsics start many results from _mm512_undefined_*, which trips
+// -Wmaybe-uninitialized and -Wuninitialized wherever they are inlined. The warnings are
+// ignored for the intrinsic definitions only, the repo's own code is still checked
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+
+#endif
@@ -4,9 +4,16 @@
 #include <cstring>
 #include <iostream>
 #include <array>
-#include <immintrin.h>
+#include <algorithm>
+#include <vector>
 
+#include "simd_intrinsics.hpp"
 #include "randutils.hpp"
+#include "xorshift128plus.hpp"
+#include "keystream.hpp"
+
+// For 64 by 64-bit multiplies, __extension__ keeps -pedantic quiet about the GCC type
+__extension__ typedef unsigned __int128 uint128_type;
 
 // Creates two 256-bit seed variables for use by the PRNG
 class simd_xorshift128plus_key 
@@ -47,6 +54,29 @@ protected:
         output2[0] = s1;
     };
 
+    // Fill the four lanes with states that are each one jump (2^64 steps) apart
+    void init_lanes(uint64_t seed1, uint64_t seed2)
+    {
+        uint64_t S0[4];
+        uint64_t S1[4];
+
+        S0[0] = seed1;
+        S1[0] = seed2;
+        
+        xorshift128plus_jump_onkeys(*S0, *S1, S0 + 1, S1 + 1);
+        xorshift128plus_jump_onkeys(*(S0 + 1), *(S1 + 1), S0 + 2, S1 + 2);
+        xorshift128plus_jump_onkeys(*(S0 + 2), *(S1 + 2), S0 + 3, S1 + 3);
+
+        part1 = _mm256_loadu_si256((const __m256i *) S0);
+        part2 = _mm256_loadu_si256((const __m256i *) S1);
+    }
+
+    struct unmixed {};
+
+    simd_xorshift128plus_key(uint64_t seed1, uint64_t seed2, unmixed)
+    {
+        init_lanes(seed1, seed2);
+    }
 
 public:
     simd_xorshift128plus_key()
@@ -56,9 +86,6 @@ public:
         randutils::auto_seed_128 seeder;
         seeder.generate(seed_array.begin(), seed_array.end());
 
-        uint64_t S0[8];
-        uint64_t S1[8];
-
         uint64_t seed_part1 = seed_array[0];
 		uint64_t seed_part2 = seed_array[1];
 		uint64_t seed_part3 = seed_array[2];
@@ -67,16 +94,56 @@ public:
 		// Create some 64-bit numbers
 		uint64_t seed1 = seed_part1 << 32 | seed_part2;
 		uint64_t seed2 = seed_part3 << 32 | seed_part4;
-                
-        S0[0] = seed1;
-        S1[0] = seed2;
-        
-        xorshift128plus_jump_onkeys(*S0, *S1, S0 + 1, S1 + 1);
-        xorshift128plus_jump_onkeys(*(S0 + 1), *(S1 + 1), S0 + 2, S1 + 2);
-        xorshift128plus_jump_onkeys(*(S0 + 2), *(S1 + 2), S0 + 3, S1 + 3);
 
-        part1 = _mm256_loadu_si256((const __m256i *) S0);
-        part2 = _mm256_loadu_si256((const __m256i *) S1);
+        init_lanes(seed1, seed2);
+    }
+
+    // Explicitly seeded key, reproducible from the seeds. Any pair gives a working key, (0, 0)
+    // included, the seeds are mixed with xorshift128plus_key::mix_seeds before use
+    simd_xorshift128plus_key(uint64_t seed1, uint64_t seed2)
+    {
+        xorshift128plus_key::mix_seeds(seed1, seed2);
+
+        init_lanes(seed1, seed2);
+    }
+
+    // A key whose lane n starts n jumps along from the state (seed1, seed2) itself, unmixed
+    // For callers that place keys on the jump grid, such as rng_pool. The state must not be all zero
+    static simd_xorshift128plus_key from_state(uint64_t seed1, uint64_t seed2)
+    {
+        return simd_xorshift128plus_key(seed1, seed2, unmixed());
+    }
+
+    // A child key for a forked task, see xorshift128plus_key::split
+    // Every lane takes one step and is split on its own, far cheaper than the jumps between lanes
+    simd_xorshift128plus_key split()
+    {
+        const __m256i s0 = part2;
+
+        part1 = part2;
+
+        __m256i s1 = _mm256_xor_si256(part2, _mm256_slli_epi64(part2, 23));
+
+        part2 = _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(s1, s0), _mm256_srli_epi64(s1, 18)), _mm256_srli_epi64(s0, 5));
+
+        alignas(32) uint64_t x[4];
+        alignas(32) uint64_t c1[4];
+        alignas(32) uint64_t c2[4];
+
+        _mm256_store_si256((__m256i *)x, _mm256_add_epi64(part2, s0));
+
+        for (int lane = 0; lane < 4; lane++)
+        {
+            c1[lane] = xorshift128plus_key::splitmix64(x[lane]);
+            c2[lane] = xorshift128plus_key::splitmix64(x[lane]) | 1; // Never all zero
+        }
+
+        simd_xorshift128plus_key child(*this);
+
+        child.part1 = _mm256_load_si256((const __m256i *)c1);
+        child.part2 = _mm256_load_si256((const __m256i *)c2);
+
+        return child;
     }
 
     __m256i part1;
@@ -84,10 +151,58 @@ public:
 };
 
 
+// A value type copy of a key for use inside hand-written SIMD loops
+// Its state is just two local vectors so the compiler can keep it in registers for
+// the whole loop, get_rand has to go back through the key reference on every call.
+// load_state before the loop, next() inside it and store_state after it
+class simd_xorshift128plus_state
+{
+public:
+	simd_xorshift128plus_state() {}
+
+	explicit simd_xorshift128plus_state(const simd_xorshift128plus_key& key)
+	{
+		load_state(key);
+	}
+
+	inline __attribute__((always_inline)) void load_state(const simd_xorshift128plus_key& key)
+	{
+		part1 = key.part1;
+		part2 = key.part2;
+	}
+
+	inline __attribute__((always_inline)) void store_state(simd_xorshift128plus_key& key) const
+	{
+		key.part1 = part1;
+		key.part2 = part2;
+	}
+
+	// Same sequence as simd_xorshift128plus::get_rand
+	inline __attribute__((always_inline)) __m256i next()
+	{
+		const __m256i s0 = part2;
+
+		part1 = part2;
+
+		__m256i s1 = _mm256_xor_si256(part2, _mm256_slli_epi64(part2, 23));
+
+		part2 = _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(s1, s0), _mm256_srli_epi64(s1, 18)), _mm256_srli_epi64(s0, 5));
+
+		return _mm256_add_epi64(part2, s0);
+	}
+
+	__m256i part1;
+	__m256i part2;
+};
+
+
 // A C++ implementation of Lemire's SIMD xor RNG
 class simd_xorshift128plus
 {
 protected:
+	// Aligned fills of at least this many numbers (16 MiB) bypass the caches
+	static constexpr uint32_t stream_threshold = uint32_t(1) << 22;
+
 	// Return a 256-bit random "number"
     __m256i simd_xorshift128plus_rand(simd_xorshift128plus_key& key)
     {
@@ -106,14 +221,38 @@ protected:
 
     void populate_array_simd_xorshift128plus(uint32_t* rand_arr, const uint32_t size)
     {
-        uint32_t i = 0;
-
         // Get two 256-bit seeds
         simd_xorshift128plus_key mykey;
 
+        populate_array_simd_xorshift128plus(rand_arr, size, mykey);
+    }
+
+    // As above but continues the stream of a caller-owned key
+    void populate_array_simd_xorshift128plus(uint32_t* rand_arr, const uint32_t size, simd_xorshift128plus_key& mykey)
+    {
+        uint32_t i = 0;
+
         // The number of variables we're operating on - should be 8 here
         const uint32_t block = sizeof(__m256i) / sizeof(uint32_t); 
 
+        if (uintptr_t(rand_arr) % sizeof(__m256i) == 0)
+        {
+            // Aligned arrays bigger than the caches are written with streaming stores,
+            // so the lines aren't read in first only to be overwritten
+            if (size >= stream_threshold)
+            {
+                for (; i + block <= size; i += block)
+                    _mm256_stream_si256((__m256i *)(rand_arr + i), simd_xorshift128plus_rand(mykey));
+
+                _mm_sfence();
+            }
+            else
+            {
+                for (; i + block <= size; i += block)
+                    _mm256_store_si256((__m256i *)(rand_arr + i), simd_xorshift128plus_rand(mykey));
+            }
+        }
+
         while (i + block <= size) 
         {
             // Fill the array with random numbers
@@ -141,12 +280,18 @@ protected:
     // Uses two generators (states really) to fill an array
     void populate_array_simd_xorshift128plus_two(uint32_t* rand_arr, const uint32_t size) 
     {
-        uint32_t i = 0;
-
         // Two seed objects
         simd_xorshift128plus_key my_key1;   
         simd_xorshift128plus_key my_key2;
 
+        populate_array_simd_xorshift128plus_two(rand_arr, size, my_key1, my_key2);
+    }
+
+    // As above but continues the streams of two caller-owned keys
+    void populate_array_simd_xorshift128plus_two(uint32_t* rand_arr, const uint32_t size, simd_xorshift128plus_key& my_key1, simd_xorshift128plus_key& my_key2) 
+    {
+        uint32_t i = 0;
+
         const uint32_t block = sizeof(__m256i) / sizeof(uint32_t);
         
         while (i + 2 * block <= size) 
@@ -218,6 +363,250 @@ protected:
 		}
 	}
 
+	// Writes one random number in [0, bounds[i]) for every bound
+	void populate_bounded_simd_xorshift128plus(const uint32_t* bounds, uint32_t* rand_arr, const uint32_t size, simd_xorshift128plus_key& mykey)
+	{
+		uint32_t i = 0;
+
+		const uint32_t block = sizeof(__m256i) / sizeof(uint32_t); // 8
+
+		while (i + block <= size) 
+		{
+			__m256i upperbound = _mm256_loadu_si256((const __m256i *)(bounds + i));
+
+			_mm256_storeu_si256((__m256i *)(rand_arr + i), avx_randombound_epu32(simd_xorshift128plus_rand(mykey), upperbound));
+
+			i += block;
+		}
+
+		if (i != size) 
+		{
+			uint32_t buffer[sizeof(__m256i) / sizeof(uint32_t)] = {0};
+
+			std::memcpy(buffer, bounds + i, sizeof(uint32_t) * (size - i));
+
+			__m256i upperbound = _mm256_loadu_si256((const __m256i *)buffer);
+
+			_mm256_storeu_si256((__m256i *)buffer, avx_randombound_epu32(simd_xorshift128plus_rand(mykey), upperbound));
+
+			std::memcpy(rand_arr + i, buffer, sizeof(uint32_t) * (size - i));
+		}
+	}
+
+	// Writes n_bits bits where each bit is set with probability P / 2^digits
+	// P is odd so the lowest binary digit of the probability is 1.
+	// Working up from the lowest digit, a 1 ORs in a new random word and a 0 ANDs one in,
+	// each step halves the probability and adds 1/2 if the digit was 1
+	void populate_bernoulli_simd_xorshift128plus(uint64_t* mask, const uint64_t n_bits, const uint64_t P, const unsigned int digits, simd_xorshift128plus_key& mykey)
+	{
+		const uint64_t block = sizeof(__m256i) / sizeof(uint64_t); // 4 words, 256 bits
+
+		const uint64_t n_words = (n_bits + 63) / 64;
+
+		uint64_t i = 0;
+
+		auto next_mask = [&]()
+		{
+			__m256i m = _mm256_setzero_si256();
+
+			for (unsigned int t = 0; t < digits; t++) 
+			{
+				if ((P >> t) & 1)
+					m = _mm256_or_si256(m, simd_xorshift128plus_rand(mykey));
+				else
+					m = _mm256_and_si256(m, simd_xorshift128plus_rand(mykey));
+			}
+
+			return m;
+		};
+
+		while ((i + block) * 64 <= n_bits) 
+		{
+			_mm256_storeu_si256((__m256i *)(mask + i), next_mask());
+
+			i += block;
+		}
+
+		if (i != n_words) 
+		{
+			uint64_t buffer[sizeof(__m256i) / sizeof(uint64_t)];
+
+			_mm256_storeu_si256((__m256i *)buffer, next_mask());
+
+			std::memcpy(mask + i, buffer, sizeof(uint64_t) * (n_words - i));
+		}
+
+		// Clear the bits past the end
+		if (n_bits % 64 != 0)
+			mask[n_words - 1] &= (UINT64_C(1) << (n_bits % 64)) - 1;
+	}
+
+	// Bounded indices for a Fisher-Yates shuffle of K elements into positions
+	// positions[t] is in [0, K - t) for t = 0..K-2, enough space for a multiple of 8 is needed
+	void fisher_yates_positions(uint32_t* positions, const uint32_t K, simd_xorshift128plus_key& mykey)
+	{
+		__m256i interval = _mm256_setr_epi32(K, K - 1, K - 2, K - 3, K - 4, K - 5, K - 6, K - 7);
+
+		const __m256i vec8 = _mm256_set1_epi32(8);
+
+		for (uint32_t t = 0; t + 1 < K; t += 8) 
+		{
+			_mm256_storeu_si256((__m256i *)(positions + t), avx_randombound_epu32(simd_xorshift128plus_rand(mykey), interval));
+
+			interval = _mm256_sub_epi32(interval, vec8);
+		}
+	}
+
+	// Arrays of up to 8 elements, each array is shuffled in one register
+	void shuffle_batch_one_register(uint32_t* arrays, const uint32_t n_arrays, const uint32_t K, simd_xorshift128plus_key& mykey)
+	{
+		uint32_t positions[8];
+
+		const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+		const __m256i nibble_shift = _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28);
+		const __m256i nibble_mask = _mm256_set1_epi32(0xF);
+
+		// Only the first K lanes are loaded and stored
+		const __m256i load_mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(K), lanes);
+
+		for (uint32_t a = 0; a < n_arrays; a++) 
+		{
+			uint32_t* array = arrays + size_t(a) * K;
+
+			fisher_yates_positions(positions, K, mykey);
+
+			uint32_t perm = uint32_t(nibble_permutation(positions, K));
+
+			__m256i idx = _mm256_and_si256(_mm256_srlv_epi32(_mm256_set1_epi32(perm), nibble_shift), nibble_mask);
+
+			__m256i v = _mm256_maskload_epi32((const int *)array, load_mask);
+
+			_mm256_maskstore_epi32((int *)array, load_mask, _mm256_permutevar8x32_epi32(v, idx));
+		}
+	}
+
+	// Arrays of 9 to 16 elements, each array is shuffled across two registers
+	// Each output lane takes a lane from both registers and blends on bit 3 of its index
+	void shuffle_batch_two_registers(uint32_t* arrays, const uint32_t n_arrays, const uint32_t K, simd_xorshift128plus_key& mykey)
+	{
+		uint32_t positions[16];
+
+		const __m256i lanes = _mm256_setr_epi32(8, 9, 10, 11, 12, 13, 14, 15);
+		const __m256i nibble_shift = _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28);
+		const __m256i nibble_mask = _mm256_set1_epi32(0xF);
+		const __m256i vec8 = _mm256_set1_epi32(8);
+
+		// The second register only holds K - 8 elements
+		const __m256i load_mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(K), lanes);
+
+		for (uint32_t a = 0; a < n_arrays; a++) 
+		{
+			uint32_t* array = arrays + size_t(a) * K;
+
+			fisher_yates_positions(positions, K, mykey);
+
+			uint64_t perm = nibble_permutation(positions, K);
+
+			__m256i idx_lo = _mm256_and_si256(_mm256_srlv_epi32(_mm256_set1_epi32(uint32_t(perm)), nibble_shift), nibble_mask);
+			__m256i idx_hi = _mm256_and_si256(_mm256_srlv_epi32(_mm256_set1_epi32(uint32_t(perm >> 32)), nibble_shift), nibble_mask);
+
+			__m256i v_lo = _mm256_loadu_si256((const __m256i *)array);
+			__m256i v_hi = _mm256_maskload_epi32((const int *)(array + 8), load_mask);
+
+			// _mm256_permutevar8x32_epi32 only looks at the low 3 bits of each index
+			__m256i out_lo = _mm256_blendv_epi8(_mm256_permutevar8x32_epi32(v_lo, idx_lo), _mm256_permutevar8x32_epi32(v_hi, idx_lo),
+												_mm256_cmpeq_epi32(_mm256_and_si256(idx_lo, vec8), vec8));
+			__m256i out_hi = _mm256_blendv_epi8(_mm256_permutevar8x32_epi32(v_lo, idx_hi), _mm256_permutevar8x32_epi32(v_hi, idx_hi),
+												_mm256_cmpeq_epi32(_mm256_and_si256(idx_hi, vec8), vec8));
+
+			_mm256_storeu_si256((__m256i *)array, out_lo);
+			_mm256_maskstore_epi32((int *)(array + 8), load_mask, out_hi);
+		}
+	}
+
+	// Arrays too large for registers are shuffled in place, but still without any per-array setup
+	void shuffle_batch_fisher_yates(uint32_t* arrays, const uint32_t n_arrays, const uint32_t K, simd_xorshift128plus_key& mykey)
+	{
+		std::vector<uint32_t> positions((K + 7) / 8 * 8);
+
+		for (uint32_t a = 0; a < n_arrays; a++) 
+		{
+			uint32_t* array = arrays + size_t(a) * K;
+
+			fisher_yates_positions(positions.data(), K, mykey);
+
+			for (uint32_t i = K - 1; i > 0; i--) 
+			{
+				uint32_t nextpos = positions[K - 1 - i];
+				uint32_t tmp = array[i];
+				array[i] = array[nextpos];
+				array[nextpos] = tmp;
+			}
+		}
+	}
+
+public:
+	// Runs Fisher-Yates on the identity permutation of K <= 16 elements, stored as
+	// 4-bit indices in a 64-bit integer so it stays in a general purpose register.
+	// positions[t] is the swap partner for element K - 1 - t
+	static uint64_t nibble_permutation(const uint32_t* positions, const uint32_t K)
+	{
+		uint64_t perm = UINT64_C(0xFEDCBA9876543210);
+
+		for (uint32_t i = K - 1; i > 0; i--) 
+		{
+			uint32_t j = positions[K - 1 - i];
+
+			uint64_t x = ((perm >> (4 * i)) ^ (perm >> (4 * j))) & 0xF;
+
+			perm ^= (x << (4 * i)) | (x << (4 * j));
+		}
+
+		return perm;
+	}
+
+	// For p = 0 or p = 1 every bit has the same value
+	static void fill_bernoulli_constant(uint64_t* mask, const uint64_t n_bits, const uint64_t fill)
+	{
+		const uint64_t n_words = (n_bits + 63) / 64;
+
+		std::fill(mask, mask + n_words, fill);
+
+		if (n_bits % 64 != 0)
+			mask[n_words - 1] &= (UINT64_C(1) << (n_bits % 64)) - 1;
+	}
+
+	// Turns p into an odd numerator P over 2^digits, rounded to precision binary digits
+	// Returns false if p rounds to 0 or 1, in which case fill holds the value of every bit
+	static bool bernoulli_digits(double p, unsigned int precision, uint64_t* P, unsigned int* digits, uint64_t* fill)
+	{
+		if (precision > 63)
+			precision = 63;
+
+		double scaled = p * double(UINT64_C(1) << precision) + 0.5;
+
+		uint64_t numerator = scaled <= 0.0 ? 0 : uint64_t(scaled);
+
+		if (numerator == 0 || numerator >= (UINT64_C(1) << precision)) 
+		{
+			*fill = numerator == 0 ? 0 : ~UINT64_C(0);
+			return false;
+		}
+
+		unsigned int d = precision;
+
+		while ((numerator & 1) == 0) 
+		{
+			numerator >>= 1;
+			d--;
+		}
+
+		*P = numerator;
+		*digits = d;
+
+		return true;
+	}
+
 	/**
 	* Given 8 random 32-bit integers in randomvals,
 	* derive 8 random 32-bit integers that are less than
@@ -252,10 +641,6 @@ protected:
 		return _mm256_blend_epi32(evenparts, oddparts, 0b10101010);
 	}
 
-
-	
-
-public:
     // Do nothing at the moment
     simd_xorshift128plus(){}
     
@@ -264,16 +649,68 @@ public:
     	return populate_array_simd_xorshift128plus(rand_arr, N_rands);
     }
 
+    void fill_array(uint32_t* rand_arr, uint32_t N_rands, simd_xorshift128plus_key& key)
+    {
+    	return populate_array_simd_xorshift128plus(rand_arr, N_rands, key);
+    }
+
     void fill_array_two(uint32_t* rand_arr, uint32_t N_rands)
     {
     	return populate_array_simd_xorshift128plus_two(rand_arr, N_rands);
     }
 
+    void fill_array_two(uint32_t* rand_arr, uint32_t N_rands, simd_xorshift128plus_key& key1, simd_xorshift128plus_key& key2)
+    {
+    	return populate_array_simd_xorshift128plus_two(rand_arr, N_rands, key1, key2);
+    }
+
     void fill_array_four(uint32_t* rand_arr, uint32_t N_rands)
     {
     	return populate_array_simd_xorshift128plus_four(rand_arr, N_rands);
     }
 
+    // Random numbers in [0, bounds[i]) for each of the N_rands bounds
+    void bounded_array(const uint32_t* bounds, uint32_t* rand_arr, uint32_t N_rands)
+    {
+    	simd_xorshift128plus_key key;
+
+    	return populate_bounded_simd_xorshift128plus(bounds, rand_arr, N_rands, key);
+    }
+
+    void bounded_array(const uint32_t* bounds, uint32_t* rand_arr, uint32_t N_rands, simd_xorshift128plus_key& key)
+    {
+    	return populate_bounded_simd_xorshift128plus(bounds, rand_arr, N_rands, key);
+    }
+
+    // Bit-packed mask of n_bits where each bit is set with probability p
+    // p is rounded to precision binary digits, a random word is used per digit
+    void bernoulli_mask(uint64_t* mask, uint64_t n_bits, double p, unsigned int precision, simd_xorshift128plus_key& key)
+    {
+    	uint64_t P, fill;
+    	unsigned int digits;
+
+    	if (!bernoulli_digits(p, precision, &P, &digits, &fill))
+    		return fill_bernoulli_constant(mask, n_bits, fill);
+
+    	return populate_bernoulli_simd_xorshift128plus(mask, n_bits, P, digits, key);
+    }
+
+    void bernoulli_mask(uint64_t* mask, uint64_t n_bits, double p, unsigned int precision = 16)
+    {
+    	simd_xorshift128plus_key key;
+
+    	return bernoulli_mask(mask, n_bits, p, precision, key);
+    }
+
+    // Exact p = 1 / 2^k, the AND of k random words
+    void bernoulli_mask_pow2(uint64_t* mask, uint64_t n_bits, unsigned int k, simd_xorshift128plus_key& key)
+    {
+    	if (k == 0)
+    		return fill_bernoulli_constant(mask, n_bits, ~UINT64_C(0));
+
+    	return populate_bernoulli_simd_xorshift128plus(mask, n_bits, 1, k, key);
+    }
+
     __m256i get_rand(simd_xorshift128plus_key& key)
     {
     	return simd_xorshift128plus_rand(key);
@@ -284,25 +721,151 @@ public:
     	return simd_xorshift128plus_rand(key);
     }
 
+    // Calls fn(rand, x) on each 256-bit vector x of data and stores the __m256i it returns back in place
+    // The generator state stays in registers for the whole loop and no scratch array is needed.
+    // Any element type works, a partial last vector is padded with zeros and only the valid bytes are written
+    template <typename T, typename FN>
+    void transform_with_random(T* data, std::size_t n, FN&& fn, simd_xorshift128plus_key& key)
+    {
+    	simd_xorshift128plus_state state(key);
+
+    	unsigned char* bytes = (unsigned char *)data;
+
+    	const std::size_t size = n * sizeof(T);
+    	const std::size_t block = sizeof(__m256i);
+
+    	std::size_t i = 0;
+
+    	while (i + block <= size)
+    	{
+    		_mm256_storeu_si256((__m256i *)(bytes + i), fn(state.next(), _mm256_loadu_si256((const __m256i *)(bytes + i))));
+
+    		i += block;
+    	}
+
+    	if (i != size)
+    	{
+    		unsigned char buffer[sizeof(__m256i)] = {0};
+
+    		std::memcpy(buffer, bytes + i, size - i);
+
+    		_mm256_storeu_si256((__m256i *)buffer, fn(state.next(), _mm256_loadu_si256((const __m256i *)buffer)));
+
+    		std::memcpy(bytes + i, buffer, size - i);
+    	}
+
+    	state.store_state(key);
+    }
+
+    template <typename T, typename FN>
+    void transform_with_random(T* data, std::size_t n, FN&& fn)
+    {
+    	simd_xorshift128plus_key key;
+
+    	return transform_with_random(data, n, fn, key);
+    }
+
+    // Vectors of keystream generated from each block key, 64 KiB
+    static constexpr uint64_t keystream_block = 2048;
+
+    // Vigna's splitmix64, used to derive well mixed states from a seed
+    static uint64_t splitmix64(uint64_t& x)
+    {
+    	return xorshift128plus_key::splitmix64(x);
+    }
+
+    // The key of keystream block b, each lane is mixed from the same lane of key and b
+    static simd_xorshift128plus_key keystream_key(const simd_xorshift128plus_key& key, uint64_t b)
+    {
+    	alignas(32) uint64_t s1[4];
+    	alignas(32) uint64_t s2[4];
+
+    	_mm256_store_si256((__m256i *)s1, key.part1);
+    	_mm256_store_si256((__m256i *)s2, key.part2);
+
+    	for (int lane = 0; lane < 4; lane++)
+    	{
+    		uint64_t x = s1[lane] ^ splitmix64(b);
+
+    		s1[lane] = splitmix64(x) ^ s2[lane];
+    		s2[lane] = splitmix64(x) | 1; // Never all zero
+    	}
+
+    	simd_xorshift128plus_key block_key(key);
+
+    	block_key.part1 = _mm256_load_si256((const __m256i *)s1);
+    	block_key.part2 = _mm256_load_si256((const __m256i *)s2);
+
+    	return block_key;
+    }
+
+    // XORs len bytes at buf with the keystream of key, starting at byte offset of the stream
+    // Applying it twice restores the data and any sub-range can be done on its own by passing its offset.
+    // The stream is made of 64 KiB blocks each generated from keystream_key(key, block),
+    // seeking into the middle of a block generates and discards the vectors before it
+    void xor_keystream(void* buf, std::size_t len, const simd_xorshift128plus_key& key, uint64_t offset = 0)
+    {
+    	unsigned char* bytes = (unsigned char *)buf;
+
+    	const uint64_t block_bytes = keystream_block * sizeof(__m256i);
+
+    	while (len != 0)
+    	{
+    		const uint64_t pos = offset % block_bytes;
+    		const std::size_t n = std::min<uint64_t>(len, block_bytes - pos);
+
+    		simd_xorshift128plus_state state(keystream_key(key, offset / block_bytes));
+
+    		for (uint64_t v = 0; v < pos / sizeof(__m256i); v++)
+    			state.next();
+
+    		keystream_xor_bytes(bytes, n, pos % sizeof(__m256i), state);
+
+    		bytes += n;
+    		len -= n;
+    		offset += n;
+    	}
+    }
+
+    // Scrub a buffer with a fresh key
+    void xor_keystream(void* buf, std::size_t len)
+    {
+    	simd_xorshift128plus_key key;
+
+    	return xor_keystream(buf, len, key);
+    }
+
+    // As xor_keystream with the buffer split over n_threads threads
+    void xor_keystream_parallel(void* buf, std::size_t len, const simd_xorshift128plus_key& key, uint64_t offset, unsigned n_threads)
+    {
+    	return keystream_xor_parallel<simd_xorshift128plus>(buf, len, key, offset, n_threads);
+    }
+
     void simd_xorshift128plus_shuffle32(uint32_t *storage, uint32_t size) 
 	{
-		uint32_t i;
-		uint32_t randomsource[8];
-
-		// Create the key here?
 		simd_xorshift128plus_key key;
 
+		return simd_xorshift128plus_shuffle32(storage, size, key);
+	}
+
+	// As above but continues the stream of a caller-owned key
+	void simd_xorshift128plus_shuffle32(uint32_t *storage, uint32_t size, simd_xorshift128plus_key& key)
+	{
+		uint32_t i;
+		alignas(32) uint32_t randomsource[8];
+
 		__m256i interval = _mm256_setr_epi32(size, size - 1, size - 2, size - 3, size - 4, size - 5, size - 6, size - 7);
 
 		__m256i R = avx_randombound_epu32(simd_xorshift128plus_rand(key), interval);
 
-		_mm256_storeu_si256((__m256i *) randomsource, R);
+		_mm256_store_si256((__m256i *) randomsource, R);
 
 		__m256i vec8 = _mm256_set1_epi32(8);
 
 		for (i = size; i > 1;) 
 		{
-			for (int j = 0; j < 8; ++j) 
+			// Stop at i == 1 so sizes that aren't a multiple of 8 don't run off the front
+			for (int j = 0; j < 8 && i > 1; ++j) 
 			{
 				uint32_t nextpos = randomsource[j];
 				int tmp = storage[i - 1]; // likely in cache
@@ -316,9 +879,110 @@ public:
 
 			R = avx_randombound_epu32(simd_xorshift128plus_rand(key), interval);
 
-			_mm256_storeu_si256((__m256i *) randomsource, R);
+			_mm256_store_si256((__m256i *) randomsource, R);
+		}
+	}
+
+	// Shuffles n_arrays arrays of K elements each, stored back to back
+	// Arrays of up to 16 elements are permuted inside vector registers
+	void shuffle_batch(uint32_t* arrays, uint32_t n_arrays, uint32_t K, simd_xorshift128plus_key& key)
+	{
+		if (K < 2)
+			return;
+
+		if (K <= 8)
+			return shuffle_batch_one_register(arrays, n_arrays, K, key);
+
+		if (K <= 16)
+			return shuffle_batch_two_registers(arrays, n_arrays, K, key);
+
+		return shuffle_batch_fisher_yates(arrays, n_arrays, K, key);
+	}
+
+	void shuffle_batch(uint32_t* arrays, uint32_t n_arrays, uint32_t K)
+	{
+		simd_xorshift128plus_key key;
+
+		return shuffle_batch(arrays, n_arrays, K, key);
+	}
+
+	// Writes a uniformly random permutation of 0..size-1 to out in a single pass
+	// This is the "inside-out" Fisher-Yates shuffle, element i is placed and then swapped
+	// with a random earlier position, so there's no need to fill with 0..size-1 first
+	void random_permutation(uint32_t* out, uint32_t size, simd_xorshift128plus_key& key)
+	{
+		uint32_t randomsource[8];
+
+		if (size == 0)
+			return;
+
+		out[0] = 0;
+
+		// Position i needs a random index in [0, i]
+		__m256i interval = _mm256_setr_epi32(2, 3, 4, 5, 6, 7, 8, 9);
+
+		__m256i vec8 = _mm256_set1_epi32(8);
+
+		uint32_t i = 1;
+
+		while (i < size) 
+		{
+			_mm256_storeu_si256((__m256i *) randomsource, avx_randombound_epu32(simd_xorshift128plus_rand(key), interval));
+
+			interval = _mm256_add_epi32(interval, vec8);
+
+			const uint32_t n = (size - i < 8) ? size - i : 8;
+
+			for (uint32_t j = 0; j < n; ++j, ++i) 
+			{
+				uint32_t nextpos = randomsource[j];
+				out[i] = out[nextpos]; // could be costly
+				out[nextpos] = i; // when nextpos == i this overwrites the line above
+			}
 		}
 	}
+
+	void random_permutation(uint32_t* out, uint32_t size)
+	{
+		simd_xorshift128plus_key key;
+
+		return random_permutation(out, size, key);
+	}
+
+	// As random_permutation but with 64-bit indices for permutations of more than 2^32 elements
+	// Each 64-bit random number is reduced with a 128-bit multiply
+	void random_permutation64(uint64_t* out, uint64_t size, simd_xorshift128plus_key& key)
+	{
+		uint64_t randomsource[4];
+
+		if (size == 0)
+			return;
+
+		out[0] = 0;
+
+		uint64_t i = 1;
+
+		while (i < size) 
+		{
+			_mm256_storeu_si256((__m256i *) randomsource, simd_xorshift128plus_rand(key));
+
+			const uint64_t n = (size - i < 4) ? size - i : 4;
+
+			for (uint64_t j = 0; j < n; ++j, ++i) 
+			{
+				uint64_t nextpos = uint64_t((uint128_type(randomsource[j]) * (i + 1)) >> 64);
+				out[i] = out[nextpos];
+				out[nextpos] = i;
+			}
+		}
+	}
+
+	void random_permutation64(uint64_t* out, uint64_t size)
+	{
+		simd_xorshift128plus_key key;
+
+		return random_permutation64(out, size, key);
+	}
 };
 
 
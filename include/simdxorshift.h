@@ -0,0 +1,74 @@
+#ifndef SIMDXORSHIFT_C_H
+#define SIMDXORSHIFT_C_H
+
+/*
+ * C interface to libsimdxorshift.so, for FFI consumers such as ctypes, cffi or Rust
+ *
+ * Every call writes straight into a caller-owned buffer, so a NumPy array or a Rust slice is
+ * filled in place with no copies. Generators are opaque handles holding a SIMD xorshift128+
+ * key. The same seeds give the same numbers from every build of the library.
+ * A handle must not be used by two threads at once. Give each thread its own, from
+ * simdxorshift_split or from its own seeds.
+ * Nothing here throws or aborts. Creating a handle returns NULL when out of memory.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+	#define SIMDXORSHIFT_API
+#else
+	#define SIMDXORSHIFT_API __attribute__((visibility("default")))
+#endif
+
+/* Bumped whenever a signature or the meaning of a seed changes */
+#define SIMDXORSHIFT_ABI_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct simdxorshift_generator simdxorshift_generator;
+
+/* SIMDXORSHIFT_ABI_VERSION of the loaded library */
+SIMDXORSHIFT_API int simdxorshift_abi_version(void);
+
+/*
+ * A generator seeded from (seed1, seed2), reproducible across runs and hosts. Any pair works,
+ * (0, 0) and small seeds included: the pair is mixed with splitmix64 and the low bit of the
+ * second word set, so the state is never all zero
+ */
+SIMDXORSHIFT_API simdxorshift_generator* simdxorshift_create(uint64_t seed1, uint64_t seed2);
+
+/* A generator seeded from system entropy */
+SIMDXORSHIFT_API simdxorshift_generator* simdxorshift_create_auto(void);
+
+/* A child generator for another thread or task, derived from parent alone. parent moves on */
+SIMDXORSHIFT_API simdxorshift_generator* simdxorshift_split(simdxorshift_generator* parent);
+
+SIMDXORSHIFT_API void simdxorshift_destroy(simdxorshift_generator* gen);
+
+/*
+ * Fills of n values. A call uses a whole number of 256-bit vectors from the stream, so the
+ * numbers a generator gives depend on how a request is split into calls.
+ */
+SIMDXORSHIFT_API void simdxorshift_fill_u32(simdxorshift_generator* gen, uint32_t* out, size_t n);
+
+SIMDXORSHIFT_API void simdxorshift_fill_u64(simdxorshift_generator* gen, uint64_t* out, size_t n);
+
+/* Uniform in [0, 1) with 23 or 52 random mantissa bits */
+SIMDXORSHIFT_API void simdxorshift_uniform_f32(simdxorshift_generator* gen, float* out, size_t n);
+
+SIMDXORSHIFT_API void simdxorshift_uniform_f64(simdxorshift_generator* gen, double* out, size_t n);
+
+/* Normal with the given mean and standard deviation, Box-Muller */
+SIMDXORSHIFT_API void simdxorshift_normal_f32(simdxorshift_generator* gen, float* out, size_t n, float mean, float stddev);
+
+/* Fisher-Yates shuffle in place. Returns 0, or -1 without touching data when n >= 2^32 */
+SIMDXORSHIFT_API int simdxorshift_shuffle_u32(simdxorshift_generator* gen, uint32_t* data, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,195 @@
+#ifndef SKIPSAMPLING_H
+#define SKIPSAMPLING_H
+
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <thread>
+#include <utility>
+
+#include "simd_intrinsics.hpp"
+#include "simd_distributions.hpp"
+#include "rng_pool.hpp"
+
+// Sparse random structures by skipping over the failures of a Bernoulli(p) sequence
+// Each success costs one geometric gap, so a sequence of length n costs O(np) rather
+// than the O(n) of testing every position against a threshold
+class skip_sampling
+{
+protected:
+	simd_distributions dist;
+
+	// Gaps are generated in batches of this many
+	static constexpr uint32_t gap_batch = 256;
+
+	// Appends the successes in [start, end) to positions
+	void append_positions(std::vector<uint64_t>& positions, uint64_t start, uint64_t end, double p, simd_xorshift128plus_key& key)
+	{
+		if (p <= 0.0 || start >= end)
+			return;
+
+		uint64_t gaps[gap_batch];
+
+		// The position of the next success, start - 1 + gap + 1
+		uint64_t pos = start;
+
+		for (;;)
+		{
+			dist.geometric_array(gaps, gap_batch, p, key);
+
+			for (uint32_t j = 0; j < gap_batch; j++)
+			{
+				// Can't overflow, gaps are below 2^52
+				if (gaps[j] >= end - pos)
+					return;
+
+				pos += gaps[j];
+
+				positions.push_back(pos);
+
+				pos++;
+			}
+		}
+	}
+
+public:
+	skip_sampling() {}
+
+	// The successes of a Bernoulli(p) sequence of length n, in increasing order
+	std::vector<uint64_t> positions(uint64_t n, double p, simd_xorshift128plus_key& key)
+	{
+		std::vector<uint64_t> result;
+
+		result.reserve(std::size_t(n * p * 1.1) + 16);
+
+		append_positions(result, 0, n, p, key);
+
+		return result;
+	}
+
+	std::vector<uint64_t> positions(uint64_t n, double p)
+	{
+		simd_xorshift128plus_key key;
+
+		return positions(n, p, key);
+	}
+
+	// The sequence is split into one block per thread, each with its own substream from the pool
+	std::vector<uint64_t> positions_parallel(uint64_t n, double p, unsigned n_threads, rng_pool& pool = rng_pool::global())
+	{
+		if (n_threads < 2)
+		{
+			simd_xorshift128plus_key key = pool.make_xorshift_key();
+
+			return positions(n, p, key);
+		}
+
+		std::vector<std::vector<uint64_t>> parts(n_threads);
+		std::vector<std::thread> threads;
+
+		for (unsigned t = 0; t < n_threads; t++)
+		{
+			const uint64_t start = n / n_threads * t;
+			const uint64_t end = t + 1 == n_threads ? n : n / n_threads * (t + 1);
+
+			simd_xorshift128plus_key key = pool.make_xorshift_key();
+
+			threads.emplace_back([&parts, t, start, end, p, key]() mutable
+			{
+				skip_sampling local;
+
+				parts[t].reserve(std::size_t((end - start) * p * 1.1) + 16);
+
+				local.append_positions(parts[t], start, end, p, key);
+			});
+		}
+
+		for (auto& thread : threads)
+			thread.join();
+
+		std::size_t total = 0;
+
+		for (auto& part : parts)
+			total += part.size();
+
+		std::vector<uint64_t> result;
+
+		result.reserve(total);
+
+		for (auto& part : parts)
+			result.insert(result.end(), part.begin(), part.end());
+
+		return result;
+	}
+
+	// Bit-packed mask with each bit set with probability p, for small p
+	// Only the words are cleared, the cost of the bits set is O(n_bits * p)
+	void sparse_mask(uint64_t* mask, uint64_t n_bits, double p, simd_xorshift128plus_key& key)
+	{
+		std::memset(mask, 0, (n_bits + 63) / 64 * sizeof(uint64_t));
+
+		if (p <= 0.0)
+			return;
+
+		uint64_t gaps[gap_batch];
+
+		uint64_t pos = 0;
+
+		for (;;)
+		{
+			dist.geometric_array(gaps, gap_batch, p, key);
+
+			for (uint32_t j = 0; j < gap_batch; j++)
+			{
+				if (gaps[j] >= n_bits - pos)
+					return;
+
+				pos += gaps[j];
+
+				mask[pos / 64] |= uint64_t(1) << (pos % 64);
+
+				pos++;
+			}
+		}
+	}
+
+	// The edges of a G(n, p) Erdos-Renyi graph, each pair i < j is an edge with probability p
+	// Pairs are numbered row by row, row i holds (i, i + 1) ... (i, n - 1)
+	std::vector<std::pair<uint32_t, uint32_t>> erdos_renyi(uint32_t n_vertices, double p, simd_xorshift128plus_key& key)
+	{
+		const uint64_t n_pairs = uint64_t(n_vertices) * (n_vertices - 1) / 2;
+
+		std::vector<uint64_t> pairs = positions(n_vertices < 2 ? 0 : n_pairs, p, key);
+
+		std::vector<std::pair<uint32_t, uint32_t>> edges;
+
+		edges.reserve(pairs.size());
+
+		// The positions are sorted so the row only ever moves forward
+		uint32_t row = 0;
+		uint64_t row_start = 0;
+
+		for (uint64_t pair : pairs)
+		{
+			while (pair >= row_start + (n_vertices - 1 - row))
+			{
+				row_start += n_vertices - 1 - row;
+				row++;
+			}
+
+			edges.emplace_back(row, uint32_t(row + 1 + (pair - row_start)));
+		}
+
+		return edges;
+	}
+
+	std::vector<std::pair<uint32_t, uint32_t>> erdos_renyi(uint32_t n_vertices, double p)
+	{
+		simd_xorshift128plus_key key;
+
+		return erdos_renyi(n_vertices, p, key);
+	}
+};
+
+#endif
@@ -0,0 +1,490 @@
+#ifndef SORTEDSAMPLING_H
+#define SORTEDSAMPLING_H
+
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <numeric>
+
+#include "simd_intrinsics.hpp"
+#include "simd_distributions.hpp"
+#include "rng_pool.hpp"
+
+// Sorted random samples generated in order, no sort needed
+// Sorted uniforms are the normalized partial sums of n + 1 exponential spacings,
+// sorted distinct indices use Vitter's sequential Method D (1987), both are O(n)
+class sorted_sampling
+{
+protected:
+	simd_distributions dist;
+
+	// Spacings are generated and summed in chunks that stay in cache
+	static constexpr uint32_t chunk = 1024;
+
+	// Scalar uniforms in (0, 1) for the sequential methods, generated 64 at a time
+	class uniform_source
+	{
+		simd_xorshift128plus generator;
+		simd_xorshift128plus_key& key;
+
+		alignas(32) double buffer[64];
+		uint32_t pos = 64;
+
+	public:
+		uniform_source(simd_xorshift128plus_key& k) : key(k) {}
+
+		double next()
+		{
+			if (pos == 64)
+			{
+				const __m256d magic = _mm256_set1_pd(4503599627370496.0); // 2^52
+
+				// (k + 1/2) / 2^52 from the top 52 bits, never 0 or 1
+				for (uint32_t i = 0; i < 64; i += 4)
+				{
+					__m256i bits = _mm256_or_si256(_mm256_srli_epi64(generator.get_rand(key), 12), _mm256_castpd_si256(magic));
+
+					__m256d k = _mm256_sub_pd(_mm256_castsi256_pd(bits), magic);
+
+					_mm256_store_pd(buffer + i, _mm256_mul_pd(_mm256_add_pd(k, _mm256_set1_pd(0.5)), _mm256_set1_pd(1.0 / 4503599627370496.0)));
+				}
+
+				pos = 0;
+			}
+
+			return buffer[pos++];
+		}
+	};
+
+	// Inclusive prefix sum of 4 doubles plus the carry from the previous vector
+	static __m256d prefix_sum_pd(__m256d x, __m256d carry)
+	{
+		const __m256d zero = _mm256_setzero_pd();
+
+		// [0, x0, x1, x2] then [0, 0, x0 + x1 ...]
+		x = _mm256_add_pd(x, _mm256_blend_pd(_mm256_permute4x64_pd(x, _MM_SHUFFLE(2, 1, 0, 0)), zero, 0x1));
+		x = _mm256_add_pd(x, _mm256_blend_pd(_mm256_permute4x64_pd(x, _MM_SHUFFLE(1, 0, 0, 0)), zero, 0x3));
+
+		return _mm256_add_pd(x, carry);
+	}
+
+	// Running sums of exponential spacings, returns the sum of all n
+	double spacing_sums(double* out, uint64_t n, double start, simd_xorshift128plus_key& key)
+	{
+		__m256d carry = _mm256_set1_pd(start);
+
+		for (uint64_t i = 0; i < n; i += chunk)
+		{
+			const uint32_t len = uint32_t(std::min<uint64_t>(chunk, n - i));
+
+			dist.exponential_array(out + i, len, 1.0, key);
+
+			uint32_t j = 0;
+
+			for (; j + 4 <= len; j += 4)
+			{
+				__m256d sums = prefix_sum_pd(_mm256_loadu_pd(out + i + j), carry);
+
+				_mm256_storeu_pd(out + i + j, sums);
+
+				// Broadcast the last lane
+				carry = _mm256_permute4x64_pd(sums, _MM_SHUFFLE(3, 3, 3, 3));
+			}
+
+			double last = _mm256_cvtsd_f64(carry);
+
+			for (; j < len; j++)
+			{
+				last += out[i + j];
+				out[i + j] = last;
+			}
+
+			carry = _mm256_set1_pd(last);
+		}
+
+		return _mm256_cvtsd_f64(carry);
+	}
+
+	static void scale_array(double* out, uint64_t n, double scale)
+	{
+		const __m256d s = _mm256_set1_pd(scale);
+
+		uint64_t i = 0;
+
+		for (; i + 4 <= n; i += 4)
+			_mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(out + i), s));
+
+		for (; i < n; i++)
+			out[i] *= scale;
+	}
+
+	// Method A, used by Method D once n is a large fraction of N
+	static void method_a(uint64_t* out, uint64_t n, uint64_t N, uint64_t current, uniform_source& uniform)
+	{
+		double top = double(N - n);
+		double Nreal = double(N);
+
+		while (n >= 2)
+		{
+			const double V = uniform.next();
+
+			uint64_t S = 0;
+
+			double quot = top / Nreal;
+
+			while (quot > V)
+			{
+				S++;
+				top -= 1.0;
+				Nreal -= 1.0;
+				quot = quot * top / Nreal;
+			}
+
+			current += S;
+			*out++ = current++;
+
+			Nreal -= 1.0;
+			n--;
+		}
+
+		*out = current + uint64_t(std::floor(std::round(Nreal) * uniform.next()));
+	}
+
+	// Method D, writes n sorted distinct indices from [current, current + N)
+	static void method_d(uint64_t* out, uint64_t n, uint64_t N, uint64_t current, uniform_source& uniform)
+	{
+		if (n == 0)
+			return;
+
+		if (n == N)
+		{
+			std::iota(out, out + n, current);
+			return;
+		}
+
+		const double negalphainv = -13.0;
+
+		double nreal = double(n);
+		double ninv = 1.0 / nreal;
+		double Nreal = double(N);
+		double Vprime = std::exp(std::log(uniform.next()) * ninv);
+
+		uint64_t qu1 = N - n + 1;
+		double qu1real = Nreal - nreal + 1.0;
+
+		double threshold = -negalphainv * nreal;
+
+		uint64_t S;
+
+		while (n > 1 && threshold < Nreal)
+		{
+			const double nmin1inv = 1.0 / (nreal - 1.0);
+
+			double X;
+
+			for (;;)
+			{
+				// The skip from the continuous envelope
+				for (;;)
+				{
+					X = Nreal * (1.0 - Vprime);
+					S = uint64_t(X);
+
+					if (S < qu1)
+						break;
+
+					Vprime = std::exp(std::log(uniform.next()) * ninv);
+				}
+
+				const double U = uniform.next();
+				const double negSreal = -double(S);
+
+				const double y1 = std::exp(std::log(U * Nreal / qu1real) * nmin1inv);
+
+				Vprime = y1 * (1.0 - X / Nreal) * (qu1real / (negSreal + qu1real));
+
+				// Quick acceptance
+				if (Vprime <= 1.0)
+					break;
+
+				double y2 = 1.0;
+				double top = Nreal - 1.0;
+				double bottom;
+				uint64_t limit;
+
+				if (n - 1 > S)
+				{
+					bottom = Nreal - nreal;
+					limit = N - S;
+				}
+				else
+				{
+					bottom = negSreal + Nreal - 1.0;
+					limit = qu1;
+				}
+
+				for (uint64_t t = N - 1; t >= limit; t--)
+				{
+					y2 = (y2 * top) / bottom;
+					top -= 1.0;
+					bottom -= 1.0;
+				}
+
+				if (Nreal / (Nreal - X) >= y1 * std::exp(std::log(y2) * nmin1inv))
+				{
+					Vprime = std::exp(std::log(uniform.next()) * nmin1inv);
+					break;
+				}
+
+				Vprime = std::exp(std::log(uniform.next()) * ninv);
+			}
+
+			// Skip S records and select the next one
+			current += S;
+			*out++ = current++;
+
+			N = N - S - 1;
+			Nreal = Nreal - double(S) - 1.0;
+			n--;
+			nreal -= 1.0;
+			ninv = nmin1inv;
+			qu1 -= S;
+			qu1real -= double(S);
+			threshold += negalphainv;
+		}
+
+		if (n > 1)
+			method_a(out, n, N, current, uniform);
+		else
+			*out = current + uint64_t(Nreal * Vprime);
+	}
+
+	// How many of the first L of N items are among n drawn without replacement
+	// Inversion searching outwards from the mode, O(standard deviation)
+	static uint64_t hypergeometric(uint64_t N, uint64_t L, uint64_t n, uniform_source& uniform)
+	{
+		const uint64_t lo = n + L > N ? n + L - N : 0;
+		const uint64_t hi = std::min(n, L);
+
+		if (lo == hi)
+			return lo;
+
+		auto log_pmf = [&](double k)
+		{
+			return std::lgamma(L + 1.0) - std::lgamma(k + 1.0) - std::lgamma(L - k + 1.0) +
+				   std::lgamma(N - L + 1.0) - std::lgamma(n - k + 1.0) - std::lgamma(N - L - n + k + 1.0) -
+				   (std::lgamma(N + 1.0) - std::lgamma(n + 1.0) - std::lgamma(N - n + 1.0));
+		};
+
+		uint64_t mode = uint64_t((n + 1.0) * (L + 1.0) / (N + 2.0));
+		mode = std::min(std::max(mode, lo), hi);
+
+		double u = uniform.next();
+
+		// The pmf at the mode, then each step down and up by its ratio to the neighbour
+		const double p_mode = std::exp(log_pmf(double(mode)));
+
+		double p_down = p_mode, p_up = p_mode;
+		uint64_t down = mode, up = mode;
+
+		u -= p_mode;
+
+		while (u > 0.0 && (down > lo || up < hi))
+		{
+			if (up < hi)
+			{
+				// p(k + 1) / p(k) = (L - k)(n - k) / ((k + 1)(N - L - n + k + 1))
+				const double k = double(up);
+
+				p_up *= (L - k) * (n - k) / ((k + 1.0) * (double(N - L) - n + k + 1.0));
+				up++;
+
+				u -= p_up;
+
+				if (u <= 0.0)
+					return up;
+			}
+
+			if (down > lo)
+			{
+				const double k = double(down);
+
+				p_down *= k * (double(N - L) - n + k) / ((L - k + 1.0) * (n - k + 1.0));
+				down--;
+
+				u -= p_down;
+
+				if (u <= 0.0)
+					return down;
+			}
+		}
+
+		return mode;
+	}
+
+public:
+	sorted_sampling() {}
+
+	// n sorted uniforms in [0, 1], out[i] = (E_1 + ... + E_i+1) / (E_1 + ... + E_n+1)
+	void uniforms(double* out, uint64_t n, simd_xorshift128plus_key& key)
+	{
+		double total = spacing_sums(out, n, 0.0, key);
+
+		// The spacing after the largest value
+		double last;
+
+		dist.exponential_array(&last, 1, 1.0, key);
+
+		scale_array(out, n, 1.0 / (total + last));
+	}
+
+	void uniforms(double* out, uint64_t n)
+	{
+		simd_xorshift128plus_key key;
+
+		uniforms(out, n, key);
+	}
+
+	// Blocked version, each thread sums the spacings of its block with its own substream,
+	// then adds the total of the blocks before it and normalizes
+	void uniforms_parallel(double* out, uint64_t n, unsigned n_threads, rng_pool& pool = rng_pool::global())
+	{
+		if (n_threads < 2)
+		{
+			simd_xorshift128plus_key key = pool.make_xorshift_key();
+
+			return uniforms(out, n, key);
+		}
+
+		std::vector<double> block_totals(n_threads + 1, 0.0);
+		std::vector<std::thread> threads;
+
+		auto block_start = [&](unsigned t) { return n / n_threads * t; };
+		auto block_end = [&](unsigned t) { return t + 1 == n_threads ? n : n / n_threads * (t + 1); };
+
+		for (unsigned t = 0; t < n_threads; t++)
+		{
+			simd_xorshift128plus_key key = pool.make_xorshift_key();
+
+			threads.emplace_back([&, t, key]() mutable
+			{
+				sorted_sampling local;
+
+				block_totals[t + 1] = local.spacing_sums(out + block_start(t), block_end(t) - block_start(t), 0.0, key);
+			});
+		}
+
+		for (auto& thread : threads)
+			thread.join();
+
+		threads.clear();
+
+		// The final spacing
+		simd_xorshift128plus_key key = pool.make_xorshift_key();
+
+		double last;
+
+		dist.exponential_array(&last, 1, 1.0, key);
+
+		std::partial_sum(block_totals.begin(), block_totals.end(), block_totals.begin());
+
+		const double inv_total = 1.0 / (block_totals[n_threads] + last);
+
+		for (unsigned t = 0; t < n_threads; t++)
+		{
+			threads.emplace_back([&, t]()
+			{
+				double* block = out + block_start(t);
+
+				const uint64_t len = block_end(t) - block_start(t);
+				const double offset = block_totals[t];
+
+				const __m256d o = _mm256_set1_pd(offset);
+				const __m256d s = _mm256_set1_pd(inv_total);
+
+				uint64_t i = 0;
+
+				for (; i + 4 <= len; i += 4)
+					_mm256_storeu_pd(block + i, _mm256_mul_pd(_mm256_add_pd(_mm256_loadu_pd(block + i), o), s));
+
+				for (; i < len; i++)
+					block[i] = (block[i] + offset) * inv_total;
+			});
+		}
+
+		for (auto& thread : threads)
+			thread.join();
+	}
+
+	// n sorted distinct indices from [0, N)
+	void indices(uint64_t* out, uint64_t n, uint64_t N, simd_xorshift128plus_key& key)
+	{
+		uniform_source uniform(key);
+
+		method_d(out, std::min(n, N), N, 0, uniform);
+	}
+
+	void indices(uint64_t* out, uint64_t n, uint64_t N)
+	{
+		simd_xorshift128plus_key key;
+
+		indices(out, n, N, key);
+	}
+
+	// Blocked version, [0, N) is split into one block per thread and the number of indices
+	// in each block is drawn from the hypergeometric distribution before the threads start
+	void indices_parallel(uint64_t* out, uint64_t n, uint64_t N, unsigned n_threads, rng_pool& pool = rng_pool::global())
+	{
+		n = std::min(n, N);
+
+		simd_xorshift128plus_key key = pool.make_xorshift_key();
+
+		if (n_threads < 2)
+			return indices(out, n, N, key);
+
+		std::vector<uint64_t> counts(n_threads);
+
+		uniform_source uniform(key);
+
+		uint64_t remaining_N = N, remaining_n = n;
+
+		for (unsigned t = 0; t < n_threads; t++)
+		{
+			const uint64_t len = t + 1 == n_threads ? remaining_N : N / n_threads;
+
+			counts[t] = hypergeometric(remaining_N, len, remaining_n, uniform);
+
+			remaining_N -= len;
+			remaining_n -= counts[t];
+		}
+
+		std::vector<std::thread> threads;
+
+		uint64_t offset = 0;
+
+		for (unsigned t = 0; t < n_threads; t++)
+		{
+			const uint64_t start = N / n_threads * t;
+			const uint64_t len = t + 1 == n_threads ? N - start : N / n_threads;
+
+			simd_xorshift128plus_key block_key = pool.make_xorshift_key();
+
+			threads.emplace_back([out, offset, start, len, &counts, t, block_key]() mutable
+			{
+				uniform_source block_uniform(block_key);
+
+				method_d(out + offset, counts[t], len, start, block_uniform);
+			});
+
+			offset += counts[t];
+		}
+
+		for (auto& thread : threads)
+			thread.join();
+	}
+};
+
+#endif
@@ -1,5 +1,10 @@
+#ifndef XORSHIFT128PLUS_H
+#define XORSHIFT128PLUS_H
 
 #include <cstdint>
+#include <array>
+
+#include "randutils.hpp"
 
 class xorshift128plus_key
 {
@@ -22,6 +27,81 @@ public:
 		seed2 = seed_part3 << 32 | seed_part4;
 	}
 
+	// Explicitly seeded key, gives a reproducible stream
+	xorshift128plus_key(uint64_t s1, uint64_t s2) : seed1(s1), seed2(s2) {}
+
+	// Advance the state by 2^64 calls to the generator
+	// This is the jump function from Vigna's original code
+	void jump()
+	{
+		static const uint64_t JUMP[] = { 0x8a5cd789635d2dff, 0x121fd2155c472f96 };
+
+		uint64_t s0 = 0;
+		uint64_t s1 = 0;
+
+		for (unsigned int i = 0; i < sizeof(JUMP) / sizeof(*JUMP); i++)
+		{
+			for (int b = 0; b < 64; b++) 
+			{
+				if (JUMP[i] & 1ULL << b) 
+				{
+					s0 ^= seed1;
+					s1 ^= seed2;
+				}
+
+				uint64_t t1 = seed1;
+				const uint64_t t0 = seed2;
+				seed1 = t0;
+				t1 ^= t1 << 23; // a
+				seed2 = t1 ^ t0 ^ (t1 >> 18) ^ (t0 >> 5); // b, c
+			}
+		}
+
+		seed1 = s0;
+		seed2 = s1;
+	}
+
+	// Vigna's splitmix64, used to derive well mixed states from a seed
+	static uint64_t splitmix64(uint64_t& x)
+	{
+		uint64_t z = (x += UINT64_C(0x9E3779B97F4A7C15));
+
+		z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+		z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+
+		return z ^ (z >> 31);
+	}
+
+	// Mixes an explicit seed pair into a state with splitmix64, so zero and small seeds start as
+	// well mixed as any other. The low bit of seed2 is set, the state is never all zero
+	static void mix_seeds(uint64_t& seed1, uint64_t& seed2)
+	{
+		uint64_t b = seed2;
+		uint64_t x = seed1 ^ splitmix64(b);
+
+		seed1 = splitmix64(x) ^ seed2;
+		seed2 = splitmix64(x) | 1; // Never all zero
+	}
+
+	// A child key for a forked task, derived from this key alone
+	// This key takes one step and the output is mixed with splitmix64 into the child state, so
+	// successive splits give different children and a task tree gets the same keys in any schedule
+	xorshift128plus_key split()
+	{
+		uint64_t t1 = seed1;
+		const uint64_t t0 = seed2;
+		seed1 = t0;
+		t1 ^= t1 << 23; // a
+		seed2 = t1 ^ t0 ^ (t1 >> 18) ^ (t0 >> 5); // b, c
+
+		uint64_t x = seed2 + t0;
+
+		const uint64_t child1 = splitmix64(x);
+		const uint64_t child2 = splitmix64(x) | 1; // Never all zero
+
+		return xorshift128plus_key(child1, child2);
+	}
+
 	uint64_t seed1 = 0;
     uint64_t seed2 = 0;
 };
@@ -91,6 +171,20 @@ public:
     	return populateRandom_xorshift128plus(rand_arr, N_rands);
     }
 
+    // Random numbers in [0, bounds[i]) for each of the N_rands bounds
+    void bounded_array(const uint32_t* bounds, uint32_t* rand_arr, uint32_t N_rands)
+    {
+    	xorshift128plus_key key;
+
+    	uint32_t i = 0;
+
+    	for (; i + 2 <= N_rands; i += 2)
+    		xorshift128plus_bounded_two_by_two(key, bounds[i], bounds[i + 1], rand_arr + i, rand_arr + i + 1);
+
+    	if (i != N_rands)
+    		rand_arr[i] = xorshift128plus_bounded(key, bounds[i]);
+    }
+
     uint64_t get_rand(xorshift128plus_key& key)
     {
     	return xorshift128plus_rand(key);
@@ -143,4 +237,6 @@ public:
 		}
 	}
 	
-};
\ No newline at end of file
+};
+
+#endif
@@ -0,0 +1,195 @@
+#ifndef XORSHIFT128PLUS_STREAMS_H
+#define XORSHIFT128PLUS_STREAMS_H
+
+#include <cstdint>
+#include <cstring>
+#include <array>
+
+#include "simd_intrinsics.hpp"
+#include "randutils.hpp"
+#include "xorshift128plus.hpp"
+
+// The states of many independent xorshift128+ streams, stored as two aligned arrays
+// rather than an array of xorshift128plus_key objects. All of the streams (or any subset)
+// are advanced together with the AVX2 or AVX-512 xorshift step. Stream i produces
+// the same numbers as xorshift128plus::get_rand on the key returned by key(i)
+class xorshift128plus_streams
+{
+protected:
+	// seed1 and seed2 of every stream
+	uint64_t* state1 = nullptr;
+	uint64_t* state2 = nullptr;
+
+	std::size_t n_streams = 0;
+
+	// Rounded up to a whole number of 512-bit vectors, the spare states are never output
+	std::size_t capacity = 0;
+
+	// Stream i starts i jumps (2^64 steps each) from (seed1, seed2)
+	void init_streams(std::size_t M, uint64_t seed1, uint64_t seed2)
+	{
+		n_streams = M;
+		capacity = (M + 7) / 8 * 8;
+
+		state1 = (uint64_t *)_mm_malloc(capacity * sizeof(uint64_t), 64);
+		state2 = (uint64_t *)_mm_malloc(capacity * sizeof(uint64_t), 64);
+
+		xorshift128plus_key key(seed1, seed2);
+
+		for (std::size_t i = 0; i < capacity; i++)
+		{
+			state1[i] = key.seed1;
+			state2[i] = key.seed2;
+
+			if (i + 1 < M)
+				key.jump();
+		}
+	}
+
+#if defined(__AVX512F__)
+	// One xorshift128+ step on 8 streams
+	static __m512i step_avx512(__m512i& part1, __m512i& part2)
+	{
+		__m512i s1 = part1;
+
+		const __m512i s0 = part2;
+
+		part1 = s0;
+
+		s1 = _mm512_xor_si512(s1, _mm512_slli_epi64(s1, 23));
+
+		part2 = _mm512_xor_si512(_mm512_xor_si512(_mm512_xor_si512(s1, s0), _mm512_srli_epi64(s1, 18)), _mm512_srli_epi64(s0, 5));
+
+		return _mm512_add_epi64(part2, s0);
+	}
+
+	// Advances the streams in the bits of mask, streams past n_streams are never selected
+	void step_streams(uint64_t* out, const uint64_t* mask)
+	{
+		for (std::size_t i = 0; i < capacity; i += 8)
+		{
+			__mmask8 active = (__mmask8)(mask == nullptr ? 0xFF : (mask[i / 64] >> (i % 64)) & 0xFF);
+
+			if (i + 8 > n_streams)
+				active &= (__mmask8)((1u << (n_streams - i)) - 1);
+
+			if (active == 0)
+				continue;
+
+			__m512i part1 = _mm512_load_si512((const __m512i *)(state1 + i));
+			__m512i part2 = _mm512_load_si512((const __m512i *)(state2 + i));
+
+			__m512i rand = step_avx512(part1, part2);
+
+			_mm512_mask_store_epi64(state1 + i, active, part1);
+			_mm512_mask_store_epi64(state2 + i, active, part2);
+			_mm512_mask_storeu_epi64(out + i, active, rand);
+		}
+	}
+#else
+	// One xorshift128+ step on 4 streams
+	static __m256i step_avx2(__m256i& part1, __m256i& part2)
+	{
+		__m256i s1 = part1;
+
+		const __m256i s0 = part2;
+
+		part1 = s0;
+
+		s1 = _mm256_xor_si256(s1, _mm256_slli_epi64(s1, 23));
+
+		part2 = _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(s1, s0), _mm256_srli_epi64(s1, 18)), _mm256_srli_epi64(s0, 5));
+
+		return _mm256_add_epi64(part2, s0);
+	}
+
+	// Advances the streams in the bits of mask, streams past n_streams are never selected
+	void step_streams(uint64_t* out, const uint64_t* mask)
+	{
+		const __m256i lane_bits = _mm256_setr_epi64x(1, 2, 4, 8);
+
+		for (std::size_t i = 0; i < capacity; i += 4)
+		{
+			uint64_t bits = mask == nullptr ? 0xF : (mask[i / 64] >> (i % 64)) & 0xF;
+
+			if (i + 4 > n_streams)
+				bits &= (i < n_streams) ? (UINT64_C(1) << (n_streams - i)) - 1 : 0;
+
+			if (bits == 0)
+				continue;
+
+			// Spread the four mask bits over the four 64-bit lanes
+			__m256i active = _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_set1_epi64x(bits), lane_bits), lane_bits);
+
+			__m256i part1 = _mm256_load_si256((const __m256i *)(state1 + i));
+			__m256i part2 = _mm256_load_si256((const __m256i *)(state2 + i));
+
+			__m256i rand = step_avx2(part1, part2);
+
+			_mm256_maskstore_epi64((long long *)(state1 + i), active, part1);
+			_mm256_maskstore_epi64((long long *)(state2 + i), active, part2);
+			_mm256_maskstore_epi64((long long *)(out + i), active, rand);
+		}
+	}
+#endif
+
+public:
+	// M streams from an automatically seeded base state
+	xorshift128plus_streams(std::size_t M)
+	{
+		std::array<uint32_t, 4> seed_array;
+
+	    randutils::auto_seed_128 seeder;
+
+		seeder.generate(seed_array.begin(), seed_array.end());
+
+		uint64_t seed_part1 = seed_array[0];
+		uint64_t seed_part2 = seed_array[1];
+		uint64_t seed_part3 = seed_array[2];
+		uint64_t seed_part4 = seed_array[3];
+
+		// Create some 64-bit numbers
+		init_streams(M, seed_part1 << 32 | seed_part2, seed_part3 << 32 | seed_part4);
+	}
+
+	// M streams with a reproducible base state
+	xorshift128plus_streams(std::size_t M, uint64_t seed1, uint64_t seed2)
+	{
+		init_streams(M, seed1, seed2);
+	}
+
+	~xorshift128plus_streams()
+	{
+		_mm_free(state1);
+		_mm_free(state2);
+	}
+
+	xorshift128plus_streams(const xorshift128plus_streams&) = delete;
+	xorshift128plus_streams& operator=(const xorshift128plus_streams&) = delete;
+
+	std::size_t size() const
+	{
+		return n_streams;
+	}
+
+	// Advance every stream once, out[i] is the output of stream i
+	void step(uint64_t* out)
+	{
+		return step_streams(out, nullptr);
+	}
+
+	// Only advance the streams whose bit is set in mask, bit i is (mask[i / 64] >> (i % 64)) & 1
+	// The other streams keep their state and their entries in out are left alone
+	void step_masked(uint64_t* out, const uint64_t* mask)
+	{
+		return step_streams(out, mask);
+	}
+
+	// The current state of stream i as a scalar key
+	xorshift128plus_key key(std::size_t i) const
+	{
+		return xorshift128plus_key(state1[i], state2[i]);
+	}
+};
+
+#endif
@@ -7,4 +7,52 @@ int main()
 	my_bench.run_generators();
 
 	my_bench.run_shuffle();
+
+	my_bench.run_thread_pool();
+
+	my_bench.run_prefill();
+
+	my_bench.run_bounded();
+
+	my_bench.run_bernoulli();
+
+	my_bench.run_permutation();
+
+	my_bench.run_shuffle_batch();
+
+	my_bench.run_streams();
+
+	my_bench.run_inline_state();
+
+	my_bench.run_distributions();
+
+	my_bench.run_skip_sampling();
+
+	my_bench.run_sorted_sampling();
+
+	my_bench.run_reservoir();
+
+	my_bench.run_bootstrap();
+
+	my_bench.run_transform();
+
+	my_bench.run_keystream();
+
+	my_bench.run_projection();
+
+	my_bench.run_low_precision();
+
+	my_bench.run_tokens();
+
+	my_bench.run_numa();
+
+	my_bench.run_aligned();
+
+	my_bench.run_autotune();
+
+	my_bench.run_canonical();
+
+	my_bench.run_split();
+
+	my_bench.run_shm_attach();
 }
\ No newline at end of file
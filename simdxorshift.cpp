@@ -0,0 +1,111 @@
+#include <new>
+#include <algorithm>
+
+#include "include/simdxorshift.h"
+#include "include/simd_xorshift128plus.hpp"
+#include "include/simd_distributions.hpp"
+
+// The C interface of libsimdxorshift.so, see include/simdxorshift.h
+// Built with -fvisibility=hidden, so only the functions marked SIMDXORSHIFT_API are exported
+struct simdxorshift_generator
+{
+	simd_xorshift128plus_key key;
+	simd_xorshift128plus generator;
+	simd_distributions distributions;
+
+	explicit simdxorshift_generator(const simd_xorshift128plus_key& k) : key(k) {}
+};
+
+namespace
+{
+	// The kernels take 32-bit sizes, larger buffers go in chunks of whole vectors
+	const std::size_t chunk = std::size_t(1) << 30;
+
+	// The key is copied to the stack for the call, the kernels' stores through out could alias it
+	// on the heap and force a reload of the key after every vector
+	template <typename T, typename FN>
+	void in_chunks(simdxorshift_generator* gen, T* out, std::size_t n, FN&& fn)
+	{
+		simd_xorshift128plus_key key(gen->key);
+
+		for (std::size_t i = 0; i < n; i += chunk)
+			fn(out + i, uint32_t(std::min(chunk, n - i)), key);
+
+		gen->key = key;
+	}
+
+	simdxorshift_generator* create(const simd_xorshift128plus_key& key)
+	{
+		return new (std::nothrow) simdxorshift_generator(key);
+	}
+}
+
+extern "C"
+{
+
+int simdxorshift_abi_version(void)
+{
+	return SIMDXORSHIFT_ABI_VERSION;
+}
+
+// The key's seeded constructor mixes the pair, see simdxorshift.h
+simdxorshift_generator* simdxorshift_create(uint64_t seed1, uint64_t seed2)
+{
+	return create(simd_xorshift128plus_key(seed1, seed2));
+}
+
+simdxorshift_generator* simdxorshift_create_auto(void)
+{
+	return create(simd_xorshift128plus_key());
+}
+
+simdxorshift_generator* simdxorshift_split(simdxorshift_generator* parent)
+{
+	return create(parent->key.split());
+}
+
+void simdxorshift_destroy(simdxorshift_generator* gen)
+{
+	delete gen;
+}
+
+void simdxorshift_fill_u32(simdxorshift_generator* gen, uint32_t* out, size_t n)
+{
+	in_chunks(gen, out, n, [gen](uint32_t* p, uint32_t m, simd_xorshift128plus_key& key) { gen->generator.fill_array(p, m, key); });
+}
+
+void simdxorshift_fill_u64(simdxorshift_generator* gen, uint64_t* out, size_t n)
+{
+	simdxorshift_fill_u32(gen, (uint32_t *)out, 2 * n);
+}
+
+void simdxorshift_uniform_f32(simdxorshift_generator* gen, float* out, size_t n)
+{
+	in_chunks(gen, out, n, [gen](float* p, uint32_t m, simd_xorshift128plus_key& key) { gen->distributions.uniform_array(p, m, key); });
+}
+
+void simdxorshift_uniform_f64(simdxorshift_generator* gen, double* out, size_t n)
+{
+	in_chunks(gen, out, n, [gen](double* p, uint32_t m, simd_xorshift128plus_key& key) { gen->distributions.uniform_array(p, m, key); });
+}
+
+void simdxorshift_normal_f32(simdxorshift_generator* gen, float* out, size_t n, float mean, float stddev)
+{
+	in_chunks(gen, out, n, [gen, mean, stddev](float* p, uint32_t m, simd_xorshift128plus_key& key) { gen->distributions.normal_array(p, m, mean, stddev, key); });
+}
+
+int simdxorshift_shuffle_u32(simdxorshift_generator* gen, uint32_t* data, size_t n)
+{
+	if (n > UINT32_MAX)
+		return -1;
+
+	simd_xorshift128plus_key key(gen->key);
+
+	gen->generator.simd_xorshift128plus_shuffle32(data, uint32_t(n), key);
+
+	gen->key = key;
+
+	return 0;
+}
+
+}